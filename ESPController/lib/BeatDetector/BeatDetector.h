@@ -0,0 +1,201 @@
+#ifndef BEAT_DETECTOR_H
+#define BEAT_DETECTOR_H
+
+#include <stdint.h>
+
+#define BEAT_FLUX_HISTORY           32      // Number of frames the adaptive threshold is calculated from
+#define BEAT_INTERVAL_HISTORY       8       // Number of onset intervals the tempo is estimated from
+#define BEAT_THRESHOLD_DEVIATIONS   5       // Distance of the threshold from the mean flux, in mean absolute deviations
+#define BEAT_MIN_FLUX               8       // Flux below this is never an onset (silence, noise)
+#define BEAT_MIN_INTERVAL           200     // Minimum time between two onsets in ms
+#define BEAT_MAX_INTERVAL           2000    // Onsets further apart than this in ms don't belong to the same beat
+
+// Intervals are folded into one octave of periods (80 to 160 bpm) before the tempo is estimated, so onsets on every
+// half or every second beat give the same tempo
+#define BEAT_MIN_PERIOD             375
+#define BEAT_MAX_PERIOD             750
+
+
+/*
+ * Spectral flux onset detector with a running tempo estimate. process() is called with the magnitude spectrum of
+ * every frame (the output of FixedFFT::compute()). The flux is the sum of all magnitudes that rose since the last
+ * frame. A frame is an onset if its flux exceeds the mean of the last BEAT_FLUX_HISTORY frames by
+ * BEAT_THRESHOLD_DEVIATIONS mean absolute deviations, so the threshold follows the loudness of the input. Onsets go
+ * into the history clipped to the threshold, so a loud beat doesn't hide the next ones.
+ *
+ * The tempo is the mean of the last BEAT_INTERVAL_HISTORY intervals between onsets (folded into one octave), without
+ * the intervals that are more than 10% off their median. Everything is integer math on fixed size ring buffers.
+ *
+ * MAX_BINS is the maximum number of bins of the spectrum. If the number of bins changes, the detector starts over.
+ */
+template <uint16_t MAX_BINS>
+class BeatDetector {
+    private:
+        uint16_t m_previous[MAX_BINS];      // Spectrum of the last frame
+        uint16_t m_bins;
+
+        uint32_t m_flux[BEAT_FLUX_HISTORY]; // Ring buffer of the flux of the last frames
+        uint8_t m_fluxHead;
+        uint8_t m_fluxCount;
+        uint32_t m_lastFlux;
+        uint32_t m_threshold;
+
+        uint16_t m_intervals[BEAT_INTERVAL_HISTORY];   // Ring buffer of the last folded onset intervals
+        uint8_t m_intervalHead;
+        uint8_t m_intervalCount;
+
+        bool m_onset;
+        bool m_lastOnsetValid;
+        uint32_t m_lastOnset;               // Time of the last onset in ms
+        uint32_t m_onsets;
+        uint16_t m_period;                  // Estimated beat period in ms, 0 if unknown
+
+        void estimatePeriod() {
+            // Median of the intervals (insertion sort of a copy, there are only a few)
+            uint16_t sorted[BEAT_INTERVAL_HISTORY];
+            for (uint8_t i = 0; i < m_intervalCount; i++) {
+                uint16_t value = m_intervals[i];
+                uint8_t j = i;
+                for (; j > 0 && sorted[j - 1] > value; j--) sorted[j] = sorted[j - 1];
+                sorted[j] = value;
+            }
+            uint16_t median = sorted[m_intervalCount / 2];
+
+            // Mean of the intervals close to the median
+            uint32_t sum = 0;
+            uint8_t count = 0;
+            for (uint8_t i = 0; i < m_intervalCount; i++) {
+                if (m_intervals[i] * 10 < median * 9 || m_intervals[i] * 10 > median * 11) continue;
+                sum += m_intervals[i];
+                count++;
+            }
+            m_period = (sum + count / 2) / count;
+        }
+
+        void addInterval(uint32_t interval) {
+            while (interval < BEAT_MIN_PERIOD) interval *= 2;
+            while (interval >= BEAT_MAX_PERIOD) interval /= 2;
+
+            m_intervals[m_intervalHead] = interval;
+            m_intervalHead = (m_intervalHead + 1) % BEAT_INTERVAL_HISTORY;
+            if (m_intervalCount < BEAT_INTERVAL_HISTORY) m_intervalCount++;
+
+            // Wait for a few intervals before guessing
+            if (m_intervalCount >= 3) estimatePeriod();
+        }
+
+    public:
+        BeatDetector() {
+            reset();
+        }
+
+        void reset() {
+            m_bins = 0;
+            m_fluxHead = 0;
+            m_fluxCount = 0;
+            m_lastFlux = 0;
+            m_threshold = 0;
+            m_intervalHead = 0;
+            m_intervalCount = 0;
+            m_onset = false;
+            m_lastOnsetValid = false;
+            m_lastOnset = 0;
+            m_onsets = 0;
+            m_period = 0;
+        }
+
+        // Processes the spectrum of a frame captured at the given time in ms. Returns true if the frame is an onset
+        bool process(const uint16_t *magnitude, uint16_t bins, uint32_t time) {
+            if (bins > MAX_BINS) bins = MAX_BINS;
+
+            // The flux of spectra of different sizes can't be compared
+            if (bins != m_bins) {
+                uint32_t onsets = m_onsets;
+                reset();
+                m_onsets = onsets;
+                m_bins = bins;
+                for (uint16_t i = 0; i < bins; i++) m_previous[i] = magnitude[i];
+                return false;
+            }
+
+            // Spectral flux: Sum of the rising magnitudes
+            uint32_t flux = 0;
+            for (uint16_t i = 0; i < bins; i++) {
+                if (magnitude[i] > m_previous[i]) flux += magnitude[i] - m_previous[i];
+                m_previous[i] = magnitude[i];
+            }
+            m_lastFlux = flux;
+
+            // Adaptive threshold from the mean and the mean absolute deviation of the previous frames
+            m_onset = false;
+            if (m_fluxCount == BEAT_FLUX_HISTORY) {
+                uint32_t sum = 0;
+                for (uint8_t i = 0; i < BEAT_FLUX_HISTORY; i++) sum += m_flux[i];
+                uint32_t mean = sum / BEAT_FLUX_HISTORY;
+
+                uint32_t deviation = 0;
+                for (uint8_t i = 0; i < BEAT_FLUX_HISTORY; i++) {
+                    deviation += m_flux[i] > mean ? m_flux[i] - mean : mean - m_flux[i];
+                }
+                deviation /= BEAT_FLUX_HISTORY;
+
+                m_threshold = mean + deviation * BEAT_THRESHOLD_DEVIATIONS;
+                if (m_threshold < BEAT_MIN_FLUX) m_threshold = BEAT_MIN_FLUX;
+
+                bool ready = !m_lastOnsetValid || time - m_lastOnset >= BEAT_MIN_INTERVAL;
+                m_onset = flux > m_threshold && ready;
+            }
+
+            // Onsets are clipped to the threshold, so they don't raise it for the next ones
+            m_flux[m_fluxHead] = m_onset ? m_threshold : flux;
+            m_fluxHead = (m_fluxHead + 1) % BEAT_FLUX_HISTORY;
+            if (m_fluxCount < BEAT_FLUX_HISTORY) m_fluxCount++;
+
+            if (m_onset) {
+                if (m_lastOnsetValid && time - m_lastOnset <= BEAT_MAX_INTERVAL) addInterval(time - m_lastOnset);
+                m_lastOnset = time;
+                m_lastOnsetValid = true;
+                m_onsets++;
+            }
+
+            // Forget the tempo if the beat stopped
+            if (m_lastOnsetValid && time - m_lastOnset > 2 * BEAT_MAX_INTERVAL) {
+                m_intervalCount = 0;
+                m_period = 0;
+            }
+
+            return m_onset;
+        }
+
+        // Whether the last processed frame was an onset
+        bool isOnset() {
+            return m_onset;
+        }
+
+        // Estimated tempo in beats per minute, 0 if unknown
+        float getBpm() {
+            return m_period ? 60000.0f / m_period : 0;
+        }
+
+        uint16_t getPeriod() {
+            return m_period;
+        }
+
+        uint32_t getOnsets() {
+            return m_onsets;
+        }
+
+        uint32_t getLastOnset() {
+            return m_lastOnset;
+        }
+
+        uint32_t getFlux() {
+            return m_lastFlux;
+        }
+
+        uint32_t getThreshold() {
+            return m_threshold;
+        }
+};
+
+#endif
\ No newline at end of file
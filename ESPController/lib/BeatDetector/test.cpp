@@ -0,0 +1,126 @@
+#include <stdio.h>
+
+#include "BeatDetector.h"
+#include "../FixedFFT/FixedFFT.h"
+#include <stdlib.h>
+#include <math.h>
+#include <time.h>
+#include <algorithm>
+
+using std::max;
+
+/*
+ * Runs the beat detector on synthetic click tracks like the visualization does: The microphone is sampled at 10 kHz,
+ * and every 20 ms frame the last 32 samples go through the fixed point FFT. Every click is a 1 kHz burst with a 30 ms
+ * decay on top of noise. Checks that the onsets match the clicks and that the tempo is estimated correctly, also for
+ * tracks that get quieter and for noise without clicks.
+ */
+
+#define SAMPLE_RATE     10000
+#define FRAME_MS        20
+#define SAMPLES         32
+#define INPUT_SHIFT     4   // Scales the 10 bit input to the fixed point range
+
+FixedFFT<SAMPLES> fft;
+
+// Microphone value at sample n: noise and the clicks of the given tempo, starting at 1 s
+int sample(long n, double bpm, double amplitude, double noise) {
+    double t = (double) n / SAMPLE_RATE;
+    double value = 512 + (rand() / (double) RAND_MAX - 0.5) * 2 * noise;
+
+    if (bpm > 0 && t >= 1) {
+        double period = 60 / bpm;
+        double dt = fmod(t - 1, period);
+        value += amplitude * exp(-dt / 0.03) * sin(2 * M_PI * 1000 * dt);
+    }
+
+    if (value < 0) value = 0;
+    if (value > 1023) value = 1023;
+    return (int) value;
+}
+
+// Computes the spectrum of the samples before the given frame
+void spectrum(int frame, double bpm, double amplitude, double noise, uint16_t *magnitude) {
+    long end = (long) frame * FRAME_MS * SAMPLE_RATE / 1000;
+    int signal[SAMPLES];
+    int dcOffset = 0;
+    for (int i = 0; i < SAMPLES; i++) {
+        signal[i] = sample(end - SAMPLES + i, bpm, amplitude, noise);
+        dcOffset += signal[i];
+    }
+    dcOffset /= SAMPLES;
+
+    int16_t input[SAMPLES];
+    for (int i = 0; i < SAMPLES; i++) input[i] = (signal[i] - dcOffset) << INPUT_SHIFT;
+    fft.compute(input, magnitude);
+}
+
+// Plays a click track for the given number of seconds. The amplitude is faded to fadeTo over the track
+bool testTrack(const char *name, double bpm, double amplitude, double fadeTo, double noise, int seconds) {
+    BeatDetector<SAMPLES / 2> detector;
+    uint16_t magnitude[SAMPLES / 2];
+
+    int frames = seconds * 1000 / FRAME_MS;
+    int hits = 0;
+    int falseOnsets = 0;
+    for (int frame = 1; frame <= frames; frame++) {
+        double a = amplitude + (fadeTo - amplitude) * frame / frames;
+        spectrum(frame, bpm, a, noise, magnitude);
+
+        uint32_t time = frame * FRAME_MS;
+        if (!detector.process(magnitude, SAMPLES / 2, time)) continue;
+
+        // An onset must be reported in the frame right after the click
+        bool hit = false;
+        if (bpm > 0 && time >= 1000) {
+            double period = 60000 / bpm;
+            double dt = fmod(time - 1000, period);
+            hit = dt < FRAME_MS + 1;
+        }
+        if (hit) hits++;
+        else falseOnsets++;
+    }
+
+    int clicks = bpm > 0 ? (int) ceil((seconds - 1) * bpm / 60) : 0;
+    double recall = clicks ? (double) hits / clicks : 1;
+    double expectedBpm = bpm;
+    while (expectedBpm > 0 && expectedBpm < 80) expectedBpm *= 2;
+    while (expectedBpm > 160) expectedBpm /= 2;
+    bool ok = recall >= 0.95 && falseOnsets <= max(clicks / 20, seconds / 10) && fabs(detector.getBpm() - expectedBpm) <= 2;
+
+    printf("%-22s %3d / %3d clicks, %2d false onsets, %6.1f bpm (expected %5.1f): %s\n",
+        name, hits, clicks, falseOnsets, detector.getBpm(), expectedBpm, ok ? "OK" : "FAILED");
+    return ok;
+}
+
+int main() {
+    printf("Beat Detector Test\n");
+    srand(1);
+
+    bool ok = true;
+    ok &= testTrack("90 bpm", 90, 300, 300, 10, 20);
+    ok &= testTrack("120 bpm", 120, 300, 300, 10, 20);
+    ok &= testTrack("128 bpm", 128, 300, 300, 10, 20);
+    ok &= testTrack("140 bpm", 140, 300, 300, 10, 20);
+    ok &= testTrack("174 bpm (folded)", 174, 300, 300, 10, 20);
+    ok &= testTrack("120 bpm fade out", 120, 400, 60, 10, 30);
+    ok &= testTrack("120 bpm loud noise", 120, 300, 300, 60, 20);
+    ok &= testTrack("120 bpm quiet clicks", 120, 120, 120, 30, 20);
+    ok &= testTrack("noise", 0, 0, 0, 60, 20);
+
+    // Run time of a frame
+    BeatDetector<SAMPLES / 2> detector;
+    uint16_t magnitude[SAMPLES / 2];
+    const int iterations = 1000000;
+    spectrum(100, 120, 300, 10, magnitude);
+    clock_t start = clock();
+    for (int i = 0; i < iterations; i++) {
+        magnitude[i % (SAMPLES / 2)] ^= 0x55;
+        detector.process(magnitude, SAMPLES / 2, i * FRAME_MS);
+    }
+    printf("process(): %.1f ns per frame, %d bytes\n",
+        (double) (clock() - start) * 1000000000 / CLOCKS_PER_SEC / iterations, (int) sizeof(detector));
+
+    printf(ok ? "OK\n" : "FAILED\n");
+    return ok ? 0 : 1;
+}
\ No newline at end of file
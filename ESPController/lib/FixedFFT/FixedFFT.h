@@ -0,0 +1,114 @@
+#ifndef FIXED_FFT_H
+#define FIXED_FFT_H
+
+#include <stdint.h>
+#include <math.h>
+
+/*
+ * Radix-2 FFT in Q15 fixed point for CPUs without an FPU. The Blackman-Nuttall window (same as arduinoFFT's
+ * FFT_WIN_TYP_BLACKMAN_NUTTALL) and the twiddle factors are precomputed, so compute() uses integer math only.
+ *
+ * Every butterfly stage is scaled by 1/2 to avoid overflows, so the magnitudes are those of the unscaled FFT divided
+ * by the number of samples. Input samples must be in the range of +-16383.
+ *
+ * MAX_SAMPLES sets the size of the tables. Any smaller power of 2 can be selected with setSamples().
+ */
+template <uint16_t MAX_SAMPLES>
+class FixedFFT {
+    private:
+        uint16_t m_samples;
+
+        int16_t m_window[MAX_SAMPLES / 2];  // First half of the symmetric window
+        int16_t m_cos[MAX_SAMPLES / 2];     // cos(2 * pi * i / MAX_SAMPLES)
+        int16_t m_sin[MAX_SAMPLES / 2];     // sin(2 * pi * i / MAX_SAMPLES)
+
+        int16_t m_real[MAX_SAMPLES];
+        int16_t m_imag[MAX_SAMPLES];
+
+    public:
+        FixedFFT() {
+            for (uint16_t i = 0; i < MAX_SAMPLES / 2; i++) {
+                m_cos[i] = (int16_t) lround(cos(2 * M_PI * i / MAX_SAMPLES) * 32767);
+                m_sin[i] = (int16_t) lround(sin(2 * M_PI * i / MAX_SAMPLES) * 32767);
+            }
+
+            setSamples(MAX_SAMPLES);
+        }
+
+        void setSamples(uint16_t samples) {
+            if (samples > MAX_SAMPLES) samples = MAX_SAMPLES;
+            m_samples = samples;
+
+            // Precompute the window
+            for (uint16_t i = 0; i < samples / 2; i++) {
+                double ratio = i / (samples - 1.0);
+                double weighingFactor = 0.3635819
+                    - 0.4891775 * cos(2 * M_PI * ratio)
+                    + 0.1365995 * cos(4 * M_PI * ratio)
+                    - 0.0106411 * cos(6 * M_PI * ratio);
+                m_window[i] = (int16_t) lround(weighingFactor * 32767);
+            }
+        }
+
+        uint16_t getSamples() {
+            return m_samples;
+        }
+
+        // Windows and transforms the samples and writes the magnitudes of the first samples / 2 bins
+        void compute(const int16_t *samples, uint16_t *magnitude) {
+            const uint16_t n = m_samples;
+
+            // Apply the window and reverse the bits of the indices
+            uint16_t reversed = 0;
+            for (uint16_t i = 0; i < n; i++) {
+                const uint16_t w = i < n / 2 ? i : n - 1 - i;
+                m_real[reversed] = ((int32_t) samples[i] * m_window[w] + 16384) >> 15;
+                m_imag[reversed] = 0;
+
+                uint16_t k = n >> 1;
+                while (k > 0 && (reversed & k)) {
+                    reversed ^= k;
+                    k >>= 1;
+                }
+                reversed |= k;
+            }
+
+            // Butterflies, every stage is scaled by 1/2
+            for (uint16_t span = 2; span <= n; span <<= 1) {
+                const uint16_t half = span >> 1;
+                const uint16_t step = MAX_SAMPLES / span;
+
+                for (uint16_t j = 0; j < half; j++) {
+                    const int32_t wr = m_cos[j * step];
+                    const int32_t wi = -m_sin[j * step];
+
+                    for (uint16_t i = j; i < n; i += span) {
+                        const uint16_t k = i + half;
+                        const int32_t tr = (wr * m_real[k] - wi * m_imag[k] + 16384) >> 15;
+                        const int32_t ti = (wr * m_imag[k] + wi * m_real[k] + 16384) >> 15;
+                        const int32_t ur = m_real[i];
+                        const int32_t ui = m_imag[i];
+
+                        m_real[k] = (ur - tr) >> 1;
+                        m_imag[k] = (ui - ti) >> 1;
+                        m_real[i] = (ur + tr) >> 1;
+                        m_imag[i] = (ui + ti) >> 1;
+                    }
+                }
+            }
+
+            // Alpha max plus beta min approximation of the magnitude (max. error 4%)
+            for (uint16_t i = 0; i < n / 2; i++) {
+                int32_t a = m_real[i] < 0 ? -m_real[i] : m_real[i];
+                int32_t b = m_imag[i] < 0 ? -m_imag[i] : m_imag[i];
+                if (a < b) {
+                    int32_t t = a;
+                    a = b;
+                    b = t;
+                }
+                magnitude[i] = (a * 123 + b * 51) >> 7;
+            }
+        }
+};
+
+#endif
\ No newline at end of file
@@ -0,0 +1,120 @@
+#include <stdio.h>
+
+#include "FixedFFT.h"
+#include <stdlib.h>
+#include <time.h>
+
+/*
+ * Compares the fixed point FFT against a direct DFT in double precision with the same window and benchmarks it at
+ * different sizes. Fails if the error of any bin exceeds MAX_ERROR or the mean error exceeds MAX_MEAN_ERROR.
+ *
+ * The input is a simulated 10 bit microphone signal: Random sines plus noise with the dc offset removed.
+ */
+
+#define INPUT_SHIFT     4       // Scales the 10 bit input to the fixed point range
+#define MAX_ERROR       0.06    // Relative to the peak of the reference spectrum
+#define MAX_MEAN_ERROR  0.01
+
+void createSignal(int *signal, int samples) {
+    double f1 = 1 + rand() % (samples / 2 - 1);
+    double f2 = 1 + rand() % (samples / 2 - 1);
+    double a1 = 50 + rand() % 250;
+    double a2 = 20 + rand() % 130;
+
+    int dcOffset = 0;
+    for (int i = 0; i < samples; i++) {
+        signal[i] = 512
+            + (int) (a1 * sin(2 * M_PI * f1 * i / samples))
+            + (int) (a2 * sin(2 * M_PI * f2 * i / samples + 1))
+            + rand() % 20 - 10;
+        dcOffset += signal[i];
+    }
+
+    dcOffset /= samples;
+    for (int i = 0; i < samples; i++) signal[i] -= dcOffset;
+}
+
+// Magnitudes of the first samples / 2 bins of the Blackman-Nuttall windowed signal, straight from the DFT definition
+template <uint16_t SAMPLES>
+void computeReference(const int *signal, double *magnitude) {
+    double windowed[SAMPLES];
+    for (int i = 0; i < SAMPLES; i++) {
+        double ratio = i / (SAMPLES - 1.0);
+        double weighingFactor = 0.3635819
+            - 0.4891775 * cos(2 * M_PI * ratio)
+            + 0.1365995 * cos(4 * M_PI * ratio)
+            - 0.0106411 * cos(6 * M_PI * ratio);
+        windowed[i] = signal[i] * weighingFactor;
+    }
+
+    for (int k = 0; k < SAMPLES / 2; k++) {
+        double real = 0;
+        double imag = 0;
+        for (int i = 0; i < SAMPLES; i++) {
+            real += windowed[i] * cos(2 * M_PI * k * i / SAMPLES);
+            imag -= windowed[i] * sin(2 * M_PI * k * i / SAMPLES);
+        }
+        magnitude[k] = sqrt(real * real + imag * imag);
+    }
+}
+
+template <uint16_t SAMPLES>
+bool runTest(int iterations) {
+    static FixedFFT<SAMPLES> fixedFFT;
+
+    int signal[SAMPLES];
+    int16_t input[SAMPLES];
+    uint16_t magnitude[SAMPLES / 2];
+    double reference[SAMPLES / 2];
+
+    // Accuracy: error of every bin relative to the peak of the reference
+    double maxError = 0;
+    double sumError = 0;
+    int numErrors = 0;
+    for (int t = 0; t < 200; t++) {
+        createSignal(signal, SAMPLES);
+        for (int i = 0; i < SAMPLES; i++) input[i] = signal[i] << INPUT_SHIFT;
+
+        computeReference<SAMPLES>(signal, reference);
+        fixedFFT.compute(input, magnitude);
+
+        double peak = 0;
+        for (int i = 0; i < SAMPLES / 2; i++) if (reference[i] > peak) peak = reference[i];
+        if (peak == 0) continue;
+
+        for (int i = 0; i < SAMPLES / 2; i++) {
+            double fixed = (double) magnitude[i] * SAMPLES / (1 << INPUT_SHIFT);
+            double error = fabs(fixed - reference[i]) / peak;
+            if (error > maxError) maxError = error;
+            sumError += error;
+            numErrors++;
+        }
+    }
+
+    // Benchmark
+    clock_t start = clock();
+    for (int t = 0; t < iterations; t++) {
+        for (int i = 0; i < SAMPLES; i++) input[i] = signal[i] << INPUT_SHIFT;
+        fixedFFT.compute(input, magnitude);
+    }
+    double fixedMicros = (double) (clock() - start) * 1000000 / CLOCKS_PER_SEC / iterations;
+
+    const double meanError = sumError / numErrors;
+    const bool success = maxError <= MAX_ERROR && meanError <= MAX_MEAN_ERROR;
+    printf("%3d samples  fixed: %7.2f us  error: max %5.2f%%, mean %5.3f%% of peak: %s\n",
+        SAMPLES, fixedMicros, maxError * 100, meanError * 100, success ? "OK" : "FAILED");
+    return success;
+}
+
+int main() {
+    printf("Fixed FFT Library Test\n");
+
+    bool success = true;
+    success &= runTest<32>(200000);
+    success &= runTest<64>(100000);
+    success &= runTest<128>(50000);
+    success &= runTest<256>(20000);
+
+    printf("%s\n", success ? "OK" : "FAILED");
+    return success ? 0 : 1;
+}
@@ -0,0 +1,629 @@
+#include "GifTranscoder.h"
+#include "MAFDecoder.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MODE_DECODE     0
+#define MODE_COLLECT    1
+#define MODE_TABLE      2
+#define MODE_WRITE      3
+
+#define DISPOSAL_NONE           0
+#define DISPOSAL_BACKGROUND     2
+#define DISPOSAL_PREVIOUS       3
+
+#define LZW_MAX_BITS    12
+#define LZW_SIZE        (1 << LZW_MAX_BITS)
+
+GifTranscoder::GifTranscoder(uint16_t matrix_width, uint16_t matrix_height) {
+    m_matrix_width = matrix_width;
+    m_matrix_height = matrix_height;
+
+    m_global_palette = NULL;
+    m_local_palette = NULL;
+    m_maf_palette = NULL;
+    m_canvas = NULL;
+    m_previous = NULL;
+    m_indices = NULL;
+    m_last_indices = NULL;
+    m_lzw_prefix = NULL;
+    m_lzw_suffix = NULL;
+    m_lzw_stack = NULL;
+
+    fileSeekCallback = NULL;
+    fileReadBlockCallback = NULL;
+    fileWriteBlockCallback = NULL;
+    frameCallback = NULL;
+    yieldCallback = NULL;
+
+    m_width = 0;
+    m_height = 0;
+    m_frame_count = 0;
+    m_maf_palette_size = 0;
+    memset(m_frame_type_counts, 0, sizeof(m_frame_type_counts));
+}
+
+GifTranscoder::~GifTranscoder() {
+    release();
+}
+
+void GifTranscoder::setFileSeekCallback(file_seek_callback c) {
+    fileSeekCallback = c;
+}
+
+void GifTranscoder::setFileReadBlockCallback(file_read_block_callback c) {
+    fileReadBlockCallback = c;
+}
+
+void GifTranscoder::setFileWriteBlockCallback(file_write_block_callback c) {
+    fileWriteBlockCallback = c;
+}
+
+void GifTranscoder::setFrameCallback(frame_callback c) {
+    frameCallback = c;
+}
+
+void GifTranscoder::setYieldCallback(yield_callback c) {
+    yieldCallback = c;
+}
+
+uint16_t GifTranscoder::getWidth(void) {
+    return m_width;
+}
+
+uint16_t GifTranscoder::getHeight(void) {
+    return m_height;
+}
+
+uint16_t GifTranscoder::getFrameCount(void) {
+    return m_frame_count;
+}
+
+int GifTranscoder::getPaletteSize(void) {
+    return m_maf_palette_size;
+}
+
+int GifTranscoder::getFrameTypeCount(uint8_t type) {
+    return type < 4 ? m_frame_type_counts[type] : 0;
+}
+
+int GifTranscoder::decode(void) {
+    int result = run(MODE_DECODE);
+    release();
+    return result;
+}
+
+int GifTranscoder::transcode(void) {
+    // The first pass collects all colors, the second one writes the header and the frame offset table and the
+    // third one the frames
+    m_maf_palette_size = 0;
+    m_maf_palette_last = 0;
+
+    int result = run(MODE_COLLECT);
+    if (result == GIF_TRANSCODER_OK) result = run(MODE_TABLE);
+    if (result == GIF_TRANSCODER_OK) result = run(MODE_WRITE);
+
+    release();
+    return result;
+}
+
+int GifTranscoder::readByte(void) {
+    // Refill the buffer if needed
+    if (m_read_position >= m_read_length) {
+        m_read_length = fileReadBlockCallback(m_read_buffer, sizeof(m_read_buffer));
+        m_read_position = 0;
+        if (m_read_length <= 0) return -1;
+    }
+
+    return m_read_buffer[m_read_position++];
+}
+
+uint16_t GifTranscoder::readWord(void) {
+    uint8_t low = readByte();
+    uint8_t high = readByte();
+    return low | (high << 8);
+}
+
+bool GifTranscoder::readPalette(uint8_t *palette, int size) {
+    memset(palette, 0, 256 * 3);
+    for (int i = 0; i < size * 3; i++) {
+        int value = readByte();
+        if (value < 0) return false;
+        palette[i] = value;
+    }
+    return true;
+}
+
+void GifTranscoder::skipSubBlocks(void) {
+    int size = readByte();
+    while (size > 0) {
+        for (int i = 0; i < size; i++) readByte();
+        size = readByte();
+    }
+}
+
+void GifTranscoder::put(uint8_t data) {
+    m_write_buffer[m_write_length++] = data;
+    if (m_write_length == sizeof(m_write_buffer)) flush();
+}
+
+void GifTranscoder::put(const uint8_t *data, int length) {
+    for (int i = 0; i < length; i++) put(data[i]);
+}
+
+void GifTranscoder::put32(uint32_t data) {
+    put(data);
+    put(data >> 8);
+    put(data >> 16);
+    put(data >> 24);
+}
+
+bool GifTranscoder::flush(void) {
+    if (m_write_length > 0 && fileWriteBlockCallback(m_write_buffer, m_write_length) != m_write_length) {
+        m_write_error = true;
+    }
+    m_write_length = 0;
+    return !m_write_error;
+}
+
+bool GifTranscoder::allocate(void) {
+    const int frameSize = (int) m_width * (int) m_height;
+
+    if (!m_global_palette) m_global_palette = (uint8_t *) malloc(256 * 3);
+    if (!m_local_palette) m_local_palette = (uint8_t *) malloc(256 * 3);
+    if (!m_maf_palette) m_maf_palette = (uint8_t *) malloc(256 * 3);
+    if (!m_canvas) m_canvas = (uint8_t *) malloc(frameSize * 3);
+    if (!m_indices) m_indices = (uint8_t *) malloc(frameSize);
+    if (!m_last_indices) m_last_indices = (uint8_t *) malloc(frameSize);
+    if (!m_lzw_prefix) m_lzw_prefix = (uint16_t *) malloc(LZW_SIZE * sizeof(uint16_t));
+    if (!m_lzw_suffix) m_lzw_suffix = (uint8_t *) malloc(LZW_SIZE);
+    if (!m_lzw_stack) m_lzw_stack = (uint8_t *) malloc(LZW_SIZE + 1);
+
+    return m_global_palette && m_local_palette && m_maf_palette && m_canvas && m_indices && m_last_indices
+        && m_lzw_prefix && m_lzw_suffix && m_lzw_stack;
+}
+
+void GifTranscoder::release(void) {
+    free(m_global_palette);
+    free(m_local_palette);
+    free(m_maf_palette);
+    free(m_canvas);
+    free(m_previous);
+    free(m_indices);
+    free(m_last_indices);
+    free(m_lzw_prefix);
+    free(m_lzw_suffix);
+    free(m_lzw_stack);
+
+    m_global_palette = NULL;
+    m_local_palette = NULL;
+    m_maf_palette = NULL;
+    m_canvas = NULL;
+    m_previous = NULL;
+    m_indices = NULL;
+    m_last_indices = NULL;
+    m_lzw_prefix = NULL;
+    m_lzw_suffix = NULL;
+    m_lzw_stack = NULL;
+}
+
+int GifTranscoder::mapColor(const uint8_t *color) {
+    // Most neighbouring pixels share their color, so check the last match first
+    uint8_t *last = &m_maf_palette[m_maf_palette_last * 3];
+    if (m_maf_palette_size > 0 && last[0] == color[0] && last[1] == color[1] && last[2] == color[2]) {
+        return m_maf_palette_last;
+    }
+
+    for (int i = 0; i < m_maf_palette_size; i++) {
+        uint8_t *entry = &m_maf_palette[i * 3];
+        if (entry[0] == color[0] && entry[1] == color[1] && entry[2] == color[2]) {
+            m_maf_palette_last = i;
+            return i;
+        }
+    }
+
+    // Add a new color
+    if (m_maf_palette_size >= 256) return -1;
+    memcpy(&m_maf_palette[m_maf_palette_size * 3], color, 3);
+    m_maf_palette_last = m_maf_palette_size;
+    return m_maf_palette_size++;
+}
+
+int GifTranscoder::encodePixels(uint16_t left, uint16_t top, uint16_t width, uint16_t height, bool rle, bool write) {
+    // Returns the number of bytes of the palette indices in the rectangle
+    if (!rle) {
+        if (write) {
+            for (int y = top; y < top + height; y++) put(&m_indices[left + y * m_width], width);
+        }
+        return width * height;
+    }
+
+    // Runs of up to 256 pixels as (length - 1, index) pairs
+    int size = 0;
+    int run = 0;
+    uint8_t index = 0;
+    for (int y = top; y < top + height; y++) {
+        for (int x = left; x < left + width; x++) {
+            const uint8_t value = m_indices[x + y * m_width];
+            if (run > 0 && run < 256 && value == index) {
+                run++;
+                continue;
+            }
+
+            if (run > 0) {
+                if (write) {
+                    put(run - 1);
+                    put(index);
+                }
+                size += 2;
+            }
+            index = value;
+            run = 1;
+        }
+    }
+    if (run > 0) {
+        if (write) {
+            put(run - 1);
+            put(index);
+        }
+        size += 2;
+    }
+
+    return size;
+}
+
+uint32_t GifTranscoder::encodeFrame(bool write) {
+    // Key frame, raw or run length encoded
+    uint8_t type = MAF_FRAME_KEY;
+    int size = (int) m_width * (int) m_height;
+    const int rleSize = encodePixels(0, 0, m_width, m_height, true, false);
+    if (rleSize < size) {
+        type = MAF_FRAME_RLE;
+        size = rleSize;
+    }
+
+    // Delta frame with the rectangle of the pixels that changed since the previous frame. The first frame is always
+    // a key frame, so playback can loop.
+    uint16_t left = 0;
+    uint16_t top = 0;
+    uint16_t width = 0;
+    uint16_t height = 0;
+    if (m_frame_count > 0) {
+        int minX = m_width, minY = m_height, maxX = -1, maxY = -1;
+        for (int y = 0; y < m_height; y++) {
+            for (int x = 0; x < m_width; x++) {
+                if (m_indices[x + y * m_width] == m_last_indices[x + y * m_width]) continue;
+                if (x < minX) minX = x;
+                if (x > maxX) maxX = x;
+                if (y < minY) minY = y;
+                if (y > maxY) maxY = y;
+            }
+        }
+
+        if (maxX >= 0) {
+            left = minX;
+            top = minY;
+            width = maxX - minX + 1;
+            height = maxY - minY + 1;
+        }
+
+        const int deltaSize = 8 + encodePixels(left, top, width, height, false, false);
+        const int deltaRleSize = 8 + encodePixels(left, top, width, height, true, false);
+        if (deltaSize < size) {
+            type = MAF_FRAME_DELTA;
+            size = deltaSize;
+        }
+        if (deltaRleSize < size) {
+            type = MAF_FRAME_DELTA | MAF_FRAME_RLE;
+            size = deltaRleSize;
+        }
+    }
+
+    if (write) {
+        // The gif delay is in 1/100 s
+        const uint32_t duration = (uint32_t) m_delay * 10 < 0xFFFF ? m_delay * 10 : 0xFFFF;
+        put(type);
+        put(duration);
+        put(duration >> 8);
+        if (type & MAF_FRAME_DELTA) {
+            const uint16_t rect[4] = { left, top, width, height };
+            for (int i = 0; i < 4; i++) {
+                put(rect[i]);
+                put(rect[i] >> 8);
+            }
+            encodePixels(left, top, width, height, type & MAF_FRAME_RLE, true);
+        } else {
+            encodePixels(0, 0, m_width, m_height, type & MAF_FRAME_RLE, true);
+        }
+        m_frame_type_counts[type]++;
+    }
+
+    return MAF_FRAME_HEADER_SIZE + size;
+}
+
+int GifTranscoder::decodeImage(void) {
+    // Read the image descriptor
+    const uint16_t left = m_image_left = readWord();
+    const uint16_t top = m_image_top = readWord();
+    const uint16_t width = m_image_width = readWord();
+    const uint16_t height = m_image_height = readWord();
+    int packed = readByte();
+    if (packed < 0) return GIF_TRANSCODER_ERROR_BAD_FORMAT;
+
+    // Use the local color table if present
+    uint8_t *palette = m_global_palette;
+    if (packed & 0x80) {
+        if (!readPalette(m_local_palette, 2 << (packed & 0x07))) return GIF_TRANSCODER_ERROR_BAD_FORMAT;
+        palette = m_local_palette;
+    }
+    const bool interlaced = packed & 0x40;
+
+    // Remember the current canvas if it has to be restored after this frame
+    if (m_disposal == DISPOSAL_PREVIOUS) {
+        if (!m_previous) m_previous = (uint8_t *) malloc((int) m_width * (int) m_height * 3);
+        if (!m_previous) return GIF_TRANSCODER_ERROR_NO_MEMORY;
+        memcpy(m_previous, m_canvas, (int) m_width * (int) m_height * 3);
+    }
+
+    // Init the lzw decoder
+    int minCodeSize = readByte();
+    if (minCodeSize < 1 || minCodeSize >= LZW_MAX_BITS) return GIF_TRANSCODER_ERROR_BAD_FORMAT;
+
+    const int clearCode = 1 << minCodeSize;
+    const int endCode = clearCode + 1;
+    int codeSize = minCodeSize + 1;
+    int nextCode = clearCode + 2;
+    int oldCode = -1;
+    int firstChar = 0;
+
+    for (int i = 0; i < clearCode; i++) m_lzw_suffix[i] = i;
+
+    uint32_t bitBuffer = 0;
+    int bitCount = 0;
+    int blockRemaining = 0;
+    bool blocksDone = false;
+
+    // Output position inside the image
+    int pass = interlaced ? 1 : 0;
+    int row = 0;
+    int column = 0;
+    int rowStep = interlaced ? 8 : 1;
+
+    while (true) {
+        // Fill the bit buffer from the data sub-blocks
+        while (bitCount < codeSize && !blocksDone) {
+            if (blockRemaining == 0) {
+                blockRemaining = readByte();
+                if (blockRemaining <= 0) {
+                    blocksDone = true;
+                    break;
+                }
+            }
+            int value = readByte();
+            if (value < 0) return GIF_TRANSCODER_ERROR_BAD_FORMAT;
+            bitBuffer |= (uint32_t) value << bitCount;
+            bitCount += 8;
+            blockRemaining--;
+        }
+        if (bitCount < codeSize) break;
+
+        int code = bitBuffer & ((1 << codeSize) - 1);
+        bitBuffer >>= codeSize;
+        bitCount -= codeSize;
+
+        if (code == clearCode) {
+            codeSize = minCodeSize + 1;
+            nextCode = clearCode + 2;
+            oldCode = -1;
+            continue;
+        }
+        if (code == endCode) break;
+
+        // Unwind the code into the stack
+        int stackSize = 0;
+        if (oldCode == -1) {
+            if (code >= clearCode) return GIF_TRANSCODER_ERROR_BAD_FORMAT;
+            firstChar = code;
+            m_lzw_stack[stackSize++] = code;
+        } else {
+            int inCode = code;
+            if (code >= nextCode) {
+                if (code > nextCode) return GIF_TRANSCODER_ERROR_BAD_FORMAT;
+                m_lzw_stack[stackSize++] = firstChar;
+                code = oldCode;
+            }
+            while (code >= clearCode) {
+                m_lzw_stack[stackSize++] = m_lzw_suffix[code];
+                code = m_lzw_prefix[code];
+            }
+            firstChar = code;
+            m_lzw_stack[stackSize++] = firstChar;
+
+            // Add the new table entry
+            if (nextCode < LZW_SIZE) {
+                m_lzw_prefix[nextCode] = oldCode;
+                m_lzw_suffix[nextCode] = firstChar;
+                nextCode++;
+                if (nextCode == (1 << codeSize) && codeSize < LZW_MAX_BITS) codeSize++;
+            }
+            code = inCode;
+        }
+        oldCode = code;
+
+        // Output the pixels
+        while (stackSize > 0) {
+            const uint8_t index = m_lzw_stack[--stackSize];
+            if (row >= height) continue;
+
+            const int x = left + column;
+            const int y = top + row;
+            if (x < m_width && y < m_height && !(m_transparent && index == m_transparent_index)) {
+                memcpy(&m_canvas[(x + y * m_width) * 3], &palette[index * 3], 3);
+            }
+
+            // Advance to the next pixel
+            column++;
+            if (column >= width) {
+                column = 0;
+                row += rowStep;
+                while (interlaced && row >= height && pass < 4) {
+                    pass++;
+                    if (pass == 2) { row = 4; rowStep = 8; }
+                    if (pass == 3) { row = 2; rowStep = 4; }
+                    if (pass == 4) { row = 1; rowStep = 2; }
+                }
+            }
+        }
+    }
+
+    // Skip any data left after the end code
+    if (!blocksDone) {
+        if (blockRemaining > 0) {
+            for (int i = 0; i < blockRemaining; i++) readByte();
+        }
+        skipSubBlocks();
+    }
+
+    return GIF_TRANSCODER_OK;
+}
+
+int GifTranscoder::run(uint8_t mode) {
+    if (yieldCallback) yieldCallback();
+
+    // Start reading from the beginning of the file
+    fileSeekCallback(0);
+    m_read_position = 0;
+    m_read_length = 0;
+
+    // Check the signature
+    char signature[6];
+    for (int i = 0; i < 6; i++) signature[i] = readByte();
+    if (memcmp(signature, "GIF87a", 6) != 0 && memcmp(signature, "GIF89a", 6) != 0) {
+        return GIF_TRANSCODER_ERROR_NOT_GIF;
+    }
+
+    // Read the logical screen descriptor
+    m_width = readWord();
+    m_height = readWord();
+    int packed = readByte();
+    readByte(); // Background color index, the background is always black
+    readByte(); // Pixel aspect ratio
+    if (packed < 0) return GIF_TRANSCODER_ERROR_BAD_FORMAT;
+
+    #ifdef GIF_TRANSCODER_DEBUG
+        printf("GIF: Size: %dx%d\n", m_width, m_height);
+    #endif
+
+    if (m_width == 0 || m_height == 0) return GIF_TRANSCODER_ERROR_BAD_FORMAT;
+    if (m_matrix_width != 0 && m_width != m_matrix_width) return GIF_TRANSCODER_ERROR_WRONG_SIZE;
+    if (m_matrix_height != 0 && m_height != m_matrix_height) return GIF_TRANSCODER_ERROR_WRONG_SIZE;
+
+    if (!allocate()) return GIF_TRANSCODER_ERROR_NO_MEMORY;
+    const int frameSize = (int) m_width * (int) m_height;
+
+    // Read the global color table
+    memset(m_global_palette, 0, 256 * 3);
+    if (packed & 0x80) {
+        if (!readPalette(m_global_palette, 2 << (packed & 0x07))) return GIF_TRANSCODER_ERROR_BAD_FORMAT;
+    }
+
+    // Write the MAF header and palette. The frame offset table follows, the first frame is stored after it
+    m_write_length = 0;
+    m_write_error = false;
+    if (mode == MODE_TABLE) {
+        const uint8_t header[MAF_HEADER_SIZE] = {
+            MAF_MAGIC_0, MAF_MAGIC_1, MAF_MAGIC_2, MAF_VERSION,
+            (uint8_t) m_width, (uint8_t) (m_width >> 8),
+            (uint8_t) m_height, (uint8_t) (m_height >> 8),
+            (uint8_t) m_frame_count, (uint8_t) (m_frame_count >> 8),
+            (uint8_t) (m_maf_palette_size - 1)
+        };
+        put(header, MAF_HEADER_SIZE);
+        put(m_maf_palette, m_maf_palette_size * 3);
+        m_write_offset = MAF_HEADER_SIZE + m_maf_palette_size * 3 + ((uint32_t) m_frame_count + 1) * 4;
+    }
+    if (mode == MODE_WRITE) memset(m_frame_type_counts, 0, sizeof(m_frame_type_counts));
+
+    memset(m_canvas, 0, frameSize * 3);
+    m_frame_count = 0;
+    m_disposal = DISPOSAL_NONE;
+    m_transparent = false;
+    m_delay = 0;
+
+    while (true) {
+        int block = readByte();
+
+        // Trailer or end of file
+        if (block == 0x3B || block < 0) break;
+
+        // Extensions. Only the graphic control extension is of interest
+        if (block == 0x21) {
+            int label = readByte();
+            if (label == 0xF9) {
+                readByte(); // Block size
+                int flags = readByte();
+                m_delay = readWord();
+                m_transparent_index = readByte();
+                m_transparent = flags & 0x01;
+                m_disposal = (flags >> 2) & 0x07;
+            }
+            skipSubBlocks();
+            continue;
+        }
+
+        if (block != 0x2C) return GIF_TRANSCODER_ERROR_BAD_FORMAT;
+
+        int result = decodeImage();
+        if (result != GIF_TRANSCODER_OK) return result;
+
+        // Output the frame
+        if (mode == MODE_DECODE && frameCallback) frameCallback(m_canvas, m_delay);
+        if (mode != MODE_DECODE) {
+            if (m_frame_count >= GIF_TRANSCODER_MAX_FRAMES) return GIF_TRANSCODER_ERROR_TOO_MANY_FRAMES;
+
+            for (int i = 0; i < frameSize; i++) {
+                int index = mapColor(&m_canvas[i * 3]);
+                if (index < 0) return GIF_TRANSCODER_ERROR_TOO_MANY_COLORS;
+                m_indices[i] = index;
+            }
+
+            // Write the offset of the frame or the frame itself
+            if (mode == MODE_TABLE) {
+                put32(m_write_offset);
+                m_write_offset += encodeFrame(false);
+            }
+            if (mode == MODE_WRITE) encodeFrame(true);
+            if (m_write_error) return GIF_TRANSCODER_ERROR_WRITE;
+            memcpy(m_last_indices, m_indices, frameSize);
+        }
+        m_frame_count++;
+        if (yieldCallback) yieldCallback();
+
+        // Dispose the frame
+        if (m_disposal == DISPOSAL_BACKGROUND) {
+            for (int y = m_image_top; y < m_image_top + m_image_height && y < m_height; y++) {
+                for (int x = m_image_left; x < m_image_left + m_image_width && x < m_width; x++) {
+                    memset(&m_canvas[(x + y * m_width) * 3], 0, 3);
+                }
+            }
+        }
+        if (m_disposal == DISPOSAL_PREVIOUS) memcpy(m_canvas, m_previous, frameSize * 3);
+
+        // The graphic control extension is only valid for one image
+        m_disposal = DISPOSAL_NONE;
+        m_transparent = false;
+        m_delay = 0;
+    }
+
+    #ifdef GIF_TRANSCODER_DEBUG
+        printf("GIF: Frame count: %d, colors: %d\n", m_frame_count, m_maf_palette_size);
+    #endif
+
+    if (m_frame_count == 0) return GIF_TRANSCODER_ERROR_BAD_FORMAT;
+
+    // The last entry of the offset table is the end of the file
+    if (mode == MODE_TABLE) put32(m_write_offset);
+    if (mode != MODE_DECODE && !flush()) return GIF_TRANSCODER_ERROR_WRITE;
+    return GIF_TRANSCODER_OK;
+}
\ No newline at end of file
@@ -0,0 +1,146 @@
+#ifndef GIF_TRANSCODER_H
+#define GIF_TRANSCODER_H
+
+#include <stdint.h>
+
+//#define GIF_TRANSCODER_DEBUG
+
+#define GIF_TRANSCODER_OK                       0
+#define GIF_TRANSCODER_ERROR_NOT_GIF            -1
+#define GIF_TRANSCODER_ERROR_BAD_FORMAT         -2
+#define GIF_TRANSCODER_ERROR_WRONG_SIZE         -3
+#define GIF_TRANSCODER_ERROR_TOO_MANY_COLORS    -4
+#define GIF_TRANSCODER_ERROR_TOO_MANY_FRAMES    -5
+#define GIF_TRANSCODER_ERROR_NO_MEMORY          -6
+#define GIF_TRANSCODER_ERROR_WRITE              -7
+
+// Limit of the MAF format (16 bit frame count)
+#define GIF_TRANSCODER_MAX_FRAMES               0xFFFF
+
+typedef bool (*file_seek_callback)(unsigned long position);
+typedef int (*file_read_block_callback)(void *buffer, int numberOfBytes);
+typedef int (*file_write_block_callback)(const void *buffer, int numberOfBytes);
+
+typedef void (*frame_callback)(const uint8_t *framebuffer, uint16_t delay);
+typedef void (*yield_callback)(void);
+
+/*
+ * Decodes a GIF file into full RGB888 frames and writes them as a MAF (Matrix Animation File), so the animation
+ * has to be decompressed only once instead of on every playback loop. Transcoding runs three passes over the GIF:
+ * The first one collects the palette, the second one writes the header, palette and frame offset table (which are
+ * stored in front of the frame data), the third one writes the frames. Every frame is stored as the smallest of a
+ * key frame, a delta frame of the rectangle that changed since the previous frame, or their run length encoded
+ * versions.
+ *
+ * Transparent pixels keep the color of the previous frame, the background color is always black.
+ *
+ * A pass over a large file takes long, the yield callback is called before every pass and after every frame, so the
+ * caller can feed its watchdog.
+ */
+class GifTranscoder {
+    private:
+        uint16_t m_matrix_width;
+        uint16_t m_matrix_height;
+
+        uint16_t m_width;
+        uint16_t m_height;
+        uint16_t m_frame_count;
+
+        // Color tables of the gif file and the palette of the MAF file
+        uint8_t *m_global_palette;
+        uint8_t *m_local_palette;
+        uint8_t *m_maf_palette;
+        int m_maf_palette_size;
+        int m_maf_palette_last;
+
+        // Frame buffers
+        uint8_t *m_canvas;
+        uint8_t *m_previous;
+        uint8_t *m_indices;
+        uint8_t *m_last_indices;
+
+        // LZW tables
+        uint16_t *m_lzw_prefix;
+        uint8_t *m_lzw_suffix;
+        uint8_t *m_lzw_stack;
+
+        // Input buffer to avoid a callback per byte
+        uint8_t m_read_buffer[64];
+        int m_read_position;
+        int m_read_length;
+
+        // Output buffer to avoid a callback per byte
+        uint8_t m_write_buffer[64];
+        int m_write_length;
+        bool m_write_error;
+        uint32_t m_write_offset;
+        int m_frame_type_counts[4];
+
+        // Graphic control extension of the next image
+        uint8_t m_disposal;
+        bool m_transparent;
+        uint8_t m_transparent_index;
+        uint16_t m_delay;
+
+        // Rectangle of the last decoded image
+        uint16_t m_image_left;
+        uint16_t m_image_top;
+        uint16_t m_image_width;
+        uint16_t m_image_height;
+
+        file_seek_callback fileSeekCallback;
+        file_read_block_callback fileReadBlockCallback;
+        file_write_block_callback fileWriteBlockCallback;
+
+        frame_callback frameCallback;
+        yield_callback yieldCallback;
+
+        int readByte(void);
+        uint16_t readWord(void);
+        bool readPalette(uint8_t *palette, int size);
+        void skipSubBlocks(void);
+
+        int decodeImage(void);
+        int mapColor(const uint8_t *color);
+
+        int encodePixels(uint16_t left, uint16_t top, uint16_t width, uint16_t height, bool rle, bool write);
+        uint32_t encodeFrame(bool write);
+
+        void put(uint8_t data);
+        void put(const uint8_t *data, int length);
+        void put32(uint32_t data);
+        bool flush(void);
+
+        bool allocate(void);
+        void release(void);
+
+        int run(uint8_t mode);
+
+    public:
+        // A matrix size of 0 accepts gif files of any size
+        GifTranscoder(uint16_t matrix_width, uint16_t matrix_height);
+        ~GifTranscoder();
+
+        void setFileSeekCallback(file_seek_callback c);
+        void setFileReadBlockCallback(file_read_block_callback c);
+        void setFileWriteBlockCallback(file_write_block_callback c);
+
+        void setFrameCallback(frame_callback c);
+        void setYieldCallback(yield_callback c);
+
+        // Decodes all frames and passes them to the frame callback
+        int decode(void);
+
+        // Writes the gif file as a MAF file using the write block callback
+        int transcode(void);
+
+        uint16_t getWidth(void);
+        uint16_t getHeight(void);
+        uint16_t getFrameCount(void);
+        int getPaletteSize(void);
+
+        // Number of frames of a MAF_FRAME_* type written by the last transcode() call
+        int getFrameTypeCount(uint8_t type);
+};
+
+#endif
\ No newline at end of file
@@ -0,0 +1,176 @@
+#include "GifValidator.h"
+#include <string.h>
+
+#define STATE_HEADER            0
+#define STATE_SKIP              1
+#define STATE_BLOCK             2
+#define STATE_EXTENSION_LABEL   3
+#define STATE_IMAGE_DESCRIPTOR  4
+#define STATE_LZW_CODE_SIZE     5
+#define STATE_SUB_BLOCK_SIZE    6
+#define STATE_SUB_BLOCK_DATA    7
+#define STATE_TRAILER           8
+
+#define HEADER_SIZE             13
+#define IMAGE_DESCRIPTOR_SIZE   9
+
+GifValidator::GifValidator(uint16_t matrix_width, uint16_t matrix_height) {
+    m_matrix_width = matrix_width;
+    m_matrix_height = matrix_height;
+    reset();
+}
+
+void GifValidator::reset(void) {
+    m_width = 0;
+    m_height = 0;
+    m_frame_count = 0;
+    m_size = 0;
+
+    m_state = STATE_HEADER;
+    m_buffer_length = 0;
+    m_skip = 0;
+    m_in_image = false;
+    m_result = GIF_TRANSCODER_OK;
+}
+
+int GifValidator::parseHeader(void) {
+    if (memcmp(m_buffer, "GIF87a", 6) != 0 && memcmp(m_buffer, "GIF89a", 6) != 0) {
+        return GIF_TRANSCODER_ERROR_NOT_GIF;
+    }
+
+    m_width = m_buffer[6] | (m_buffer[7] << 8);
+    m_height = m_buffer[8] | (m_buffer[9] << 8);
+    if (m_width == 0 || m_height == 0) return GIF_TRANSCODER_ERROR_BAD_FORMAT;
+    if (m_matrix_width != 0 && m_width != m_matrix_width) return GIF_TRANSCODER_ERROR_WRONG_SIZE;
+    if (m_matrix_height != 0 && m_height != m_matrix_height) return GIF_TRANSCODER_ERROR_WRONG_SIZE;
+
+    // Skip the global color table
+    const uint8_t packed = m_buffer[10];
+    m_skip = packed & 0x80 ? 3 * (2 << (packed & 0x07)) : 0;
+    m_state = m_skip ? STATE_SKIP : STATE_BLOCK;
+    return GIF_TRANSCODER_OK;
+}
+
+int GifValidator::parseImageDescriptor(void) {
+    const uint16_t left = m_buffer[0] | (m_buffer[1] << 8);
+    const uint16_t top = m_buffer[2] | (m_buffer[3] << 8);
+    const uint16_t width = m_buffer[4] | (m_buffer[5] << 8);
+    const uint16_t height = m_buffer[6] | (m_buffer[7] << 8);
+
+    // The image must lie within the logical screen
+    if ((uint32_t) left + width > m_width || (uint32_t) top + height > m_height) return GIF_TRANSCODER_ERROR_BAD_FORMAT;
+
+    // Skip the local color table, then read the lzw code size
+    const uint8_t packed = m_buffer[8];
+    m_skip = packed & 0x80 ? 3 * (2 << (packed & 0x07)) : 0;
+    m_state = m_skip ? STATE_SKIP : STATE_LZW_CODE_SIZE;
+    m_in_image = true;
+    return GIF_TRANSCODER_OK;
+}
+
+int GifValidator::push(const uint8_t *data, int length) {
+    int i = 0;
+    m_size += length;
+
+    while (i < length && m_result == GIF_TRANSCODER_OK) {
+        switch (m_state) {
+            case STATE_HEADER:
+            case STATE_IMAGE_DESCRIPTOR: {
+                // Collect the fixed size descriptor, it may be split over several chunks
+                const uint8_t size = m_state == STATE_HEADER ? HEADER_SIZE : IMAGE_DESCRIPTOR_SIZE;
+                while (i < length && m_buffer_length < size) m_buffer[m_buffer_length++] = data[i++];
+                if (m_buffer_length < size) break;
+
+                m_buffer_length = 0;
+                m_result = m_state == STATE_HEADER ? parseHeader() : parseImageDescriptor();
+                break;
+            }
+
+            case STATE_SKIP:
+            case STATE_SUB_BLOCK_DATA: {
+                // Skip color tables and sub-block data without looking at it
+                uint32_t n = length - i;
+                if (n > m_skip) n = m_skip;
+                i += n;
+                m_skip -= n;
+                if (m_skip > 0) break;
+
+                if (m_state == STATE_SUB_BLOCK_DATA) m_state = STATE_SUB_BLOCK_SIZE;
+                else m_state = m_in_image ? STATE_LZW_CODE_SIZE : STATE_BLOCK;
+                break;
+            }
+
+            case STATE_BLOCK: {
+                const uint8_t block = data[i++];
+                if (block == 0x21) m_state = STATE_EXTENSION_LABEL;
+                else if (block == 0x2C) m_state = STATE_IMAGE_DESCRIPTOR;
+                else if (block == 0x3B) m_state = STATE_TRAILER;
+                else m_result = GIF_TRANSCODER_ERROR_BAD_FORMAT;
+                break;
+            }
+
+            case STATE_EXTENSION_LABEL:
+                // The label doesn't matter, all extensions consist of sub-blocks
+                i++;
+                m_state = STATE_SUB_BLOCK_SIZE;
+                break;
+
+            case STATE_LZW_CODE_SIZE: {
+                const uint8_t minCodeSize = data[i++];
+                if (minCodeSize < 1 || minCodeSize > 11) m_result = GIF_TRANSCODER_ERROR_BAD_FORMAT;
+                m_state = STATE_SUB_BLOCK_SIZE;
+                break;
+            }
+
+            case STATE_SUB_BLOCK_SIZE:
+                m_skip = data[i++];
+                if (m_skip > 0) {
+                    m_state = STATE_SUB_BLOCK_DATA;
+                    break;
+                }
+
+                // Block terminator. Count the frame if it was an image
+                if (m_in_image) m_frame_count++;
+                m_in_image = false;
+                m_state = STATE_BLOCK;
+                break;
+
+            case STATE_TRAILER:
+                // Ignore anything after the trailer
+                i = length;
+                break;
+        }
+    }
+
+    return m_result;
+}
+
+int GifValidator::finish(void) {
+    if (m_result != GIF_TRANSCODER_OK) return m_result;
+
+    // The file may end without a trailer (like the gif decoder accepts), but not within a block
+    if (m_state != STATE_BLOCK && m_state != STATE_TRAILER) m_result = GIF_TRANSCODER_ERROR_BAD_FORMAT;
+    else if (m_frame_count == 0) m_result = GIF_TRANSCODER_ERROR_BAD_FORMAT;
+
+    return m_result;
+}
+
+bool GifValidator::hasHeader(void) {
+    return m_state != STATE_HEADER;
+}
+
+uint16_t GifValidator::getWidth(void) {
+    return m_width;
+}
+
+uint16_t GifValidator::getHeight(void) {
+    return m_height;
+}
+
+uint16_t GifValidator::getFrameCount(void) {
+    return m_frame_count;
+}
+
+uint32_t GifValidator::getSize(void) {
+    return m_size;
+}
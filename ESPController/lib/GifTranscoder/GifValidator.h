@@ -0,0 +1,57 @@
+#ifndef GIF_VALIDATOR_H
+#define GIF_VALIDATOR_H
+
+#include <stdint.h>
+#include "GifTranscoder.h"
+
+/*
+ * Checks the structure of a gif file while it is received, so invalid uploads can be rejected before they are written
+ * to the flash. The data is passed in chunks of any size with push(). Only the block structure is parsed (the image
+ * data is skipped, not decompressed), which also yields the size and the number of frames of the animation.
+ *
+ * Errors are reported with the GIF_TRANSCODER_ERROR_* codes. The size is checked as soon as the logical screen
+ * descriptor (the first 13 bytes) was received.
+ */
+class GifValidator {
+    private:
+        uint16_t m_matrix_width;
+        uint16_t m_matrix_height;
+
+        uint16_t m_width;
+        uint16_t m_height;
+        uint16_t m_frame_count;
+        uint32_t m_size;
+
+        // Parser state, the bytes of the current header or descriptor and the number of bytes left to skip
+        uint8_t m_state;
+        uint8_t m_buffer[13];
+        uint8_t m_buffer_length;
+        uint32_t m_skip;
+        bool m_in_image;
+        int m_result;
+
+        int parseHeader(void);
+        int parseImageDescriptor(void);
+
+    public:
+        // A matrix size of 0 accepts gif files of any size
+        GifValidator(uint16_t matrix_width, uint16_t matrix_height);
+
+        void reset(void);
+
+        // Parses the next chunk. Returns GIF_TRANSCODER_OK or the first error
+        int push(const uint8_t *data, int length);
+
+        // Call at the end of the file. Returns GIF_TRANSCODER_OK if the file is complete and has at least one frame
+        int finish(void);
+
+        // True after the logical screen descriptor was received
+        bool hasHeader(void);
+
+        uint16_t getWidth(void);
+        uint16_t getHeight(void);
+        uint16_t getFrameCount(void);
+        uint32_t getSize(void);
+};
+
+#endif
@@ -0,0 +1,64 @@
+#include <stdio.h>
+
+#include "GifTranscoder.h"
+
+/*
+ * Command line tool to transcode gif files into MAF files on the host.
+ *
+ * Build: g++ gif2maf.cpp GifTranscoder.cpp -I../MAFDecoder -o gif2maf
+ * Usage: ./gif2maf input.gif output.maf
+ */
+
+FILE *inputFile;
+FILE *outputFile;
+
+bool inputFileSeek(unsigned long position) {
+    return fseek(inputFile, position, SEEK_SET) == 0;
+}
+
+int inputFileReadBlock(void *buffer, int numberOfBytes) {
+    return fread(buffer, 1, numberOfBytes, inputFile);
+}
+
+int outputFileWriteBlock(const void *buffer, int numberOfBytes) {
+    return fwrite(buffer, 1, numberOfBytes, outputFile);
+}
+
+int main(int argc, char **argv) {
+    if (argc != 3) {
+        printf("Usage: %s input.gif output.maf\n", argv[0]);
+        return 1;
+    }
+
+    inputFile = fopen(argv[1], "rb");
+    if (!inputFile) {
+        printf("Could not open %s\n", argv[1]);
+        return 1;
+    }
+
+    outputFile = fopen(argv[2], "wb");
+    if (!outputFile) {
+        printf("Could not create %s\n", argv[2]);
+        fclose(inputFile);
+        return 1;
+    }
+
+    GifTranscoder transcoder = GifTranscoder(0, 0);
+    transcoder.setFileSeekCallback(inputFileSeek);
+    transcoder.setFileReadBlockCallback(inputFileReadBlock);
+    transcoder.setFileWriteBlockCallback(outputFileWriteBlock);
+    int result = transcoder.transcode();
+
+    fclose(inputFile);
+    fclose(outputFile);
+
+    if (result != GIF_TRANSCODER_OK) {
+        printf("Transcoding failed with error %d\n", result);
+        remove(argv[2]);
+        return 1;
+    }
+
+    printf("%s: %dx%d, %d frames, %d colors\n", argv[2], transcoder.getWidth(), transcoder.getHeight(),
+        transcoder.getFrameCount(), transcoder.getPaletteSize());
+    return 0;
+}
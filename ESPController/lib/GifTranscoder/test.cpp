@@ -0,0 +1,313 @@
+#include <stdio.h>
+
+#include "GifTranscoder.h"
+#include "GifValidator.h"
+#include "MAFDecoder.h"
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/*
+ * Transcodes all animations in data/animations into MAF files (in memory) and checks that the MAF decoder outputs
+ * exactly the same frames as the gif decoder. The files are also passed through the gif validator in chunks of
+ * different sizes, which must find the same size and frame count, and must reject truncated or wrong sized files.
+ *
+ * Reports the size, the bytes read per frame and the decode time of the MAF files compared to the same animation
+ * stored as key frames only (like version 1 of the format).
+ */
+
+#define MAX_FILE_SIZE   (1024 * 1024)
+#define MAX_FRAMES      256
+
+// Virtual input (gif) and output (maf) files
+unsigned char gifFile[MAX_FILE_SIZE];
+int gifFileSize = 0;
+int gifFileIndex = 0;
+
+unsigned char mafFile[MAX_FILE_SIZE];
+int mafFileSize = 0;
+int mafFileIndex = 0;
+
+// The same animation with key frames only
+unsigned char keyFile[MAX_FILE_SIZE];
+int keyFileSize = 0;
+
+// File read by the maf decoder
+unsigned char *mafData = mafFile;
+unsigned long mafBytesRead = 0;
+
+// Frames decoded from the gif file
+uint8_t *gifFrames[MAX_FRAMES];
+uint16_t gifDelays[MAX_FRAMES];
+int gifFrameCount = 0;
+int gifFrameSize = 0;
+
+// Calls of the yield callback
+int yields = 0;
+
+bool gifFileSeek(unsigned long position) {
+    gifFileIndex = position;
+    return true;
+}
+
+int gifFileReadBlock(void *buffer, int numberOfBytes) {
+    if (numberOfBytes > gifFileSize - gifFileIndex) numberOfBytes = gifFileSize - gifFileIndex;
+    memcpy(buffer, &gifFile[gifFileIndex], numberOfBytes);
+    gifFileIndex += numberOfBytes;
+    return numberOfBytes;
+}
+
+int mafFileWriteBlock(const void *buffer, int numberOfBytes) {
+    if (numberOfBytes > MAX_FILE_SIZE - mafFileSize) return 0;
+    memcpy(&mafFile[mafFileSize], buffer, numberOfBytes);
+    mafFileSize += numberOfBytes;
+    return numberOfBytes;
+}
+
+bool mafFileSeek(unsigned long position) {
+    mafFileIndex = position;
+    return true;
+}
+
+int mafFileRead(void) {
+    mafBytesRead++;
+    return mafData[mafFileIndex++];
+}
+
+int mafFileReadBlock(void *buffer, int numberOfBytes) {
+    memcpy(buffer, &mafData[mafFileIndex], numberOfBytes);
+    mafFileIndex += numberOfBytes;
+    mafBytesRead += numberOfBytes;
+    return numberOfBytes;
+}
+
+void gifFrame(const uint8_t *framebuffer, uint16_t delay) {
+    if (gifFrameCount >= MAX_FRAMES) return;
+    gifDelays[gifFrameCount] = delay;
+    gifFrames[gifFrameCount] = (uint8_t *) malloc(gifFrameSize);
+    memcpy(gifFrames[gifFrameCount], framebuffer, gifFrameSize);
+    gifFrameCount++;
+}
+
+void countYield(void) {
+    yields++;
+}
+
+// Passes the gif file to the validator in chunks of chunkSize bytes. Returns the result of the validator
+int validate(GifValidator *validator, int size, int chunkSize) {
+    validator->reset();
+    for (int position = 0; position < size; position += chunkSize) {
+        int length = size - position < chunkSize ? size - position : chunkSize;
+        int result = validator->push(&gifFile[position], length);
+        if (result != GIF_TRANSCODER_OK) return result;
+    }
+    return validator->finish();
+}
+
+bool testValidator(const char *fileName, int width, int height, int frameCount) {
+    const int chunkSizes[] = { 1, 13, 100, 2048 };
+    bool success = true;
+
+    // Valid file, any chunk size
+    GifValidator validator = GifValidator(width, height);
+    for (int i = 0; i < 4; i++) {
+        int result = validate(&validator, gifFileSize, chunkSizes[i]);
+        if (result != GIF_TRANSCODER_OK || validator.getWidth() != width || validator.getHeight() != height
+            || validator.getFrameCount() != frameCount || (int) validator.getSize() != gifFileSize) {
+            printf("%s: validator failed with chunk size %d (error %d, %dx%d, %d frames)\n", fileName, chunkSizes[i],
+                result, validator.getWidth(), validator.getHeight(), validator.getFrameCount());
+            success = false;
+        }
+    }
+
+    // Truncated file
+    int result = validate(&validator, gifFileSize / 2, 100);
+    if (result != GIF_TRANSCODER_ERROR_BAD_FORMAT) {
+        printf("%s: validator accepted a truncated file (result %d)\n", fileName, result);
+        success = false;
+    }
+
+    // Wrong size. Must be rejected with the logical screen descriptor
+    GifValidator wrongSize = GifValidator(width + 1, height);
+    wrongSize.push(gifFile, 13);
+    if (wrongSize.push(gifFile, 0) != GIF_TRANSCODER_ERROR_WRONG_SIZE) {
+        printf("%s: validator accepted the wrong size\n", fileName);
+        success = false;
+    }
+
+    // Not a gif file
+    gifFile[0] ^= 0xFF;
+    result = validate(&validator, gifFileSize, 2048);
+    gifFile[0] ^= 0xFF;
+    if (result != GIF_TRANSCODER_ERROR_NOT_GIF) {
+        printf("%s: validator accepted an invalid signature (result %d)\n", fileName, result);
+        success = false;
+    }
+
+    return success;
+}
+
+// Stores the gif frames as key frames with the palette of the maf file
+void createKeyFrameFile(int width, int height) {
+    const int paletteSize = mafFile[10] + 1;
+    const int frameSize = width * height;
+    const int frameOffset = MAF_HEADER_SIZE + paletteSize * 3 + (gifFrameCount + 1) * 4;
+    memcpy(keyFile, mafFile, MAF_HEADER_SIZE + paletteSize * 3);
+
+    for (int i = 0; i <= gifFrameCount; i++) {
+        const uint32_t offset = frameOffset + (MAF_FRAME_HEADER_SIZE + frameSize) * i;
+        for (int j = 0; j < 4; j++) keyFile[MAF_HEADER_SIZE + paletteSize * 3 + i * 4 + j] = offset >> (j * 8);
+        if (i == gifFrameCount) break;
+
+        unsigned char *frame = &keyFile[offset];
+        frame[0] = MAF_FRAME_KEY;
+        frame[1] = gifDelays[i] * 10;
+        frame[2] = (gifDelays[i] * 10) >> 8;
+        for (int p = 0; p < frameSize; p++) {
+            int index = 0;
+            while (memcmp(&mafFile[MAF_HEADER_SIZE + index * 3], &gifFrames[i][p * 3], 3) != 0) index++;
+            frame[MAF_FRAME_HEADER_SIZE + p] = index;
+        }
+    }
+    keyFileSize = frameOffset + (MAF_FRAME_HEADER_SIZE + frameSize) * gifFrameCount;
+}
+
+// Decodes all frames of a maf file a number of times. Returns the time per frame in us and the bytes read per frame
+double benchmarkDecoder(unsigned char *data, int width, int height, double *bytesPerFrame) {
+    const int loops = 2000;
+    mafData = data;
+    RuntimeMAFDecoder decoder = RuntimeMAFDecoder(width, height);
+    decoder.setFileSeekCallback(mafFileSeek);
+    decoder.setFileReadBlockCallback(mafFileReadBlock);
+    decoder.initDecoder();
+
+    uint8_t *framebuffer = (uint8_t *) malloc(width * height * 3);
+    mafBytesRead = 0;
+    clock_t start = clock();
+    for (int i = 0; i < loops * gifFrameCount; i++) decoder.decodeFrame(framebuffer);
+    double seconds = (double) (clock() - start) / CLOCKS_PER_SEC;
+    free(framebuffer);
+
+    *bytesPerFrame = (double) mafBytesRead / (loops * gifFrameCount);
+    mafData = mafFile;
+    return seconds * 1000000.0 / (loops * gifFrameCount);
+}
+
+bool testFile(const char *fileName) {
+    // Load the gif file
+    FILE *f = fopen(fileName, "rb");
+    if (!f) {
+        printf("%s: could not open file\n", fileName);
+        return false;
+    }
+    gifFileSize = fread(gifFile, 1, MAX_FILE_SIZE, f);
+    fclose(f);
+
+    GifTranscoder transcoder = GifTranscoder(0, 0);
+    transcoder.setFileSeekCallback(gifFileSeek);
+    transcoder.setFileReadBlockCallback(gifFileReadBlock);
+    transcoder.setFileWriteBlockCallback(mafFileWriteBlock);
+    transcoder.setFrameCallback(gifFrame);
+
+    // Decode all gif frames. The size is known after the header has been read, so decode twice.
+    gifFrameCount = 0;
+    gifFrameSize = MAX_FILE_SIZE;
+    transcoder.setFrameCallback(NULL);
+    int result = transcoder.decode();
+    gifFrameSize = transcoder.getWidth() * transcoder.getHeight() * 3;
+    transcoder.setFrameCallback(gifFrame);
+    if (result == GIF_TRANSCODER_OK) result = transcoder.decode();
+    if (result != GIF_TRANSCODER_OK) {
+        printf("%s: decoding failed with error %d\n", fileName, result);
+        return false;
+    }
+
+    // Validate the file like an upload
+    bool success = testValidator(fileName, transcoder.getWidth(), transcoder.getHeight(), gifFrameCount);
+
+    // Transcode. Every pass and every frame of every pass yields
+    mafFileSize = 0;
+    yields = 0;
+    transcoder.setYieldCallback(countYield);
+    result = transcoder.transcode();
+    if (result == GIF_TRANSCODER_ERROR_TOO_MANY_COLORS) {
+        // Not an error, these files are played back as gif
+        printf("%s: more than 256 colors, skipped\n", fileName);
+        for (int i = 0; i < gifFrameCount; i++) free(gifFrames[i]);
+        return success;
+    }
+    if (result != GIF_TRANSCODER_OK) {
+        printf("%s: transcoding failed with error %d\n", fileName, result);
+        return false;
+    }
+    if (yields < 3 * (gifFrameCount + 1)) {
+        printf("%s: %d yields for %d frames\n", fileName, yields, gifFrameCount);
+        success = false;
+    }
+
+    // Decode the maf file and compare all frames
+    RuntimeMAFDecoder decoder = RuntimeMAFDecoder(transcoder.getWidth(), transcoder.getHeight());
+    decoder.setFileSeekCallback(mafFileSeek);
+    decoder.setFileReadCallback(mafFileRead);
+    decoder.setFileReadBlockCallback(mafFileReadBlock);
+    if (!decoder.initDecoder() || decoder.getFrameCount() != gifFrameCount) {
+        printf("%s: invalid maf header\n", fileName);
+        success = false;
+    }
+
+    uint8_t *framebuffer = (uint8_t *) malloc(gifFrameSize);
+    for (int i = 0; i < gifFrameCount; i++) {
+        decoder.decodeFrame(framebuffer);
+        if (memcmp(framebuffer, gifFrames[i], gifFrameSize) != 0) {
+            printf("%s: frame %d differs\n", fileName, i);
+            success = false;
+        }
+        if (gifDelays[i] > 0 && decoder.getFrameDuration() != gifDelays[i] * 10) {
+            printf("%s: frame %d has a duration of %d ms instead of %d ms\n",
+                fileName, i, decoder.getFrameDuration(), gifDelays[i] * 10);
+            success = false;
+        }
+    }
+
+    // Compare with key frames only
+    const int width = transcoder.getWidth();
+    const int height = transcoder.getHeight();
+    createKeyFrameFile(width, height);
+    double mafBytes, keyBytes;
+    double mafMicros = benchmarkDecoder(mafFile, width, height, &mafBytes);
+    double keyMicros = benchmarkDecoder(keyFile, width, height, &keyBytes);
+
+    printf("%s: %dx%d, %d frames, %d colors, gif %d bytes, maf %d bytes: %s\n",
+        fileName, width, height, gifFrameCount, transcoder.getPaletteSize(), gifFileSize, mafFileSize,
+        success ? "OK" : "FAILED");
+    printf("    frames: %d key, %d rle, %d delta, %d delta rle\n",
+        transcoder.getFrameTypeCount(MAF_FRAME_KEY), transcoder.getFrameTypeCount(MAF_FRAME_RLE),
+        transcoder.getFrameTypeCount(MAF_FRAME_DELTA), transcoder.getFrameTypeCount(MAF_FRAME_DELTA | MAF_FRAME_RLE));
+    printf("    key frames only: %d bytes, %.1f bytes/frame read, %.2f us/frame\n", keyFileSize, keyBytes, keyMicros);
+    printf("    maf:             %d bytes (%.1f%%), %.1f bytes/frame read, %.2f us/frame\n",
+        mafFileSize, mafFileSize * 100.0 / keyFileSize, mafBytes, mafMicros);
+
+    free(framebuffer);
+    for (int i = 0; i < gifFrameCount; i++) free(gifFrames[i]);
+    return success;
+}
+
+int main(int argc, char **argv) {
+    printf("GIF Transcoder Library Test\n");
+
+    const char *defaultFiles[] = {
+        "../../data/animations/0.gif",
+        "../../data/animations/1.gif",
+        "../../data/animations/2.gif",
+        "../../data/animations/3.gif"
+    };
+
+    bool success = true;
+    if (argc > 1) {
+        for (int i = 1; i < argc; i++) success &= testFile(argv[i]);
+    } else {
+        for (int i = 0; i < 4; i++) success &= testFile(defaultFiles[i]);
+    }
+
+    return success ? 0 : 1;
+}
@@ -0,0 +1,125 @@
+#ifndef LED_LAYOUT_H
+#define LED_LAYOUT_H
+
+#include <stdint.h>
+
+// Layout flags
+#define LED_LAYOUT_SERPENTINE       0x01    // Every second row of a tile runs backwards
+#define LED_LAYOUT_FLIP_X           0x02    // The tiles are mirrored horizontally
+#define LED_LAYOUT_FLIP_Y           0x04    // The tiles are mirrored vertically
+#define LED_LAYOUT_TILE_SERPENTINE  0x08    // Every second row of tiles is chained backwards
+
+
+/*
+ * Wiring of a led matrix that is built from a chain of equally sized tiles. The renderers draw into a row major
+ * framebuffer (x + y * width), logicalIndex() returns the framebuffer position of every led in the chain, so the output
+ * stage can gather the strip with a single lookup per led.
+ *
+ * The tiles are chained row by row, starting in the top left corner. The leds of a tile run along its rows, starting
+ * in its top left corner. A rotated tile (in 90 degree steps, clockwise) starts in the corner the top left corner was
+ * rotated to and runs along the rotated rows, so a tile rotated by 90 degrees starts in the top right corner and runs
+ * down. Flipping is applied after the rotation.
+ *
+ * Everything is constexpr, so a layout known at compile time can be checked with static_assert().
+ */
+class LedLayout {
+    private:
+        uint16_t m_width;
+        uint16_t m_height;
+        uint16_t m_tileWidth;
+        uint16_t m_tileHeight;
+        uint8_t m_rotation;
+        uint8_t m_flags;
+
+        constexpr uint16_t tileLeds() const {
+            return m_tileWidth * m_tileHeight;
+        }
+
+        constexpr uint16_t tilesX() const {
+            return m_width / m_tileWidth;
+        }
+
+        // Length of the wired rows of a tile
+        constexpr uint16_t rowLength() const {
+            return m_rotation & 1 ? m_tileHeight : m_tileWidth;
+        }
+
+        // Position of a led in the wired rows of its tile
+        constexpr uint16_t wiredRow(uint16_t led) const {
+            return led / rowLength();
+        }
+
+        constexpr uint16_t wiredColumn(uint16_t led) const {
+            return (m_flags & LED_LAYOUT_SERPENTINE) && (wiredRow(led) & 1)
+                ? rowLength() - 1 - led % rowLength()
+                : led % rowLength();
+        }
+
+        // Position in the tile after the rotation
+        constexpr uint16_t rotatedX(uint16_t column, uint16_t row) const {
+            return m_rotation == 0 ? column
+                : m_rotation == 1 ? m_tileWidth - 1 - row
+                : m_rotation == 2 ? m_tileWidth - 1 - column
+                : row;
+        }
+
+        constexpr uint16_t rotatedY(uint16_t column, uint16_t row) const {
+            return m_rotation == 0 ? row
+                : m_rotation == 1 ? column
+                : m_rotation == 2 ? m_tileHeight - 1 - row
+                : m_tileHeight - 1 - column;
+        }
+
+        // Position in the tile after the rotation and flipping
+        constexpr uint16_t tileX(uint16_t led) const {
+            return m_flags & LED_LAYOUT_FLIP_X
+                ? m_tileWidth - 1 - rotatedX(wiredColumn(led), wiredRow(led))
+                : rotatedX(wiredColumn(led), wiredRow(led));
+        }
+
+        constexpr uint16_t tileY(uint16_t led) const {
+            return m_flags & LED_LAYOUT_FLIP_Y
+                ? m_tileHeight - 1 - rotatedY(wiredColumn(led), wiredRow(led))
+                : rotatedY(wiredColumn(led), wiredRow(led));
+        }
+
+        // Position of a tile in the matrix
+        constexpr uint16_t tileRow(uint16_t tile) const {
+            return tile / tilesX();
+        }
+
+        constexpr uint16_t tileColumn(uint16_t tile) const {
+            return (m_flags & LED_LAYOUT_TILE_SERPENTINE) && (tileRow(tile) & 1)
+                ? tilesX() - 1 - tile % tilesX()
+                : tile % tilesX();
+        }
+
+    public:
+        constexpr LedLayout(uint16_t width, uint16_t height, uint16_t tileWidth, uint16_t tileHeight, uint8_t rotation,
+            uint8_t flags) : m_width(width), m_height(height), m_tileWidth(tileWidth), m_tileHeight(tileHeight),
+            m_rotation(rotation), m_flags(flags) {}
+
+        // The tiles must fill the matrix
+        constexpr bool isValid() const {
+            return m_tileWidth > 0 && m_tileHeight > 0 && m_rotation < 4
+                && m_width % m_tileWidth == 0 && m_height % m_tileHeight == 0;
+        }
+
+        constexpr uint16_t getNumLeds() const {
+            return m_width * m_height;
+        }
+
+        // Framebuffer position (x + y * width) of the led at the given position of the chain
+        constexpr uint16_t logicalIndex(uint16_t led) const {
+            return tileColumn(led / tileLeds()) * m_tileWidth + tileX(led % tileLeds())
+                + (tileRow(led / tileLeds()) * m_tileHeight + tileY(led % tileLeds())) * m_width;
+        }
+
+        // Fills the table with the framebuffer position of every led of the chain
+        void build(uint16_t *table) const {
+            for (uint16_t i = 0; i < getNumLeds(); i++) table[i] = logicalIndex(i);
+        }
+};
+
+
+#endif
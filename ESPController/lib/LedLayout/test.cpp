@@ -0,0 +1,133 @@
+#include <stdio.h>
+
+#include "LedLayout.h"
+#include <string.h>
+#include <time.h>
+
+/*
+ * Checks the led order of serpentine, rotated, flipped and tiled layouts against hand written tables and that every
+ * layout maps the chain onto every framebuffer position exactly once. Also measures the gather of a frame through the
+ * table, like the output stage does it.
+ */
+
+// Layouts known at compile time are checked by the compiler
+static_assert(LedLayout(4, 2, 4, 2, 0, LED_LAYOUT_SERPENTINE).logicalIndex(4) == 7, "serpentine row");
+static_assert(LedLayout(4, 4, 4, 4, 1, 0).logicalIndex(1) == 7, "rotated tile");
+static_assert(!LedLayout(6, 4, 4, 4, 0, 0).isValid(), "tiles must fill the matrix");
+
+struct Rgb {
+    uint8_t r, g, b;
+};
+
+bool testTable(const char *name, const LedLayout &layout, const uint16_t *expected) {
+    bool ok = true;
+    for (uint16_t i = 0; i < layout.getNumLeds(); i++) ok &= layout.logicalIndex(i) == expected[i];
+
+    printf("%-32s %s\n", name, ok ? "OK" : "FAILED");
+    return ok;
+}
+
+// Every led must map to a different framebuffer position
+bool isPermutation(const LedLayout &layout) {
+    bool used[64 * 64];
+    memset(used, 0, sizeof(used));
+    for (uint16_t i = 0; i < layout.getNumLeds(); i++) {
+        uint16_t index = layout.logicalIndex(i);
+        if (index >= layout.getNumLeds() || used[index]) return false;
+        used[index] = true;
+    }
+    return true;
+}
+
+bool testPermutations() {
+    const uint16_t sizes[][4] = {
+        { 4, 4, 4, 4 }, { 8, 4, 4, 4 }, { 8, 8, 4, 4 }, { 32, 8, 32, 8 }, { 32, 16, 32, 8 }, { 64, 64, 32, 8 }, { 6, 9, 3, 3 }
+    };
+
+    int layouts = 0;
+    bool ok = true;
+    for (int s = 0; s < 7; s++) {
+        for (uint8_t rotation = 0; rotation < 4; rotation++) {
+            for (uint8_t flags = 0; flags < 16; flags++) {
+                LedLayout layout(sizes[s][0], sizes[s][1], sizes[s][2], sizes[s][3], rotation, flags);
+                if (!isPermutation(layout)) {
+                    printf("    %dx%d with %dx%d tiles, rotation %d, flags %d is not a permutation\n",
+                        sizes[s][0], sizes[s][1], sizes[s][2], sizes[s][3], rotation, flags);
+                    ok = false;
+                }
+                layouts++;
+            }
+        }
+    }
+
+    printf("%-32s %s (%d layouts)\n", "permutations", ok ? "OK" : "FAILED", layouts);
+    return ok;
+}
+
+int main() {
+    printf("Led Layout Test\n");
+
+    bool ok = true;
+
+    const uint16_t progressive[] = { 0, 1, 2, 3, 4, 5, 6, 7 };
+    ok &= testTable("progressive", LedLayout(4, 2, 4, 2, 0, 0), progressive);
+
+    const uint16_t serpentine[] = { 0, 1, 2, 3, 7, 6, 5, 4 };
+    ok &= testTable("serpentine", LedLayout(4, 2, 4, 2, 0, LED_LAYOUT_SERPENTINE), serpentine);
+
+    // Starts top right and runs down the columns
+    const uint16_t rotated90[] = { 3, 7, 11, 15, 2, 6, 10, 14, 1, 5, 9, 13, 0, 4, 8, 12 };
+    ok &= testTable("rotated 90", LedLayout(4, 4, 4, 4, 1, 0), rotated90);
+
+    const uint16_t rotated180[] = { 7, 6, 5, 4, 3, 2, 1, 0 };
+    ok &= testTable("rotated 180", LedLayout(4, 2, 4, 2, 2, 0), rotated180);
+
+    // Columns of a 4x2 tile, from the bottom left corner upwards
+    const uint16_t rotated270[] = { 4, 0, 5, 1, 6, 2, 7, 3 };
+    ok &= testTable("rotated 270", LedLayout(4, 2, 4, 2, 3, 0), rotated270);
+
+    const uint16_t flipped[] = { 4, 5, 6, 7, 3, 2, 1, 0 };
+    ok &= testTable("serpentine flipped y", LedLayout(4, 2, 4, 2, 0, LED_LAYOUT_SERPENTINE | LED_LAYOUT_FLIP_Y), flipped);
+
+    // Two 2x2 serpentine tiles side by side
+    const uint16_t tiles[] = { 0, 1, 5, 4, 2, 3, 7, 6 };
+    ok &= testTable("tiles", LedLayout(4, 2, 2, 2, 0, LED_LAYOUT_SERPENTINE), tiles);
+
+    // 2x2 tiles of 2x2 leds, the second row of tiles is chained from right to left
+    const uint16_t tileSerpentine[] = { 0, 1, 4, 5, 2, 3, 6, 7, 10, 11, 14, 15, 8, 9, 12, 13 };
+    ok &= testTable("tile serpentine", LedLayout(4, 4, 2, 2, 0, LED_LAYOUT_TILE_SERPENTINE), tileSerpentine);
+
+    ok &= testPermutations();
+
+    // Run time of the gather of a 32x16 frame (two serpentine 32x8 tiles)
+    const LedLayout layout(32, 16, 32, 8, 0, LED_LAYOUT_SERPENTINE);
+    static uint16_t table[32 * 16];
+    static Rgb framebuffer[32 * 16];
+    static Rgb strip[32 * 16];
+    layout.build(table);
+    for (int i = 0; i < 32 * 16; i++) framebuffer[i] = { (uint8_t) i, (uint8_t) (i >> 8), 0 };
+
+    const int iterations = 100000;
+    clock_t start = clock();
+    for (int n = 0; n < iterations; n++) {
+        framebuffer[n % (32 * 16)].b++;
+        for (int i = 0; i < 32 * 16; i++) strip[i] = framebuffer[table[i]];
+    }
+    double gatherNanos = (double) (clock() - start) * 1000000000 / CLOCKS_PER_SEC / iterations;
+
+    start = clock();
+    for (int n = 0; n < iterations; n++) {
+        framebuffer[n % (32 * 16)].b++;
+        for (int i = 0; i < 32 * 16; i++) strip[i] = framebuffer[layout.logicalIndex(i)];
+    }
+    double computeNanos = (double) (clock() - start) * 1000000000 / CLOCKS_PER_SEC / iterations;
+
+    bool gathered = true;
+    for (int i = 0; i < 32 * 16; i++) gathered &= memcmp(&strip[i], &framebuffer[table[i]], sizeof(Rgb)) == 0;
+    ok &= gathered;
+    printf("32x16 frame: %.1f ns with the table, %.1f ns computing every position: %s\n",
+        gatherNanos, computeNanos, gathered ? "OK" : "FAILED");
+
+    printf(ok ? "OK\n" : "FAILED\n");
+    return ok ? 0 : 1;
+}
@@ -1,85 +1,270 @@
 #include "MAFDecoder.h"
 #include <stdio.h>
+#include <stddef.h>
 
-MAFDecoder::MAFDecoder(uint8_t matrix_width, uint8_t matrix_height) {
-    m_matrix_width = matrix_width;
-    m_matrix_height = matrix_height;
+bool isMafHeader(const uint8_t *header) {
+    return header[0] == MAF_MAGIC_0 && header[1] == MAF_MAGIC_1 && header[2] == MAF_MAGIC_2
+        && header[3] == MAF_VERSION;
+}
+
+MAFDecoderBase::MAFDecoderBase() {
+    m_frame_count = 0;
+    m_current_frame = 0;
+    m_table_offset = 0;
+    m_frame_duration = 0;
+    m_default_frame_duration = 100;
+    m_deadline = 0;
+    m_deadline_valid = false;
+    m_read_position = 0;
+    m_read_length = 0;
+    m_frame_remaining = 0;
+
+    fileSeekCallback = NULL;
+    fileReadCallback = NULL;
+    fileReadBlockCallback = NULL;
+    drawPixelCallback = NULL;
+    updateScreenCallback = NULL;
 }
 
-void MAFDecoder::setFileSeekCallback(file_seek_callback c) {
+void MAFDecoderBase::setFileSeekCallback(file_seek_callback c) {
     fileSeekCallback = c;
 }
 
-void MAFDecoder::setFileReadCallback(file_read_callback c) {
+void MAFDecoderBase::setFileReadCallback(file_read_callback c) {
     fileReadCallback = c;
 }
 
-void MAFDecoder::setFileReadBlockCallback(file_read_block_callback c) {
+void MAFDecoderBase::setFileReadBlockCallback(file_read_block_callback c) {
     fileReadBlockCallback = c;
 }
 
-void MAFDecoder::setDrawPixelCallback(draw_pixel_callback c) {
+void MAFDecoderBase::setDrawPixelCallback(draw_pixel_callback c) {
     drawPixelCallback = c;
 }
 
-void MAFDecoder::setUpdateScreenCallback(update_screen_callback c) {
+void MAFDecoderBase::setUpdateScreenCallback(update_screen_callback c) {
     updateScreenCallback = c;
 }
 
-void MAFDecoder::initDecoder(void) {
-    // Read the animation width and height and check if they are correct.
-    uint8_t animationWidth = fileReadCallback();
-    uint8_t animationHeight= fileReadCallback();
-    if (animationWidth != m_matrix_width || animationHeight != m_matrix_height) {
+void MAFDecoderBase::setDefaultFrameDuration(uint16_t duration) {
+    m_default_frame_duration = duration;
+}
+
+bool MAFDecoderBase::advance(uint32_t now) {
+    // The first frame is due right away
+    if (!m_deadline_valid) {
+        m_deadline = now;
+        m_deadline_valid = true;
+        return true;
+    }
+
+    const int32_t lateness = now - m_deadline;
+    if (lateness < 0) return false;
+
+    // Don't try to catch up after a long stall (e.g. a blocking file upload), just continue from now on
+    if (lateness > MAF_MAX_LATENESS_US) m_deadline = now;
+    return true;
+}
+
+void MAFDecoderBase::restartTiming(uint32_t now) {
+    // The last decoded frame is shown from now on for its duration
+    m_deadline = now + (uint32_t) m_frame_duration * 1000;
+    m_deadline_valid = true;
+}
+
+uint32_t MAFDecoderBase::getNextDeadline(void) {
+    return m_deadline;
+}
+
+uint16_t MAFDecoderBase::getFrameDuration(void) {
+    return m_frame_duration;
+}
+
+uint16_t MAFDecoderBase::getFrameCount(void) {
+    return m_frame_count;
+}
+
+bool MAFDecoderBase::readHeader(uint16_t matrix_width, uint16_t matrix_height) {
+    // Start reading from the beginning of the file
+    fileSeekCallback(0);
+
+    uint8_t header[MAF_HEADER_SIZE];
+    if (fileReadBlockCallback(header, MAF_HEADER_SIZE) != MAF_HEADER_SIZE || !isMafHeader(header)) {
+        #ifdef MAF_DEBUG
+            printf("MAF: Not a MAF file of version %d!\n", MAF_VERSION);
+        #endif
+        return false;
+    }
+
+    // Check if the animation width and height are correct
+    const uint16_t animationWidth = header[4] | (header[5] << 8);
+    const uint16_t animationHeight = header[6] | (header[7] << 8);
+    if (animationWidth != matrix_width || animationHeight != matrix_height) {
         #ifdef MAF_DEBUG
             printf("MAF: Animation size is different from matrix size!\n");
         #endif
-        return;
+        return false;
     }
 
-    // Read the animation frame count
-    m_frame_count = fileReadCallback();
+    m_frame_count = header[8] | (header[9] << 8);
+    if (m_frame_count == 0) return false;
     #ifdef MAF_DEBUG
         printf("MAF: Frame count: %d\n", m_frame_count);
     #endif
 
-    // Read the palette size
-    int paletteSize = (int) fileReadCallback() + 1;
+    // Read the palette
+    const int paletteSize = (int) header[10] + 1;
+    if (fileReadBlockCallback(m_palette, paletteSize * 3) != paletteSize * 3) return false;
     #ifdef MAF_DEBUG
         printf("MAF: Palette size: %d\n", paletteSize);
     #endif
 
-    // Read the palette
-    fileReadBlockCallback(&m_palette, paletteSize * 3);
-    #ifdef MAF_DEBUG
-        printf("Palette: ");
-        for (int i = 0; i < paletteSize * 3; i++) printf("%d ", (uint8_t) m_palette[i]);
-        printf("\n");
-    #endif
+    // The frame offset table follows the palette
+    m_table_offset = MAF_HEADER_SIZE + paletteSize * 3;
+    m_current_frame = 0;
+    m_deadline_valid = false;
+    return true;
+}
+
+uint8_t MAFDecoderBase::beginFrame(void) {
+    // Get the offset and the size of the frame from the table
+    uint8_t offsets[8] = { 0 };
+    fileSeekCallback(m_table_offset + (uint32_t) m_current_frame * 4);
+    const bool tableValid = fileReadBlockCallback(offsets, 8) == 8;
+    const uint32_t start = offsets[0] | (offsets[1] << 8) | ((uint32_t) offsets[2] << 16) | ((uint32_t) offsets[3] << 24);
+    const uint32_t end = offsets[4] | (offsets[5] << 8) | ((uint32_t) offsets[6] << 16) | ((uint32_t) offsets[7] << 24);
 
-    // Set the frame offset
-    m_frame_offset = 4 + paletteSize * 3;
-    m_currrent_frame = 0;
+    m_current_frame++;
+    if (m_current_frame >= m_frame_count) m_current_frame = 0;
+
+    // Read the type and the duration. The rest of the frame is read by the caller. A frame that can't be read has no
+    // pixels left, so decoding it fails
+    uint8_t header[MAF_FRAME_HEADER_SIZE] = { MAF_FRAME_KEY, 0, 0 };
+    fileSeekCallback(start);
+    if (tableValid && fileReadBlockCallback(header, MAF_FRAME_HEADER_SIZE) == MAF_FRAME_HEADER_SIZE) {
+        m_frame_remaining = end > start + MAF_FRAME_HEADER_SIZE ? end - start - MAF_FRAME_HEADER_SIZE : 0;
+    } else {
+        m_frame_remaining = 0;
+    }
+    m_read_position = 0;
+    m_read_length = 0;
+
+    // The next frame is due when this one has been shown for its duration
+    m_frame_duration = header[1] | (header[2] << 8);
+    if (m_frame_duration == 0) m_frame_duration = m_default_frame_duration;
+    m_deadline += (uint32_t) m_frame_duration * 1000;
+
+    return header[0];
 }
 
-void MAFDecoder::decodeFrame(void) {
-    // Seek to the current position
-    fileSeekCallback(m_frame_offset + (int) m_matrix_width * (int) m_matrix_height * (int) m_currrent_frame);
+int MAFDecoderBase::readByte(void) {
+    // Refill the buffer, but don't read past the end of the frame
+    if (m_read_position >= m_read_length) {
+        if (m_frame_remaining == 0) return -1;
+        int length = m_frame_remaining < sizeof(m_read_buffer) ? m_frame_remaining : sizeof(m_read_buffer);
+        if (fileReadBlockCallback(m_read_buffer, length) != length) return -1;
+        m_frame_remaining -= length;
+        m_read_length = length;
+        m_read_position = 0;
+    }
+
+    return m_read_buffer[m_read_position++];
+}
 
-    // Read the frame data one-by-one and output it to the draw pixel callback
-    for (uint8_t y = 0; y < m_matrix_height; y++) {
-        for (uint8_t x = 0; x < m_matrix_width; x++) {
-            // Get the palette color and convert it to rgb
-            const uint8_t color = fileReadCallback();
-            const uint8_t red = m_palette[(int) color * 3];
-            const uint8_t green = m_palette[(int) color * 3 + 1];
-            const uint8_t blue = m_palette[(int) color * 3 + 2];
+uint16_t MAFDecoderBase::readWord(void) {
+    uint8_t low = readByte();
+    uint8_t high = readByte();
+    return low | (high << 8);
+}
 
-            drawPixelCallback(x, y, red, green, blue);
+bool MAFDecoderBase::decodePixels(uint8_t *framebuffer, uint16_t width, uint16_t height, uint8_t type) {
+    // Get the rectangle that is updated
+    uint16_t left = 0;
+    uint16_t top = 0;
+    uint16_t rectWidth = width;
+    uint16_t rectHeight = height;
+    if (type & MAF_FRAME_DELTA) {
+        left = readWord();
+        top = readWord();
+        rectWidth = readWord();
+        rectHeight = readWord();
+        if (left + rectWidth > width || top + rectHeight > height) return false;
+    }
+    if (rectWidth == 0 || rectHeight == 0) return true;
+
+    uint16_t x = left;
+    uint16_t y = top;
+    const uint16_t right = left + rectWidth;
+    const uint16_t bottom = top + rectHeight;
+
+    while (y < bottom) {
+        // Get the next run (a single pixel if not run length encoded)
+        int run = 1;
+        if (type & MAF_FRAME_RLE) run = readByte() + 1;
+        const int index = readByte();
+        if (run <= 0 || index < 0) return false;
+
+        const uint8_t *color = &m_palette[index * 3];
+        for (; run > 0 && y < bottom; run--) {
+            if (framebuffer) {
+                uint8_t *pixel = &framebuffer[((uint32_t) x + (uint32_t) y * width) * 3];
+                pixel[0] = color[0];
+                pixel[1] = color[1];
+                pixel[2] = color[2];
+            } else {
+                drawPixelCallback(x, y, color[0], color[1], color[2]);
+            }
+
+            x++;
+            if (x >= right) {
+                x = left;
+                y++;
+            }
         }
     }
 
-    m_currrent_frame++;
-    if (m_currrent_frame >= m_frame_count) m_currrent_frame = 0;
-    updateScreenCallback();
+    return true;
+}
+
+RuntimeMAFDecoder::RuntimeMAFDecoder(uint16_t matrix_width, uint16_t matrix_height) {
+    m_matrix_width = matrix_width;
+    m_matrix_height = matrix_height;
+}
+
+bool RuntimeMAFDecoder::initDecoder(void) {
+    return readHeader(m_matrix_width, m_matrix_height);
+}
+
+bool RuntimeMAFDecoder::decodeFrame(void) {
+    if (!decodePixels(NULL, m_matrix_width, m_matrix_height, beginFrame())) return false;
+    if (updateScreenCallback) updateScreenCallback();
+    return true;
+}
+
+bool RuntimeMAFDecoder::decodeFrame(uint8_t *framebuffer) {
+    const uint8_t type = beginFrame();
+    if (type != MAF_FRAME_KEY) {
+        if (!decodePixels(framebuffer, m_matrix_width, m_matrix_height, type)) return false;
+        if (updateScreenCallback) updateScreenCallback();
+        return true;
+    }
+
+    const uint32_t frameSize = (uint32_t) m_matrix_width * m_matrix_height;
+
+    // Read the whole index plane into the last third of the framebuffer (see MAFDecoder::decodeFrame)
+    uint8_t *indices = framebuffer + frameSize * 2;
+    if (m_frame_remaining < frameSize || fileReadBlockCallback(indices, frameSize) != (int) frameSize) {
+        memset(framebuffer, 0, frameSize * 3);
+        return false;
+    }
+
+    for (uint32_t i = 0; i < frameSize; i++) {
+        const uint8_t *color = &m_palette[indices[i] * 3];
+        framebuffer[i * 3] = color[0];
+        framebuffer[i * 3 + 1] = color[1];
+        framebuffer[i * 3 + 2] = color[2];
+    }
+
+    if (updateScreenCallback) updateScreenCallback();
+    return true;
 }
\ No newline at end of file
@@ -2,25 +2,86 @@
 #define MAF_DECODER_H
 
 #include <stdint.h>
+#include <stddef.h>
+#include <string.h>
 
 //#define MAF_DEBUG
 
+/*
+ * MAF (Matrix Animation File) Format, version 3. All 16 and 32 bit values are little endian.
+ *
+ * OFFSET   MEANING
+ * 0x00     "MAF" magic
+ * 0x03     format version
+ * 0x04     width of the animation (16 bit)
+ * 0x06     height of the animation (16 bit)
+ * 0x08     number of frames (16 bit)
+ * 0x0A     number of colors in the palette minus one (0: 1 color, 1: two colors, ..., 255: 256 colors)
+ * 0x0B...  color0 red, color0 green, color0 blue, color1 red, ...
+ *
+ * followed by the frame offset table (number of frames + 1 file offsets of 32 bit, the last one is the end of the
+ * file) and the frames. Every frame starts with its type flags and its duration in ms (16 bit, 0 if the gif frame
+ * had no delay), followed by the pixels:
+ *
+ *   KEY        width * height palette indices
+ *   DELTA      left, top, width and height of the rectangle that changed since the previous frame (16 bit each),
+ *              followed by its palette indices. Pixels outside the rectangle keep the color of the previous frame.
+ *   RLE        the palette indices are run length encoded as (run length - 1, palette index) pairs
+ *
+ * DELTA and RLE can be combined. The first frame is never a delta frame.
+ */
+#define MAF_MAGIC_0         'M'
+#define MAF_MAGIC_1         'A'
+#define MAF_MAGIC_2         'F'
+#define MAF_VERSION         3
+#define MAF_HEADER_SIZE     11
+#define MAF_FRAME_HEADER_SIZE   3
+
+#define MAF_FRAME_KEY       0x00
+#define MAF_FRAME_DELTA     0x01
+#define MAF_FRAME_RLE       0x02
+
+// If playback is late by more than this, the next frame is scheduled from now on instead of catching up
+#define MAF_MAX_LATENESS_US 250000
+
 typedef bool (*file_seek_callback)(unsigned long position);
 typedef int (*file_read_callback)(void);
 typedef int (*file_read_block_callback)(void *buffer, int numberOfBytes);
 
-typedef void (*draw_pixel_callback)(uint8_t x, uint8_t y, uint8_t red, uint8_t green, uint8_t blue);
+typedef void (*draw_pixel_callback)(uint16_t x, uint16_t y, uint8_t red, uint8_t green, uint8_t blue);
 typedef void (*update_screen_callback)(void);
 
-class MAFDecoder {
-    private:
-        int8_t m_matrix_width;
-        int8_t m_matrix_height;
+// Checks the magic and version of a MAF header (at least 4 bytes)
+bool isMafHeader(const uint8_t *header);
 
-        int8_t m_frame_count, m_currrent_frame;
+/*
+ * Header parsing, callbacks and the delta / run length decoding shared by the decoders. MAFDecoder (matrix size known
+ * at compile time) and RuntimeMAFDecoder (matrix size set in the constructor) implement the key frame decoding.
+ *
+ * Delta frames only update the changed pixels, so the framebuffer must still hold the previous frame.
+ *
+ * The frames are timed with absolute deadlines: advance() tells if the next frame is due and every decoded frame moves
+ * the deadline by its duration, so the playback speed doesn't drift, no matter how late the frames are decoded.
+ */
+class MAFDecoderBase {
+    protected:
+        uint16_t m_frame_count;
+        uint16_t m_current_frame;
 
-        int8_t m_palette[256 * 3];
-        int m_frame_offset;
+        uint8_t m_palette[256 * 3];
+        uint32_t m_table_offset;
+
+        // Timing of the frames in ms and the deadline of the next frame in us
+        uint16_t m_frame_duration;
+        uint16_t m_default_frame_duration;
+        uint32_t m_deadline;
+        bool m_deadline_valid;
+
+        // Input buffer for the delta and run length encoded frames
+        uint8_t m_read_buffer[64];
+        uint8_t m_read_position;
+        uint8_t m_read_length;
+        uint32_t m_frame_remaining;
 
         file_seek_callback fileSeekCallback;
         file_read_callback fileReadCallback;
@@ -29,9 +90,22 @@ class MAFDecoder {
         draw_pixel_callback drawPixelCallback;
         update_screen_callback updateScreenCallback;
 
-    public:
-        MAFDecoder(uint8_t matrix_width, uint8_t matrix_height);
+        MAFDecoderBase();
+
+        // Reads the header and palette and checks the animation size
+        bool readHeader(uint16_t matrix_width, uint16_t matrix_height);
 
+        // Seeks to the current frame, advances to the next one and its deadline and returns the frame type flags
+        uint8_t beginFrame(void);
+
+        // Decodes a delta and / or run length encoded frame (or any frame if framebuffer is NULL) into the
+        // framebuffer or to the draw pixel callback. Returns false if the frame is truncated or invalid
+        bool decodePixels(uint8_t *framebuffer, uint16_t width, uint16_t height, uint8_t type);
+
+        int readByte(void);
+        uint16_t readWord(void);
+
+    public:
         void setFileSeekCallback(file_seek_callback c);
         void setFileReadCallback(file_read_callback c);
         void setFileReadBlockCallback(file_read_block_callback c);
@@ -39,8 +113,83 @@ class MAFDecoder {
         void setDrawPixelCallback(draw_pixel_callback c);
         void setUpdateScreenCallback(update_screen_callback c);
 
-        void initDecoder(void);
-        void decodeFrame(void);
+        // Duration of frames without a delay in ms
+        void setDefaultFrameDuration(uint16_t duration);
+
+        // Returns true if the next frame is due at the given time (micros())
+        bool advance(uint32_t now);
+
+        // Times the next frame from the given time on, e.g. when a frame that was decoded ahead is shown
+        void restartTiming(uint32_t now);
+
+        // Deadline of the next frame (in micros()) and duration of the last decoded frame in ms
+        uint32_t getNextDeadline(void);
+        uint16_t getFrameDuration(void);
+
+        uint16_t getFrameCount(void);
+};
+
+template <uint16_t MATRIX_W, uint16_t MATRIX_H>
+class MAFDecoder : public MAFDecoderBase {
+    private:
+        static constexpr uint32_t FRAME_SIZE = (uint32_t) MATRIX_W * MATRIX_H;
+
+    public:
+        // Reads the header and palette. Returns false if the file is invalid or the animation size doesn't match
+        bool initDecoder(void) {
+            return readHeader(MATRIX_W, MATRIX_H);
+        }
+
+        // Decodes the next frame pixel by pixel using the draw pixel callback. Returns false if the frame is
+        // truncated or invalid, the screen isn't updated then
+        bool decodeFrame(void) {
+            if (!decodePixels(NULL, MATRIX_W, MATRIX_H, beginFrame())) return false;
+            if (updateScreenCallback) updateScreenCallback();
+            return true;
+        }
+
+        // Decodes the next frame with a single block read straight into an RGB888 framebuffer of
+        // width * height * 3 bytes (e.g. a CRGB array). The draw pixel callback is not used.
+        bool decodeFrame(uint8_t *framebuffer) {
+            const uint8_t type = beginFrame();
+            if (type != MAF_FRAME_KEY) {
+                if (!decodePixels(framebuffer, MATRIX_W, MATRIX_H, type)) return false;
+                if (updateScreenCallback) updateScreenCallback();
+                return true;
+            }
+
+            // Read the whole index plane into the last third of the framebuffer. Expanding it front to back never
+            // overwrites an index that wasn't read yet (3 * i + 2 < 2 * size + i + 1), so no extra buffer is needed.
+            // A truncated frame has already overwritten part of the previous one, so it is cleared instead.
+            uint8_t *indices = framebuffer + FRAME_SIZE * 2;
+            if (m_frame_remaining < FRAME_SIZE || fileReadBlockCallback(indices, FRAME_SIZE) != (int) FRAME_SIZE) {
+                memset(framebuffer, 0, FRAME_SIZE * 3);
+                return false;
+            }
+
+            for (uint32_t i = 0; i < FRAME_SIZE; i++) {
+                const uint8_t *color = &m_palette[indices[i] * 3];
+                framebuffer[i * 3] = color[0];
+                framebuffer[i * 3 + 1] = color[1];
+                framebuffer[i * 3 + 2] = color[2];
+            }
+
+            if (updateScreenCallback) updateScreenCallback();
+            return true;
+        }
+};
+
+class RuntimeMAFDecoder : public MAFDecoderBase {
+    private:
+        uint16_t m_matrix_width;
+        uint16_t m_matrix_height;
+
+    public:
+        RuntimeMAFDecoder(uint16_t matrix_width, uint16_t matrix_height);
+
+        bool initDecoder(void);
+        bool decodeFrame(void);
+        bool decodeFrame(uint8_t *framebuffer);
 };
 
-#endif
\ No newline at end of file
+#endif
@@ -1,34 +1,20 @@
 #include <stdio.h>
 
 #include "MAFDecoder.h"
+#include <stdlib.h>
 #include <string.h>
+#include <time.h>
 
 //#define VFILE_DEBUG
 
-/*
- * MAF (Matrix Animation File) Format:
- * 
- * bytesize:    4 + paletteColorCount * 3 + width * height * frameCount
- * 
- * OFFSET   MEANING
- * 0x00     width of the animation
- * 0x01     height of the animation
- * 0x02     number of frames / animation length
- * 
- * 0x03     number of colors in the palette minus on (0: 1 color, 1: two colors, ..., 255: 256 colors)
- * 0x04...  color0 red, color0 green, color0 blue, color1 red, color1 green, color1 blue, ...
- * 
- * 0xn0...  frame 0 color id at (0, 0), frame 0 color id at (1, 0), frame 0 color id at (2, 0), ...
- * 0xm0...  frame 1 color id at (0, 0), ...
- * 
- * ...      ...
- */
-
+// MAF file with a 2x2 animation, see MAFDecoder.h for the format
 unsigned char file[] = {
-    2,      // Animation width
-    2,      // Animation height
-    3,      // Number of frames
-    
+    'M', 'A', 'F',
+    3,      // Version
+    2, 0,   // Animation width
+    2, 0,   // Animation height
+    3, 0,   // Number of frames
+
     1,      // Number of colors in the palette (1 => 2 different colors)
     255,    // Color0: Magenta
     0,
@@ -37,19 +23,33 @@ unsigned char file[] = {
     255,
     0,
 
-    1,      // Frame0
-    0,      //   GM
+    33, 0, 0, 0,    // Frame offsets
+    40, 0, 0, 0,
+    52, 0, 0, 0,
+    61, 0, 0, 0,    // End of file
+
+    0,      // Frame0: key frame
+    100, 0, //   100 ms
+    1,      //   GM
     0,      //   MM
     0,
-    1,      // Frame1
-    0,      //   GM
-    0,      //   MG
-    1,
-    0,      // Frame2
-    1,      //   MG
+    0,
+    1,      // Frame1: delta frame, rectangle (1, 1) 1x1
+    50, 0,  //   50 ms
+    1, 0,
+    1, 0,
+    1, 0,
+    1, 0,
     1,      //   GM
-    0
+            //   MG
+    2,      // Frame2: run length encoded key frame
+    30, 0,  //   30 ms
+    0, 0,   //   MG
+    1, 1,   //   GM
+    0, 0
 };
+unsigned char *fileData = file;
+int fileSize = sizeof(file);
 int fileIndex = 0;
 
 bool mafFileSeek(unsigned long position) {
@@ -66,7 +66,7 @@ int mafFileRead(void) {
         printf("FILE: Reading byte from position %d\n", fileIndex);
     #endif
 
-    return file[fileIndex++];
+    return fileData[fileIndex++];
 }
 
 int mafFileReadBlock(void *buffer, int numberOfBytes) {
@@ -74,13 +74,15 @@ int mafFileReadBlock(void *buffer, int numberOfBytes) {
         printf("FILE: Reading %d bytes from position %d\n", numberOfBytes, fileIndex);
     #endif
 
-    memcpy(buffer, &file[fileIndex], numberOfBytes);
+    // Reads past the end of a (truncated) file are short
+    if (numberOfBytes > fileSize - fileIndex) numberOfBytes = fileIndex < fileSize ? fileSize - fileIndex : 0;
+    memcpy(buffer, &fileData[fileIndex], numberOfBytes);
     fileIndex += numberOfBytes;
 
-    return 0;
+    return numberOfBytes;
 }
 
-void mafDrawPixel(uint8_t x, uint8_t y, uint8_t red, uint8_t green, uint8_t blue) {
+void mafDrawPixel(uint16_t x, uint16_t y, uint8_t red, uint8_t green, uint8_t blue) {
     printf("Pixel at (%d, %d) is rgb(%d, %d, %d)\n", x, y, red, green, blue);
 }
 
@@ -89,7 +91,184 @@ void mafUpdateScreen(void) {
 }
 
 
-MAFDecoder decoder = MAFDecoder(2, 2);
+
+
+// Benchmark framebuffer and callbacks. The pixel callback writes to the framebuffer just like the gif callback does.
+uint8_t benchFramebuffer[64 * 64 * 3];
+int benchWidth = 0;
+
+void benchDrawPixel(uint16_t x, uint16_t y, uint8_t red, uint8_t green, uint8_t blue) {
+    uint8_t *pixel = &benchFramebuffer[(x + y * benchWidth) * 3];
+    pixel[0] = red;
+    pixel[1] = green;
+    pixel[2] = blue;
+}
+
+void benchUpdateScreen(void) {
+}
+
+// Creates a MAF file with random palette and random frame data
+unsigned char *createBenchFile(int width, int height, int frames, int &size) {
+    const int paletteSize = 256;
+    const int frameOffset = MAF_HEADER_SIZE + paletteSize * 3 + (frames + 1) * 4;
+    size = frameOffset + (MAF_FRAME_HEADER_SIZE + width * height) * frames;
+    unsigned char *data = (unsigned char *) malloc(size);
+
+    const unsigned char header[MAF_HEADER_SIZE] = {
+        MAF_MAGIC_0, MAF_MAGIC_1, MAF_MAGIC_2, MAF_VERSION,
+        (unsigned char) width, (unsigned char) (width >> 8),
+        (unsigned char) height, (unsigned char) (height >> 8),
+        (unsigned char) frames, (unsigned char) (frames >> 8),
+        paletteSize - 1
+    };
+    memcpy(data, header, MAF_HEADER_SIZE);
+    for (int i = MAF_HEADER_SIZE; i < size; i++) data[i] = rand() & 0xFF;
+
+    // Key frames only
+    for (int i = 0; i <= frames; i++) {
+        const uint32_t offset = frameOffset + (MAF_FRAME_HEADER_SIZE + width * height) * i;
+        unsigned char *entry = &data[MAF_HEADER_SIZE + paletteSize * 3 + i * 4];
+        for (int j = 0; j < 4; j++) entry[j] = offset >> (j * 8);
+        if (i < frames) data[offset] = MAF_FRAME_KEY;
+    }
+
+    return data;
+}
+
+template <typename Decoder>
+void setBenchCallbacks(Decoder &decoder) {
+    decoder.setFileSeekCallback(mafFileSeek);
+    decoder.setFileReadCallback(mafFileRead);
+    decoder.setFileReadBlockCallback(mafFileReadBlock);
+    decoder.setDrawPixelCallback(benchDrawPixel);
+    decoder.setUpdateScreenCallback(benchUpdateScreen);
+}
+
+template <typename Decoder>
+double benchmark(Decoder &decoder, bool block, int iterations) {
+    decoder.initDecoder();
+
+    clock_t start = clock();
+    for (int i = 0; i < iterations; i++) {
+        if (block) decoder.decodeFrame(benchFramebuffer);
+        else decoder.decodeFrame();
+    }
+    double seconds = (double) (clock() - start) / CLOCKS_PER_SEC;
+
+    return iterations / seconds;
+}
+
+// Compares the size specialized decoder with the runtime sized one. Returns false if any output differs
+template <uint16_t W, uint16_t H>
+bool runBenchmark(int iterations) {
+    fileData = createBenchFile(W, H, 300, fileSize);
+    benchWidth = W;
+    const int frameBytes = W * H * 3;
+    bool success = true;
+
+    MAFDecoder<W, H> templateDecoder;
+    RuntimeMAFDecoder runtimeDecoder = RuntimeMAFDecoder(W, H);
+    setBenchCallbacks(templateDecoder);
+    setBenchCallbacks(runtimeDecoder);
+
+    // All paths must produce the same pixels. Decode past frame 255 to cover the 16 bit frame count
+    static uint8_t expected[64 * 64 * 3];
+    templateDecoder.initDecoder();
+    runtimeDecoder.initDecoder();
+    for (int frame = 0; frame < 280; frame++) {
+        templateDecoder.decodeFrame(expected);
+        runtimeDecoder.decodeFrame(benchFramebuffer);
+        success &= memcmp(expected, benchFramebuffer, frameBytes) == 0;
+    }
+
+    // Check the last frame against the file
+    const unsigned char *palette = &fileData[MAF_HEADER_SIZE];
+    const unsigned char *indices =
+        &fileData[MAF_HEADER_SIZE + 256 * 3 + 301 * 4 + 279 * (MAF_FRAME_HEADER_SIZE + W * H) + MAF_FRAME_HEADER_SIZE];
+    for (int i = 0; i < W * H; i++) success &= memcmp(&expected[i * 3], &palette[indices[i] * 3], 3) == 0;
+
+    // Per-pixel path of the next frame
+    runtimeDecoder.decodeFrame(expected);
+    templateDecoder.decodeFrame();
+    success &= memcmp(expected, benchFramebuffer, frameBytes) == 0;
+    if (!success) printf("%dx%d: decoder outputs differ!\n", W, H);
+
+    double runtimePixelFps = benchmark(runtimeDecoder, false, iterations);
+    double runtimeBlockFps = benchmark(runtimeDecoder, true, iterations);
+    double templatePixelFps = benchmark(templateDecoder, false, iterations);
+    double templateBlockFps = benchmark(templateDecoder, true, iterations);
+    printf("%2dx%-2d  runtime per-pixel: %9.0f fps  block: %9.0f fps   template per-pixel: %9.0f fps  block: %9.0f fps  (%.2fx)\n",
+        W, H, runtimePixelFps, runtimeBlockFps, templatePixelFps, templateBlockFps, templateBlockFps / runtimeBlockFps);
+
+    free(fileData);
+    fileData = file;
+    fileSize = sizeof(file);
+    fileIndex = 0;
+    return success;
+}
+
+
+// Plays the 2x2 animation (100, 50 and 30 ms frames) for a while, calling advance() at irregular intervals like a
+// busy main loop. Every frame must be decoded within one call of its deadline, without drifting.
+template <typename Decoder>
+bool testTiming(Decoder &decoder) {
+    decoder.initDecoder();
+
+    const uint32_t start = 4294000000UL; // micros() overflows during the test
+    const uint32_t durations[3] = { 100000, 50000, 30000 };
+    uint32_t deadline = 0;
+    uint32_t now = start;
+    uint32_t maxLateness = 0;
+    int frames = 0;
+    uint8_t framebuffer[2 * 2 * 3];
+
+    for (int i = 0; i < 20000; i++) {
+        // Up to 5 ms between the calls
+        const uint32_t step = rand() % 5000;
+        now += step;
+
+        if (!decoder.advance(now)) continue;
+        decoder.decodeFrame(framebuffer);
+        if (frames == 0) deadline = now;
+
+        const uint32_t lateness = now - deadline;
+        if (lateness > maxLateness) maxLateness = lateness;
+        deadline += durations[frames % 3];
+        frames++;
+        if ((int32_t) (decoder.getNextDeadline() - deadline) != 0) return false;
+    }
+
+    printf("timing: %d frames in %.1f s, max. %u us late: %s\n", frames, (now - start) / 1000000.0, maxLateness,
+        maxLateness < 5000 ? "OK" : "FAILED");
+    return maxLateness < 5000;
+}
+
+// Decodes the 2x2 animation cut off in its key frame and in its delta frame. The truncated frames must fail and the
+// key frame must not show what was left in the framebuffer
+template <typename Decoder>
+bool testTruncated(Decoder &decoder) {
+    bool success = true;
+    uint8_t framebuffer[2 * 2 * 3];
+
+    fileSize = 38;
+    decoder.initDecoder();
+    memset(framebuffer, 0x55, sizeof(framebuffer));
+    success &= !decoder.decodeFrame(framebuffer);
+    for (unsigned int i = 0; i < sizeof(framebuffer); i++) success &= framebuffer[i] == 0;
+
+    fileSize = 46;
+    decoder.initDecoder();
+    success &= decoder.decodeFrame(framebuffer);
+    success &= !decoder.decodeFrame(framebuffer);
+    success &= !decoder.decodeFrame();
+
+    fileSize = sizeof(file);
+    printf("truncated file: %s\n", success ? "OK" : "FAILED");
+    return success;
+}
+
+
+MAFDecoder<2, 2> decoder;
 
 
 int main() {
@@ -102,9 +281,45 @@ int main() {
     decoder.setDrawPixelCallback(mafDrawPixel);
     decoder.setUpdateScreenCallback(mafUpdateScreen);
 
+    bool success = decoder.initDecoder();
+    decoder.decodeFrame();
+
+    // Key, delta and run length encoded frames, compared to the expected frames
+    const uint8_t magenta[3] = { 255, 0, 255 };
+    const uint8_t green[3] = { 0, 255, 0 };
+    const uint8_t *expectedFrames[3][4] = {
+        { green, magenta, magenta, magenta },
+        { green, magenta, magenta, green },
+        { magenta, green, green, magenta }
+    };
+    uint8_t framebuffer[2 * 2 * 3];
+    decoder.setUpdateScreenCallback(NULL);
     decoder.initDecoder();
+    for (int frame = 0; frame < 4; frame++) {
+        decoder.decodeFrame(framebuffer);
+        for (int i = 0; i < 4; i++) success &= memcmp(&framebuffer[i * 3], expectedFrames[frame % 3][i], 3) == 0;
+    }
 
-    decoder.decodeFrame();
+    success &= testTiming(decoder);
+
+    RuntimeMAFDecoder runtimeDecoder(2, 2);
+    setBenchCallbacks(runtimeDecoder);
+    success &= testTruncated(decoder);
+    success &= testTruncated(runtimeDecoder);
+
+    // A file of a different size or an old version must be rejected
+    MAFDecoder<2, 3> wrongSizeDecoder;
+    setBenchCallbacks(wrongSizeDecoder);
+    success &= !wrongSizeDecoder.initDecoder();
+    file[3] = MAF_VERSION + 1;
+    success &= !decoder.initDecoder();
+    file[3] = MAF_VERSION;
+
+    // Compare the runtime sized decoder against the template, per-pixel callback and block decode
+    printf("\nMAF Decoder Benchmark\n");
+    success &= runBenchmark<32, 8>(200000);
+    success &= runBenchmark<64, 64>(10000);
 
-    return 0;
+    printf("%s\n", success ? "OK" : "FAILED");
+    return success ? 0 : 1;
 }
\ No newline at end of file
@@ -0,0 +1,519 @@
+#include "MatrixStream.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define STATE_SYNC_0    0
+#define STATE_SYNC_1    1
+#define STATE_TYPE      2
+#define STATE_SEQUENCE  3
+#define STATE_LENGTH_0  4
+#define STATE_LENGTH_1  5
+#define STATE_PAYLOAD   6
+#define STATE_CRC_0     7
+#define STATE_CRC_1     8
+
+#define OP_SKIP         0x00
+#define OP_REPEAT       0x80
+#define OP_LITERAL      0xC0
+#define OP_SKIP_MAX     128
+#define OP_RUN_MAX      64
+
+namespace {
+    bool sameColor(const uint8_t *a, const uint8_t *b) {
+        return a[0] == b[0] && a[1] == b[1] && a[2] == b[2];
+    }
+
+    // Checks if a pixel is the same as in the reference frame, which is black if there is no reference
+    bool unchanged(const uint8_t *frame, const uint8_t *reference, int i) {
+        if (reference) return sameColor(frame + i * 3, reference + i * 3);
+        return frame[i * 3] == 0 && frame[i * 3 + 1] == 0 && frame[i * 3 + 2] == 0;
+    }
+
+    // Largest payload of any frame packet
+    uint32_t maxPayloadSize(uint32_t numPixels) {
+        uint32_t operations = numPixels * 3 + (numPixels + OP_RUN_MAX - 1) / OP_RUN_MAX;
+        uint32_t palette = 1 + MATRIX_STREAM_MAX_PALETTE_SIZE * 3 + numPixels;
+        return operations > palette ? operations : palette;
+    }
+}
+
+// CRC-16/CCITT-FALSE (polynomial 0x1021, initial value 0xFFFF), calculated a nibble at a time
+uint16_t matrixStreamCrc(uint16_t crc, uint8_t data) {
+    static const uint16_t table[16] = {
+        0x0000, 0x1021, 0x2042, 0x3063, 0x4084, 0x50A5, 0x60C6, 0x70E7,
+        0x8108, 0x9129, 0xA14A, 0xB16B, 0xC18C, 0xD1AD, 0xE1CE, 0xF1EF
+    };
+
+    crc = (crc << 4) ^ table[(crc >> 12) ^ (data >> 4)];
+    crc = (crc << 4) ^ table[(crc >> 12) ^ (data & 0x0F)];
+    return crc;
+}
+
+
+/*****************
+ *    ENCODER    *
+ *****************/
+
+MatrixStreamEncoder::MatrixStreamEncoder(uint16_t width, uint16_t height) {
+    m_width = width;
+    m_height = height;
+
+    m_previous = (uint8_t *) malloc(width * height * 3);
+    m_previous_valid = false;
+    m_frames_since_key_frame = 0;
+
+    m_palette_size = 0;
+    m_write_length = 0;
+    m_crc = 0xFFFF;
+    m_sequence = 0;
+    m_last_type = 0;
+
+    writeCallback = NULL;
+}
+
+MatrixStreamEncoder::~MatrixStreamEncoder() {
+    free(m_previous);
+}
+
+void MatrixStreamEncoder::setWriteCallback(stream_write_callback f) {
+    writeCallback = f;
+}
+
+void MatrixStreamEncoder::reset(void) {
+    m_previous_valid = false;
+}
+
+uint8_t MatrixStreamEncoder::getLastType(void) {
+    return m_last_type;
+}
+
+void MatrixStreamEncoder::writeInfo(void) {
+    beginPacket(MATRIX_STREAM_TYPE_INFO, 4);
+    put(m_width & 0xFF);
+    put(m_width >> 8);
+    put(m_height & 0xFF);
+    put(m_height >> 8);
+    endPacket();
+}
+
+int MatrixStreamEncoder::writeFrame(const uint8_t *frame) {
+    const int numPixels = m_width * m_height;
+    int written = 0;
+
+    // Send a key frame if the receiver could be out of sync
+    bool keyFrame = !m_previous || !m_previous_valid || m_frames_since_key_frame >= MATRIX_STREAM_KEY_FRAME_INTERVAL;
+    if (keyFrame) {
+        writeInfo();
+        written += MATRIX_STREAM_HEADER_SIZE + 4 + MATRIX_STREAM_CRC_SIZE;
+    }
+
+    // Find the smallest packet type
+    uint8_t type = MATRIX_STREAM_TYPE_RAW;
+    int size = numPixels * 3;
+
+    int paletteSize = buildPalette(frame);
+    if (paletteSize > 0 && 1 + paletteSize * 3 + numPixels < size) {
+        type = MATRIX_STREAM_TYPE_PALETTE;
+        size = 1 + paletteSize * 3 + numPixels;
+    }
+
+    int rleSize = encodeOperations(frame, NULL, false);
+    if (rleSize < size) {
+        type = MATRIX_STREAM_TYPE_RLE;
+        size = rleSize;
+    }
+
+    if (!keyFrame) {
+        int deltaSize = encodeOperations(frame, m_previous, false);
+        if (deltaSize < size) {
+            type = MATRIX_STREAM_TYPE_DELTA;
+            size = deltaSize;
+        }
+    }
+
+    if (size > 0xFFFF) return written;
+
+    // Send the frame
+    beginPacket(type, size);
+    if (type == MATRIX_STREAM_TYPE_RAW) {
+        put(frame, numPixels * 3);
+    } else if (type == MATRIX_STREAM_TYPE_PALETTE) {
+        put(paletteSize - 1);
+        put(m_palette, paletteSize * 3);
+        for (int i = 0; i < numPixels; i++) put(findPaletteColor(frame + i * 3));
+    } else if (type == MATRIX_STREAM_TYPE_RLE) {
+        encodeOperations(frame, NULL, true);
+    } else {
+        encodeOperations(frame, m_previous, true);
+    }
+    endPacket();
+
+    written += MATRIX_STREAM_HEADER_SIZE + size + MATRIX_STREAM_CRC_SIZE;
+    m_last_type = type;
+
+    #ifdef MATRIX_STREAM_DEBUG
+        printf("MatrixStream: type %d, %d bytes\n", type, written);
+    #endif
+
+    // Store the frame as the reference for the next delta frame
+    if (m_previous) {
+        memcpy(m_previous, frame, numPixels * 3);
+        m_previous_valid = true;
+    }
+    m_frames_since_key_frame = keyFrame ? 0 : m_frames_since_key_frame + 1;
+
+    return written;
+}
+
+int MatrixStreamEncoder::buildPalette(const uint8_t *frame) {
+    // Collects all colors of the frame. Returns the number of colors or -1 if there are too many
+    memset(m_palette_hash, 0, sizeof(m_palette_hash));
+    m_palette_size = 0;
+
+    for (int i = 0; i < m_width * m_height; i++) {
+        const uint8_t *color = frame + i * 3;
+        if (findPaletteColor(color) >= 0) continue;
+        if (m_palette_size >= MATRIX_STREAM_MAX_PALETTE_SIZE) return -1;
+
+        // Insert the new color into the hash table (findPaletteColor stops at an empty slot, so there is one)
+        int hash = (color[0] * 7 + color[1] * 31 + color[2] * 131) & 511;
+        while (m_palette_hash[hash]) hash = (hash + 1) & 511;
+        m_palette_hash[hash] = m_palette_size + 1;
+
+        memcpy(&m_palette[m_palette_size * 3], color, 3);
+        m_palette_size++;
+    }
+
+    return m_palette_size;
+}
+
+int MatrixStreamEncoder::findPaletteColor(const uint8_t *color) {
+    int hash = (color[0] * 7 + color[1] * 31 + color[2] * 131) & 511;
+    while (m_palette_hash[hash]) {
+        int index = m_palette_hash[hash] - 1;
+        if (sameColor(&m_palette[index * 3], color)) return index;
+        hash = (hash + 1) & 511;
+    }
+    return -1;
+}
+
+int MatrixStreamEncoder::encodeOperations(const uint8_t *frame, const uint8_t *reference, bool write) {
+    // Encodes the frame as skip / repeat / literal operations. Returns the size of the encoded data
+    const int numPixels = m_width * m_height;
+    int size = 0;
+    int i = 0;
+
+    while (i < numPixels) {
+        // Skip all pixels that didn't change
+        int run = 0;
+        while (i + run < numPixels && run < OP_SKIP_MAX && unchanged(frame, reference, i + run)) run++;
+        if (run > 0) {
+            if (write) put(OP_SKIP + run - 1);
+            size += 1;
+            i += run;
+            continue;
+        }
+
+        // Repeat the same color
+        run = 1;
+        while (i + run < numPixels && run < OP_RUN_MAX && sameColor(frame + i * 3, frame + (i + run) * 3)) run++;
+        if (run > 1) {
+            if (write) {
+                put(OP_REPEAT + run - 1);
+                put(frame + i * 3, 3);
+            }
+            size += 4;
+            i += run;
+            continue;
+        }
+
+        // Literal values until an unchanged pixel or a repeated color comes up
+        while (i + run < numPixels && run < OP_RUN_MAX && !unchanged(frame, reference, i + run)
+            && !(i + run + 1 < numPixels && sameColor(frame + (i + run) * 3, frame + (i + run + 1) * 3))) run++;
+        if (write) {
+            put(OP_LITERAL + run - 1);
+            put(frame + i * 3, run * 3);
+        }
+        size += 1 + run * 3;
+        i += run;
+    }
+
+    return size;
+}
+
+void MatrixStreamEncoder::beginPacket(uint8_t type, uint16_t length) {
+    // The sync bytes are not part of the crc
+    put(MATRIX_STREAM_SYNC_0);
+    put(MATRIX_STREAM_SYNC_1);
+
+    m_crc = 0xFFFF;
+    put(type);
+    put(m_sequence++);
+    put(length & 0xFF);
+    put(length >> 8);
+}
+
+void MatrixStreamEncoder::endPacket(void) {
+    uint16_t crc = m_crc;
+    put(crc & 0xFF);
+    put(crc >> 8);
+    flush();
+}
+
+void MatrixStreamEncoder::put(uint8_t data) {
+    m_crc = matrixStreamCrc(m_crc, data);
+    m_write_buffer[m_write_length++] = data;
+    if (m_write_length == sizeof(m_write_buffer)) flush();
+}
+
+void MatrixStreamEncoder::put(const uint8_t *data, int length) {
+    for (int i = 0; i < length; i++) put(data[i]);
+}
+
+void MatrixStreamEncoder::flush(void) {
+    if (m_write_length > 0 && writeCallback) writeCallback(m_write_buffer, m_write_length);
+    m_write_length = 0;
+}
+
+
+/*****************
+ *    DECODER    *
+ *****************/
+
+MatrixStreamDecoder::MatrixStreamDecoder() {
+    m_width = 0;
+    m_height = 0;
+
+    m_frame = NULL;
+    m_frame_valid = false;
+
+    m_state = STATE_SYNC_0;
+    m_type = 0;
+    m_sequence = 0;
+    m_last_sequence = 0;
+    m_length = 0;
+    m_position = 0;
+    m_crc = 0xFFFF;
+    m_received_crc = 0;
+    m_payload = NULL;
+    m_payload_capacity = 0;
+
+    m_frame_count = 0;
+    m_error_count = 0;
+}
+
+MatrixStreamDecoder::~MatrixStreamDecoder() {
+    free(m_frame);
+    free(m_payload);
+}
+
+const uint8_t *MatrixStreamDecoder::getFrame(void) {
+    return m_frame;
+}
+
+uint16_t MatrixStreamDecoder::getWidth(void) {
+    return m_width;
+}
+
+uint16_t MatrixStreamDecoder::getHeight(void) {
+    return m_height;
+}
+
+uint8_t MatrixStreamDecoder::getLastType(void) {
+    return m_type;
+}
+
+unsigned long MatrixStreamDecoder::getFrameCount(void) {
+    return m_frame_count;
+}
+
+unsigned long MatrixStreamDecoder::getErrorCount(void) {
+    return m_error_count;
+}
+
+bool MatrixStreamDecoder::push(uint8_t data) {
+    switch (m_state) {
+        case STATE_SYNC_0:
+            if (data == MATRIX_STREAM_SYNC_0) m_state = STATE_SYNC_1;
+            return false;
+
+        case STATE_SYNC_1:
+            if (data == MATRIX_STREAM_SYNC_1) m_state = STATE_TYPE;
+            else if (data != MATRIX_STREAM_SYNC_0) m_state = STATE_SYNC_0;
+            return false;
+
+        case STATE_TYPE:
+            // Unknown types are most likely a false sync
+            if (data < MATRIX_STREAM_TYPE_INFO || data > MATRIX_STREAM_TYPE_DELTA) {
+                m_state = STATE_SYNC_0;
+                return false;
+            }
+            m_type = data;
+            m_crc = matrixStreamCrc(0xFFFF, data);
+            m_state = STATE_SEQUENCE;
+            return false;
+
+        case STATE_SEQUENCE:
+            m_sequence = data;
+            m_crc = matrixStreamCrc(m_crc, data);
+            m_state = STATE_LENGTH_0;
+            return false;
+
+        case STATE_LENGTH_0:
+            m_length = data;
+            m_crc = matrixStreamCrc(m_crc, data);
+            m_state = STATE_LENGTH_1;
+            return false;
+
+        case STATE_LENGTH_1:
+            m_length |= data << 8;
+            m_crc = matrixStreamCrc(m_crc, data);
+            m_position = 0;
+
+            // Frames can only be received after the size is known and must not be larger than the largest frame
+            if (m_type == MATRIX_STREAM_TYPE_INFO ? m_length != 4
+                : (m_width == 0 || m_length > maxPayloadSize(m_width * m_height))) {
+                m_state = STATE_SYNC_0;
+                return false;
+            }
+
+            if (m_length > m_payload_capacity) {
+                uint8_t *payload = (uint8_t *) realloc(m_payload, m_length);
+                if (!payload) {
+                    m_state = STATE_SYNC_0;
+                    return false;
+                }
+                m_payload = payload;
+                m_payload_capacity = m_length;
+            }
+
+            m_state = m_length > 0 ? STATE_PAYLOAD : STATE_CRC_0;
+            return false;
+
+        case STATE_PAYLOAD:
+            m_payload[m_position++] = data;
+            m_crc = matrixStreamCrc(m_crc, data);
+            if (m_position == m_length) m_state = STATE_CRC_0;
+            return false;
+
+        case STATE_CRC_0:
+            m_received_crc = data;
+            m_state = STATE_CRC_1;
+            return false;
+
+        case STATE_CRC_1:
+            m_received_crc |= data << 8;
+            m_state = STATE_SYNC_0;
+
+            if (m_received_crc != m_crc) {
+                // The next delta frame can't be applied, wait for a key frame
+                m_error_count++;
+                m_frame_valid = false;
+                return false;
+            }
+
+            // Delta frames can't be applied if a packet was lost in between
+            if (m_sequence != (uint8_t) (m_last_sequence + 1)) m_frame_valid = false;
+            m_last_sequence = m_sequence;
+
+            if (!handlePacket()) {
+                m_error_count++;
+                m_frame_valid = false;
+                return false;
+            }
+            return m_type != MATRIX_STREAM_TYPE_INFO;
+    }
+
+    m_state = STATE_SYNC_0;
+    return false;
+}
+
+bool MatrixStreamDecoder::setSize(uint16_t width, uint16_t height) {
+    if (width == m_width && height == m_height && m_frame) return true;
+
+    free(m_frame);
+    m_frame = (uint8_t *) calloc(width * height, 3);
+    m_frame_valid = false;
+    if (!m_frame) {
+        m_width = 0;
+        m_height = 0;
+        return false;
+    }
+
+    m_width = width;
+    m_height = height;
+    return true;
+}
+
+bool MatrixStreamDecoder::handlePacket(void) {
+    const int numPixels = m_width * m_height;
+
+    switch (m_type) {
+        case MATRIX_STREAM_TYPE_INFO:
+            return setSize(m_payload[0] | m_payload[1] << 8, m_payload[2] | m_payload[3] << 8);
+
+        case MATRIX_STREAM_TYPE_RAW:
+            if (m_length != numPixels * 3) return false;
+            memcpy(m_frame, m_payload, numPixels * 3);
+            break;
+
+        case MATRIX_STREAM_TYPE_PALETTE: {
+            const int paletteSize = m_payload[0] + 1;
+            const uint8_t *palette = m_payload + 1;
+            const uint8_t *indices = palette + paletteSize * 3;
+            if (m_length != 1 + paletteSize * 3 + numPixels) return false;
+
+            for (int i = 0; i < numPixels; i++) {
+                if (indices[i] >= paletteSize) return false;
+                memcpy(m_frame + i * 3, palette + indices[i] * 3, 3);
+            }
+            break;
+        }
+
+        case MATRIX_STREAM_TYPE_RLE:
+            memset(m_frame, 0, numPixels * 3);
+            if (!applyOperations()) return false;
+            break;
+
+        case MATRIX_STREAM_TYPE_DELTA:
+            if (!m_frame_valid || !applyOperations()) return false;
+            break;
+
+        default:
+            return false;
+    }
+
+    m_frame_valid = true;
+    m_frame_count++;
+    return true;
+}
+
+bool MatrixStreamDecoder::applyOperations(void) {
+    const int numPixels = m_width * m_height;
+    int i = 0;
+    int position = 0;
+
+    while (position < m_length) {
+        const uint8_t op = m_payload[position++];
+
+        if (op < OP_REPEAT) {
+            i += op - OP_SKIP + 1;
+        } else if (op < OP_LITERAL) {
+            const int run = op - OP_REPEAT + 1;
+            if (position + 3 > m_length || i + run > numPixels) return false;
+            for (int j = 0; j < run; j++) memcpy(m_frame + (i + j) * 3, m_payload + position, 3);
+            position += 3;
+            i += run;
+        } else {
+            const int run = op - OP_LITERAL + 1;
+            if (position + run * 3 > m_length || i + run > numPixels) return false;
+            memcpy(m_frame + i * 3, m_payload + position, run * 3);
+            position += run * 3;
+            i += run;
+        }
+    }
+
+    // The operations must cover the whole frame
+    return i == numPixels;
+}
\ No newline at end of file
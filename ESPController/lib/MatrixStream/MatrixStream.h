@@ -0,0 +1,149 @@
+#ifndef MATRIX_STREAM_H
+#define MATRIX_STREAM_H
+
+#include <stdint.h>
+
+/*
+ * Binary protocol to stream the led data over the serial port (used by the VirtualMatrix). Every packet is framed as
+ *
+ *     0xA5 0x5A | type | sequence | length (16 bit, little endian) | payload | crc (16 bit, little endian)
+ *
+ * The crc is a CRC-16/CCITT-FALSE over type, sequence, length and payload. The sequence number is incremented with
+ * every packet, so a receiver can tell if a packet was lost. The sync bytes never appear in ascii text, so debug
+ * messages can be sent in between packets.
+ *
+ * Packet types:
+ *   INFO       width (16 bit), height (16 bit)
+ *   RAW        width * height RGB values
+ *   PALETTE    number of colors - 1, the RGB palette and a palette index per pixel
+ *   RLE        run length encoded operations (see below) starting from a black frame
+ *   DELTA      run length encoded operations starting from the previous frame
+ *
+ * The operations of the RLE and DELTA packets are a single byte op, followed by data:
+ *   0x00 - 0x7F    skip (op + 1) pixels
+ *   0x80 - 0xBF    one RGB value, repeated (op - 0x80 + 1) times
+ *   0xC0 - 0xFF    (op - 0xC0 + 1) RGB values
+ *
+ * The encoder sends the smallest packet type for each frame. Every MATRIX_STREAM_KEY_FRAME_INTERVAL frames, an INFO
+ * packet and a key frame (RAW, PALETTE or RLE) is sent, so a receiver can (re)synchronize. The decoder only applies
+ * DELTA packets if it received the previous packet.
+ */
+
+//#define MATRIX_STREAM_DEBUG
+
+#define MATRIX_STREAM_SYNC_0                0xA5
+#define MATRIX_STREAM_SYNC_1                0x5A
+
+#define MATRIX_STREAM_TYPE_INFO             0x01
+#define MATRIX_STREAM_TYPE_RAW              0x02
+#define MATRIX_STREAM_TYPE_PALETTE          0x03
+#define MATRIX_STREAM_TYPE_RLE              0x04
+#define MATRIX_STREAM_TYPE_DELTA            0x05
+
+#define MATRIX_STREAM_HEADER_SIZE           6
+#define MATRIX_STREAM_CRC_SIZE              2
+
+#define MATRIX_STREAM_KEY_FRAME_INTERVAL    50
+#define MATRIX_STREAM_MAX_PALETTE_SIZE      255
+
+typedef void (*stream_write_callback)(const uint8_t *buffer, int numberOfBytes);
+
+uint16_t matrixStreamCrc(uint16_t crc, uint8_t data);
+
+class MatrixStreamEncoder {
+    private:
+        uint16_t m_width;
+        uint16_t m_height;
+        uint16_t m_frames_since_key_frame;
+
+        // Last frame that was sent. Used as the reference for delta frames
+        uint8_t *m_previous;
+        bool m_previous_valid;
+
+        // Palette of the current frame and a hash table of palette index + 1 (0 is empty)
+        uint8_t m_palette[MATRIX_STREAM_MAX_PALETTE_SIZE * 3];
+        int m_palette_size;
+        uint8_t m_palette_hash[512];
+
+        // Output buffer to avoid a callback per byte
+        uint8_t m_write_buffer[64];
+        int m_write_length;
+        uint16_t m_crc;
+        uint8_t m_sequence;
+
+        uint8_t m_last_type;
+
+        stream_write_callback writeCallback;
+
+        int buildPalette(const uint8_t *frame);
+        int findPaletteColor(const uint8_t *color);
+        int encodeOperations(const uint8_t *frame, const uint8_t *reference, bool write);
+
+        void beginPacket(uint8_t type, uint16_t length);
+        void endPacket(void);
+        void put(uint8_t data);
+        void put(const uint8_t *data, int length);
+        void flush(void);
+
+    public:
+        MatrixStreamEncoder(uint16_t width, uint16_t height);
+        ~MatrixStreamEncoder();
+
+        void setWriteCallback(stream_write_callback f);
+
+        // Sends an INFO packet
+        void writeInfo(void);
+
+        // Sends a frame of width * height RGB values. Returns the number of bytes sent
+        int writeFrame(const uint8_t *frame);
+
+        // Forces the next frame to be a key frame
+        void reset(void);
+
+        uint8_t getLastType(void);
+};
+
+class MatrixStreamDecoder {
+    private:
+        uint16_t m_width;
+        uint16_t m_height;
+
+        // Current frame and whether it is valid (a key frame was received after the last error)
+        uint8_t *m_frame;
+        bool m_frame_valid;
+
+        // Packet parser state
+        uint8_t m_state;
+        uint8_t m_type;
+        uint8_t m_sequence;
+        uint8_t m_last_sequence;
+        uint16_t m_length;
+        uint16_t m_position;
+        uint16_t m_crc;
+        uint16_t m_received_crc;
+        uint8_t *m_payload;
+        uint16_t m_payload_capacity;
+
+        unsigned long m_frame_count;
+        unsigned long m_error_count;
+
+        bool setSize(uint16_t width, uint16_t height);
+        bool handlePacket(void);
+        bool applyOperations(void);
+
+    public:
+        MatrixStreamDecoder();
+        ~MatrixStreamDecoder();
+
+        // Parses the next byte. Returns true if a frame was completed
+        bool push(uint8_t data);
+
+        const uint8_t *getFrame(void);
+        uint16_t getWidth(void);
+        uint16_t getHeight(void);
+        uint8_t getLastType(void);
+        unsigned long getFrameCount(void);
+        unsigned long getErrorCount(void);
+};
+
+#endif
\ No newline at end of file
@@ -0,0 +1,284 @@
+#include <stdio.h>
+
+#include "MatrixStream.h"
+#include "GifTranscoder.h"
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * Streams all frames of the animations in data/animations through the encoder and decoder and checks that the decoder
+ * outputs exactly the same frames. Debug text is sent in between the packets and some packets are corrupted, which
+ * the decoder must detect and recover from at the next key frame. Also reports the bytes per frame of the text
+ * protocol (LEDDATA) and the binary one.
+ *
+ * With --write <gif file> <stream file> <frames file>, the stream of an animation (with debug text, a frame of the
+ * text protocol and corrupted packets) is written to a file instead, with the frames the decoder outputs as the
+ * reference for the decoder of the virtual matrix (VirtualMatrix/test).
+ */
+
+#define MAX_FILE_SIZE   (1024 * 1024)
+#define MAX_FRAMES      256
+#define LOOPS           4
+
+// Virtual input (gif) file
+unsigned char gifFile[MAX_FILE_SIZE];
+int gifFileSize = 0;
+int gifFileIndex = 0;
+
+// Frames decoded from the gif file
+uint8_t *gifFrames[MAX_FRAMES];
+int gifFrameCount = 0;
+int gifFrameSize = 0;
+
+// Serial output of the encoder
+unsigned char stream[MAX_FILE_SIZE];
+int streamSize = 0;
+
+bool gifFileSeek(unsigned long position) {
+    gifFileIndex = position;
+    return true;
+}
+
+int gifFileReadBlock(void *buffer, int numberOfBytes) {
+    if (numberOfBytes > gifFileSize - gifFileIndex) numberOfBytes = gifFileSize - gifFileIndex;
+    memcpy(buffer, &gifFile[gifFileIndex], numberOfBytes);
+    gifFileIndex += numberOfBytes;
+    return numberOfBytes;
+}
+
+void gifFrame(const uint8_t *framebuffer, uint16_t delay) {
+    if (gifFrameCount >= MAX_FRAMES) return;
+    gifFrames[gifFrameCount] = (uint8_t *) malloc(gifFrameSize);
+    memcpy(gifFrames[gifFrameCount], framebuffer, gifFrameSize);
+    gifFrameCount++;
+}
+
+void streamWrite(const uint8_t *buffer, int numberOfBytes) {
+    if (numberOfBytes > MAX_FILE_SIZE - streamSize) return;
+    memcpy(&stream[streamSize], buffer, numberOfBytes);
+    streamSize += numberOfBytes;
+}
+
+void streamPrint(const char *text) {
+    streamWrite((const uint8_t *) text, strlen(text));
+}
+
+// Encodes the frames, decodes them again and compares. Returns the number of wrong frames
+int roundTrip(const char *name, uint8_t **frames, int frameCount, int width, int height, bool corrupt) {
+    const int frameSize = width * height * 3;
+    MatrixStreamEncoder encoder(width, height);
+    MatrixStreamDecoder decoder;
+    encoder.setWriteCallback(streamWrite);
+
+    int errors = 0;
+    int sentBytes = 0;
+    int typeCounts[6] = { 0 };
+    int lostFrames = 0;
+    bool corrupted = false;
+
+    for (int i = 0; i < frameCount * LOOPS; i++) {
+        const uint8_t *frame = frames[i % frameCount];
+
+        // Encode the frame with some debug text in front
+        streamSize = 0;
+        if (i % 7 == 0) streamPrint("Debug message\n");
+        int start = streamSize;
+        sentBytes += encoder.writeFrame(frame);
+        typeCounts[encoder.getLastType()]++;
+
+        // Flip a bit in every 10th frame
+        if (corrupt && i % 10 == 5) {
+            stream[start + (streamSize - start) / 2] ^= 0x10;
+            corrupted = true;
+        }
+
+        bool decoded = false;
+        for (int j = 0; j < streamSize; j++) decoded |= decoder.push(stream[j]);
+
+        // Corrupted frames and the delta frames following them may be lost, but the decoder must never output a
+        // wrong frame
+        if (encoder.getLastType() != MATRIX_STREAM_TYPE_DELTA && !(corrupt && i % 10 == 5)) corrupted = false;
+        if (!decoded) {
+            if (!corrupted) {
+                printf("%s: frame %d was not decoded\n", name, i);
+                errors++;
+            }
+            lostFrames++;
+        } else if (memcmp(decoder.getFrame(), frame, frameSize) != 0) {
+            printf("%s: frame %d differs\n", name, i);
+            errors++;
+        }
+    }
+
+    if (!corrupt) {
+        int textBytes = 7 + width * height * 6 + 1;
+        printf("%s: %dx%d, %d frames: text %d, raw %d, encoded %.1f bytes/frame (%.1f%% of text) - ",
+            name, width, height, frameCount * LOOPS, textBytes, MATRIX_STREAM_HEADER_SIZE + frameSize + MATRIX_STREAM_CRC_SIZE,
+            sentBytes / (double) (frameCount * LOOPS), sentBytes * 100.0 / textBytes / (frameCount * LOOPS));
+        printf("raw %d, palette %d, rle %d, delta %d: %s\n",
+            typeCounts[MATRIX_STREAM_TYPE_RAW], typeCounts[MATRIX_STREAM_TYPE_PALETTE],
+            typeCounts[MATRIX_STREAM_TYPE_RLE], typeCounts[MATRIX_STREAM_TYPE_DELTA], errors ? "FAILED" : "OK");
+    } else {
+        printf("%s: corrupted stream, %lu crc errors, %d frames lost: %s\n",
+            name, decoder.getErrorCount(), lostFrames, errors ? "FAILED" : "OK");
+    }
+
+    return errors;
+}
+
+// Decodes all frames of the gif file into gifFrames
+bool loadFile(const char *fileName, int *width, int *height) {
+    // Load the gif file
+    FILE *f = fopen(fileName, "rb");
+    if (!f) {
+        printf("%s: could not open file\n", fileName);
+        return false;
+    }
+    gifFileSize = fread(gifFile, 1, MAX_FILE_SIZE, f);
+    fclose(f);
+
+    GifTranscoder transcoder = GifTranscoder(0, 0);
+    transcoder.setFileSeekCallback(gifFileSeek);
+    transcoder.setFileReadBlockCallback(gifFileReadBlock);
+
+    // Decode all gif frames. The size is known after the header has been read, so decode twice.
+    gifFrameCount = 0;
+    int result = transcoder.decode();
+    gifFrameSize = transcoder.getWidth() * transcoder.getHeight() * 3;
+    transcoder.setFrameCallback(gifFrame);
+    if (result == GIF_TRANSCODER_OK) result = transcoder.decode();
+    if (result != GIF_TRANSCODER_OK) {
+        printf("%s: decoding failed with error %d\n", fileName, result);
+        return false;
+    }
+
+    *width = transcoder.getWidth();
+    *height = transcoder.getHeight();
+    return true;
+}
+
+bool testFile(const char *fileName) {
+    int width, height;
+    if (!loadFile(fileName, &width, &height)) return false;
+
+    int errors = roundTrip(fileName, gifFrames, gifFrameCount, width, height, false);
+    errors += roundTrip(fileName, gifFrames, gifFrameCount, width, height, true);
+
+    for (int i = 0; i < gifFrameCount; i++) free(gifFrames[i]);
+    return errors == 0;
+}
+
+// Writes the stream of the animation and the frames the decoder outputs for it. The frames file starts with the width,
+// the height (16 bit each), the number of frames, of corrupted packets and of text lines (32 bit each)
+bool writeStream(const char *fileName, const char *streamFileName, const char *framesFileName) {
+    int width, height;
+    if (!loadFile(fileName, &width, &height)) return false;
+    const int frameSize = width * height * 3;
+
+    FILE *streamFile = fopen(streamFileName, "wb");
+    FILE *framesFile = fopen(framesFileName, "wb");
+    if (!streamFile || !framesFile) {
+        printf("Could not create the output files\n");
+        return false;
+    }
+
+    MatrixStreamEncoder encoder(width, height);
+    MatrixStreamDecoder decoder;
+    encoder.setWriteCallback(streamWrite);
+
+    uint32_t header[3] = { 0, 0, 0 };
+    uint16_t size[2] = { (uint16_t) width, (uint16_t) height };
+    fwrite(size, sizeof(size), 1, framesFile);
+    fwrite(header, sizeof(header), 1, framesFile);
+
+    for (int i = 0; i < gifFrameCount * LOOPS; i++) {
+        const uint8_t *frame = gifFrames[i % gifFrameCount];
+
+        // Debug text, a frame sent with the text protocol and a corrupted packet in every 50 frames
+        streamSize = 0;
+        if (i % 7 == 0) {
+            streamPrint("Debug message\n");
+            header[2]++;
+        }
+        if (i == 3) {
+            streamPrint("LEDDATA");
+            for (int j = 0; j < frameSize; j++) {
+                char hex[3];
+                snprintf(hex, sizeof(hex), "%02X", frame[j]);
+                streamPrint(hex);
+            }
+            streamPrint("\n");
+            fwrite(frame, frameSize, 1, framesFile);
+            header[0]++;
+            header[2]++;
+        }
+        int start = streamSize;
+        encoder.writeFrame(frame);
+        if (i % 50 == 25) {
+            stream[start + (streamSize - start) / 2] ^= 0x10;
+            header[1]++;
+        }
+
+        bool decoded = false;
+        for (int j = 0; j < streamSize; j++) decoded |= decoder.push(stream[j]);
+        if (decoded) {
+            fwrite(decoder.getFrame(), frameSize, 1, framesFile);
+            header[0]++;
+        }
+        fwrite(stream, streamSize, 1, streamFile);
+    }
+
+    fseek(framesFile, sizeof(size), SEEK_SET);
+    fwrite(header, sizeof(header), 1, framesFile);
+    fclose(streamFile);
+    fclose(framesFile);
+
+    printf("%s: %d frames, %u decoded, %u corrupted written to %s\n",
+        fileName, gifFrameCount * LOOPS, header[0], header[1], streamFileName);
+    for (int i = 0; i < gifFrameCount; i++) free(gifFrames[i]);
+    return true;
+}
+
+bool testNoise(int width, int height) {
+    // Random frames, which can only be sent raw
+    uint8_t *frames[8];
+    for (int i = 0; i < 8; i++) {
+        frames[i] = (uint8_t *) malloc(width * height * 3);
+        for (int j = 0; j < width * height * 3; j++) frames[i][j] = rand();
+    }
+
+    int errors = roundTrip("noise", frames, 8, width, height, false);
+
+    for (int i = 0; i < 8; i++) free(frames[i]);
+    return errors == 0;
+}
+
+int main(int argc, char **argv) {
+    if (argc == 5 && strcmp(argv[1], "--write") == 0) return writeStream(argv[2], argv[3], argv[4]) ? 0 : 1;
+
+    printf("Matrix Stream Library Test\n");
+
+    // Check value of CRC-16/CCITT-FALSE
+    uint16_t crc = 0xFFFF;
+    for (const char *c = "123456789"; *c; c++) crc = matrixStreamCrc(crc, *c);
+    bool success = crc == 0x29B1;
+    printf("crc: 0x%04X: %s\n", crc, success ? "OK" : "FAILED");
+
+    const char *defaultFiles[] = {
+        "../../data/animations/0.gif",
+        "../../data/animations/1.gif",
+        "../../data/animations/2.gif",
+        "../../data/animations/3.gif"
+    };
+
+    if (argc > 1) {
+        for (int i = 1; i < argc; i++) success &= testFile(argv[i]);
+    } else {
+        for (int i = 0; i < 4; i++) success &= testFile(defaultFiles[i]);
+    }
+
+    success &= testNoise(32, 8);
+    success &= testNoise(64, 64);
+
+    return success ? 0 : 1;
+}
\ No newline at end of file
@@ -0,0 +1,232 @@
+#include "Arduino.h"
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <thread>
+
+MockSerial Serial;
+MockESP ESP;
+
+namespace {
+    const std::chrono::steady_clock::time_point startTime = std::chrono::steady_clock::now();
+
+    // Timer1 state. The mutex is held while the interrupt runs and between noInterrupts() and interrupts()
+    std::mutex interruptMutex;
+    std::thread timerThread;
+    std::atomic<bool> timerRunning(false);
+    std::atomic<timercallback> timerCallback(nullptr);
+    uint8_t timerDivider = TIM_DIV1;
+    uint8_t timerReload = TIM_SINGLE;
+    uint32_t timerTicks = 0;
+
+    void runTimer(void) {
+        // Ticks per second of the selected prescaler
+        const double tickRates[] = { 80000000.0, 5000000.0, 5000000.0, 312500.0 };
+        const std::chrono::duration<double> period(timerTicks / tickRates[timerDivider]);
+
+        // Catches up on missed ticks, so the average rate is exact even if the thread is woken up late
+        std::chrono::steady_clock::time_point next = std::chrono::steady_clock::now();
+        while (timerRunning) {
+            next += std::chrono::duration_cast<std::chrono::steady_clock::duration>(period);
+            std::this_thread::sleep_until(next);
+            if (!timerRunning) break;
+
+            timercallback callback = timerCallback;
+            if (callback) {
+                std::lock_guard<std::mutex> lock(interruptMutex);
+                callback();
+            }
+
+            if (timerReload == TIM_SINGLE) break;
+        }
+    }
+
+    void stopTimer(void) {
+        timerRunning = false;
+        if (timerThread.joinable() && timerThread.get_id() != std::this_thread::get_id()) timerThread.join();
+    }
+
+    // Stops the timer thread on exit, destroying it while it is running would terminate the program
+    struct TimerShutdown {
+        ~TimerShutdown() { stopTimer(); }
+    } timerShutdown;
+}
+
+
+/*************************
+ *    TIME AND INPUTS    *
+ *************************/
+
+unsigned long millis(void) {
+    return micros() / 1000;
+}
+
+unsigned long micros(void) {
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - startTime).count();
+}
+
+void delay(unsigned long ms) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+}
+
+void delayMicroseconds(unsigned int us) {
+    // Busy wait like the real thing
+    unsigned long start = micros();
+    while (micros() - start < us);
+}
+
+void yield(void) {
+}
+
+int analogRead(uint8_t pin) {
+    // Simulated microphone: DC offset, two tones and some noise in the range of the 10 bit adc
+    double t = micros() / 1000000.0;
+    double value = 512
+        + 200 * sin(2 * M_PI * 440 * t)
+        + 100 * sin(2 * M_PI * 2500 * t)
+        + (rand() % 40) - 20;
+
+    if (value < 0) value = 0;
+    if (value > 1023) value = 1023;
+    return (int) value;
+}
+
+long random(long max) {
+    if (max <= 0) return 0;
+    return rand() % max;
+}
+
+long random(long min, long max) {
+    if (max <= min) return min;
+    return min + rand() % (max - min);
+}
+
+
+/**************************
+ *    TIMER INTERRUPTS    *
+ **************************/
+
+void timer1_attachInterrupt(timercallback userFunc) {
+    timerCallback = userFunc;
+}
+
+void timer1_detachInterrupt(void) {
+    timerCallback = nullptr;
+}
+
+void timer1_enable(uint8_t divider, uint8_t int_type, uint8_t reload) {
+    stopTimer();
+    timerDivider = divider;
+    timerReload = reload;
+}
+
+void timer1_disable(void) {
+    stopTimer();
+}
+
+void timer1_write(uint32_t ticks) {
+    // Writing the timer (re)starts it
+    stopTimer();
+    if (ticks == 0) return;
+
+    timerTicks = ticks;
+    timerRunning = true;
+    timerThread = std::thread(runTimer);
+}
+
+void interrupts(void) {
+    interruptMutex.unlock();
+}
+
+void noInterrupts(void) {
+    interruptMutex.lock();
+}
+
+
+/****************
+ *    STRING    *
+ ****************/
+
+String::String(float value, unsigned int decimals) : String((double) value, decimals) {
+}
+
+String::String(double value, unsigned int decimals) {
+    char buffer[64];
+    snprintf(buffer, sizeof(buffer), "%.*f", decimals, value);
+    m_string = buffer;
+}
+
+bool String::startsWith(const String &prefix) const {
+    return m_string.compare(0, prefix.m_string.length(), prefix.m_string) == 0;
+}
+
+bool String::endsWith(const String &suffix) const {
+    if (suffix.m_string.length() > m_string.length()) return false;
+    return m_string.compare(m_string.length() - suffix.m_string.length(), suffix.m_string.length(), suffix.m_string) == 0;
+}
+
+int String::indexOf(char c, unsigned int from) const {
+    size_t index = m_string.find(c, from);
+    return index == std::string::npos ? -1 : (int) index;
+}
+
+int String::indexOf(const String &str, unsigned int from) const {
+    size_t index = m_string.find(str.m_string, from);
+    return index == std::string::npos ? -1 : (int) index;
+}
+
+String String::substring(unsigned int from) const {
+    if (from >= m_string.length()) return String();
+    return String(m_string.substr(from));
+}
+
+String String::substring(unsigned int from, unsigned int to) const {
+    if (to > m_string.length()) to = m_string.length();
+    if (from >= to) return String();
+    return String(m_string.substr(from, to - from));
+}
+
+void String::replace(const String &find, const String &replace) {
+    if (find.m_string.empty()) return;
+
+    size_t index = 0;
+    while ((index = m_string.find(find.m_string, index)) != std::string::npos) {
+        m_string.replace(index, find.m_string.length(), replace.m_string);
+        index += replace.m_string.length();
+    }
+}
+
+
+/****************
+ *    SERIAL    *
+ ****************/
+
+size_t MockSerial::write(const uint8_t *buffer, size_t size) {
+    static bool echo = getenv("MOCK_SERIAL") != NULL;
+
+    bytesWritten += size;
+    if (echo) fwrite(buffer, 1, size, stderr);
+    return size;
+}
+
+size_t MockSerial::printf(const char *format, ...) {
+    char buffer[256];
+    va_list args;
+    va_start(args, format);
+    int size = vsnprintf(buffer, sizeof(buffer), format, args);
+    va_end(args);
+
+    if (size <= 0) return 0;
+    if (size >= (int) sizeof(buffer)) size = sizeof(buffer) - 1;
+    return write((const uint8_t *) buffer, size);
+}
+
+
+/*************
+ *    ESP    *
+ *************/
+
+void MockESP::restart(void) {
+    fprintf(stderr, "ESP.restart() called\n");
+    exit(1);
+}
\ No newline at end of file
@@ -0,0 +1,184 @@
+#ifndef MOCK_ARDUINO_H
+#define MOCK_ARDUINO_H
+
+/*
+ * Minimal Arduino core replacement for the native (host) build. Time is taken from the host clock, the microphone
+ * is simulated and everything written to the serial port is counted and discarded.
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <ctype.h>
+#include <math.h>
+#include <algorithm>
+#include <string>
+
+using std::min;
+using std::max;
+
+#define D8      15
+#define A0      17
+
+#define ICACHE_RAM_ATTR
+#define IRAM_ATTR
+
+typedef uint8_t byte;
+
+
+/*************************
+ *    TIME AND INPUTS    *
+ *************************/
+
+unsigned long millis(void);
+unsigned long micros(void);
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+void yield(void);
+
+int analogRead(uint8_t pin);
+
+long random(long max);
+long random(long min, long max);
+
+inline bool isDigit(char c) {
+    return isdigit((unsigned char) c);
+}
+
+
+/**************************
+ *    TIMER INTERRUPTS    *
+ **************************/
+
+// Timer1 of the ESP8266. The interrupt is called from a separate thread at the programmed rate, interrupts() and
+// noInterrupts() lock it out like on the real thing.
+#define TIM_DIV1        0   // 80 MHz
+#define TIM_DIV16       1   // 5 MHz
+#define TIM_DIV256      3   // 312.5 kHz
+
+#define TIM_EDGE        0
+#define TIM_LEVEL       1
+
+#define TIM_SINGLE      0
+#define TIM_LOOP        1
+
+typedef void (*timercallback)(void);
+
+void timer1_attachInterrupt(timercallback userFunc);
+void timer1_detachInterrupt(void);
+void timer1_enable(uint8_t divider, uint8_t int_type, uint8_t reload);
+void timer1_disable(void);
+void timer1_write(uint32_t ticks);
+
+void interrupts(void);
+void noInterrupts(void);
+
+
+/****************
+ *    STRING    *
+ ****************/
+
+class String {
+    private:
+        std::string m_string;
+
+    public:
+        String() {}
+        String(const char *str) : m_string(str ? str : "") {}
+        String(const std::string &str) : m_string(str) {}
+        String(char c) : m_string(1, c) {}
+        String(int value) : m_string(std::to_string(value)) {}
+        String(unsigned int value) : m_string(std::to_string(value)) {}
+        String(long value) : m_string(std::to_string(value)) {}
+        String(unsigned long value) : m_string(std::to_string(value)) {}
+        String(unsigned char value) : m_string(std::to_string(value)) {}
+        String(float value, unsigned int decimals = 2);
+        String(double value, unsigned int decimals = 2);
+
+        unsigned int length() const { return m_string.length(); }
+        const char *c_str() const { return m_string.c_str(); }
+        char operator[](unsigned int index) const { return index < m_string.length() ? m_string[index] : 0; }
+
+        bool equals(const String &str) const { return m_string == str.m_string; }
+        bool operator==(const String &str) const { return m_string == str.m_string; }
+        bool operator==(const char *str) const { return m_string == str; }
+        bool operator!=(const String &str) const { return m_string != str.m_string; }
+
+        bool startsWith(const String &prefix) const;
+        bool endsWith(const String &suffix) const;
+        int indexOf(char c, unsigned int from = 0) const;
+        int indexOf(const String &str, unsigned int from = 0) const;
+        String substring(unsigned int from) const;
+        String substring(unsigned int from, unsigned int to) const;
+        void replace(const String &find, const String &replace);
+        long toInt() const { return atol(m_string.c_str()); }
+        float toFloat() const { return atof(m_string.c_str()); }
+
+        String &operator+=(const String &str) { m_string += str.m_string; return *this; }
+        String &operator+=(const char *str) { m_string += str; return *this; }
+        String &operator+=(char c) { m_string += c; return *this; }
+        String &operator+=(int value) { m_string += std::to_string(value); return *this; }
+        String &operator+=(unsigned int value) { m_string += std::to_string(value); return *this; }
+        String &operator+=(long value) { m_string += std::to_string(value); return *this; }
+        String &operator+=(unsigned long value) { m_string += std::to_string(value); return *this; }
+};
+
+inline String operator+(const String &a, const String &b) { String s = a; s += b; return s; }
+inline String operator+(const String &a, const char *b) { String s = a; s += b; return s; }
+inline String operator+(const char *a, const String &b) { String s = a; s += b; return s; }
+inline String operator+(const String &a, char b) { String s = a; s += b; return s; }
+inline String operator+(const String &a, int b) { String s = a; s += b; return s; }
+inline String operator+(const String &a, unsigned int b) { String s = a; s += b; return s; }
+inline String operator+(const String &a, long b) { String s = a; s += b; return s; }
+inline String operator+(const String &a, unsigned long b) { String s = a; s += b; return s; }
+
+
+/****************
+ *    SERIAL    *
+ ****************/
+
+// Serial output is echoed to stderr if the MOCK_SERIAL environment variable is set
+class MockSerial {
+    public:
+        unsigned long bytesWritten;
+
+        MockSerial() : bytesWritten(0) {}
+
+        void begin(unsigned long baud) {}
+
+        size_t write(uint8_t c) { return write(&c, 1); }
+        size_t write(const uint8_t *buffer, size_t size);
+
+        size_t print(const String &str) { return write((const uint8_t *) str.c_str(), str.length()); }
+        size_t print(const char *str) { return print(String(str)); }
+        size_t print(int value) { return print(String(value)); }
+        size_t print(unsigned int value) { return print(String(value)); }
+        size_t print(long value) { return print(String(value)); }
+        size_t print(unsigned long value) { return print(String(value)); }
+        size_t print(double value) { return print(String(value)); }
+
+        template <typename T>
+        size_t println(const T &value) { return print(value) + print("\n"); }
+        size_t println(void) { return print("\n"); }
+
+        size_t printf(const char *format, ...);
+};
+
+extern MockSerial Serial;
+
+
+/*************
+ *    ESP    *
+ *************/
+
+class MockESP {
+    public:
+        void restart(void);
+        uint32_t getFreeHeap(void) { return 40000; }
+};
+
+extern MockESP ESP;
+
+#endif
\ No newline at end of file
@@ -0,0 +1,69 @@
+#include "ESP8266WebServer.h"
+#include "ESP8266WiFi.h"
+#include "ESP8266mDNS.h"
+
+MockWiFi WiFi;
+MockMDNS MDNS;
+
+void ESP8266WebServer::mockRequest(HTTPMethod method, const String &uri, const String &body) {
+    Request request;
+    request.method = method;
+    request.uri = uri;
+    request.body = body;
+    m_requests.push_back(request);
+}
+
+void ESP8266WebServer::mockUpload(const String &uri, const uint8_t *data, size_t size) {
+    Request request;
+    request.method = HTTP_POST;
+    request.uri = uri;
+    request.upload.assign(data, data + size);
+    m_requests.push_back(request);
+}
+
+void ESP8266WebServer::handleClient(void) {
+    if (m_requests.empty()) return;
+
+    Request request = m_requests.front();
+    m_requests.pop_front();
+
+    m_method = request.method;
+    m_uri = request.uri;
+    m_body = request.body;
+    requestsHandled++;
+
+    // Find a matching handler
+    for (size_t i = 0; i < m_handlers.size(); i++) {
+        Handler &handler = m_handlers[i];
+        if (!(handler.uri == m_uri) || (handler.method != HTTP_ANY && handler.method != m_method)) continue;
+
+        // Pass the upload in chunks, like the real server
+        if (handler.uploadFn && !request.upload.empty()) {
+            m_upload.filename = "upload.gif";
+            m_upload.totalSize = 0;
+            m_upload.currentSize = 0;
+            m_upload.status = UPLOAD_FILE_START;
+            handler.uploadFn();
+
+            for (size_t position = 0; position < request.upload.size(); position += HTTP_UPLOAD_BUFLEN) {
+                size_t size = request.upload.size() - position;
+                if (size > HTTP_UPLOAD_BUFLEN) size = HTTP_UPLOAD_BUFLEN;
+                memcpy(m_upload.buf, &request.upload[position], size);
+
+                m_upload.status = UPLOAD_FILE_WRITE;
+                m_upload.currentSize = size;
+                m_upload.totalSize += size;
+                handler.uploadFn();
+            }
+
+            m_upload.status = UPLOAD_FILE_END;
+            m_upload.currentSize = 0;
+            handler.uploadFn();
+        }
+
+        handler.fn();
+        return;
+    }
+
+    if (m_notFoundHandler) m_notFoundHandler();
+}
@@ -0,0 +1,138 @@
+#ifndef MOCK_ESP8266_WEBSERVER_H
+#define MOCK_ESP8266_WEBSERVER_H
+
+/*
+ * WebServer replacement for the native build. Requests and uploads are queued by the benchmark (or a test) and
+ * dispatched one at a time from handleClient(), just like the real server does. The last response is recorded.
+ */
+
+#include "Arduino.h"
+#include "FS.h"
+#include <deque>
+#include <functional>
+#include <vector>
+
+#define HTTP_UPLOAD_BUFLEN 2048
+
+enum HTTPMethod {
+    HTTP_ANY,
+    HTTP_GET,
+    HTTP_POST,
+    HTTP_PUT,
+    HTTP_PATCH,
+    HTTP_DELETE,
+    HTTP_OPTIONS
+};
+
+enum HTTPUploadStatus {
+    UPLOAD_FILE_START,
+    UPLOAD_FILE_WRITE,
+    UPLOAD_FILE_END,
+    UPLOAD_FILE_ABORTED
+};
+
+struct HTTPUpload {
+    HTTPUploadStatus status;
+    String filename;
+    String name;
+    String type;
+    size_t totalSize;
+    size_t currentSize;
+    uint8_t buf[HTTP_UPLOAD_BUFLEN];
+};
+
+class ESP8266WebServer {
+    public:
+        typedef std::function<void(void)> THandlerFunction;
+
+    private:
+        struct Handler {
+            String uri;
+            HTTPMethod method;
+            THandlerFunction fn;
+            THandlerFunction uploadFn;
+        };
+
+        struct Request {
+            HTTPMethod method;
+            String uri;
+            String body;
+            std::vector<uint8_t> upload;
+        };
+
+        std::vector<Handler> m_handlers;
+        THandlerFunction m_notFoundHandler;
+        std::deque<Request> m_requests;
+
+        HTTPMethod m_method;
+        String m_uri;
+        String m_body;
+        HTTPUpload m_upload;
+
+    public:
+        // Last response
+        int lastStatus;
+        String lastContentType;
+        String lastContent;
+        unsigned long requestsHandled;
+
+        ESP8266WebServer(int port) : m_method(HTTP_GET), lastStatus(0), requestsHandled(0) {}
+
+        void begin(void) {}
+
+        void on(const String &uri, HTTPMethod method, THandlerFunction fn) {
+            on(uri, method, fn, THandlerFunction());
+        }
+
+        void on(const String &uri, HTTPMethod method, THandlerFunction fn, THandlerFunction uploadFn) {
+            Handler handler = { uri, method, fn, uploadFn };
+            m_handlers.push_back(handler);
+        }
+
+        void onNotFound(THandlerFunction fn) {
+            m_notFoundHandler = fn;
+        }
+
+        void handleClient(void);
+
+        // Queue a request or a file upload for the next handleClient() calls
+        void mockRequest(HTTPMethod method, const String &uri, const String &body = String());
+        void mockUpload(const String &uri, const uint8_t *data, size_t size);
+
+        HTTPMethod method(void) { return m_method; }
+        String uri(void) { return m_uri; }
+        HTTPUpload &upload(void) { return m_upload; }
+
+        String arg(const String &name) {
+            if (name == "plain") return m_body;
+            return String();
+        }
+
+        void sendHeader(const String &name, const String &value, bool first = false) {}
+
+        void send(int code, const char *contentType = "", const String &content = String()) {
+            lastStatus = code;
+            lastContentType = contentType;
+            lastContent = content;
+        }
+
+        void send(int code, const String &contentType, const String &content) {
+            send(code, contentType.c_str(), content);
+        }
+
+        template <typename T>
+        size_t streamFile(T &file, const String &contentType) {
+            // Read the whole file like the real server would
+            uint8_t buffer[256];
+            size_t size = 0;
+            size_t read;
+            while ((read = file.read(buffer, sizeof(buffer))) > 0) size += read;
+
+            lastStatus = 200;
+            lastContentType = contentType;
+            lastContent = String();
+            return size;
+        }
+};
+
+#endif
@@ -0,0 +1,46 @@
+#ifndef MOCK_ESP8266_WIFI_H
+#define MOCK_ESP8266_WIFI_H
+
+/*
+ * WiFi replacement for the native build. The station is always connected.
+ */
+
+#include "Arduino.h"
+#include <functional>
+#include <memory>
+
+typedef enum {
+    WL_IDLE_STATUS = 0,
+    WL_CONNECTED = 3,
+    WL_DISCONNECTED = 6
+} wl_status_t;
+
+typedef enum {
+    WIFI_OFF = 0,
+    WIFI_STA = 1,
+    WIFI_AP = 2,
+    WIFI_AP_STA = 3
+} WiFiMode_t;
+
+struct WiFiEventStationModeConnected {
+    String ssid;
+    uint8_t channel;
+};
+
+typedef std::shared_ptr<void> WiFiEventHandler;
+
+class MockWiFi {
+    public:
+        wl_status_t status(void) { return WL_CONNECTED; }
+        wl_status_t begin(const char *ssid, const char *passphrase) { return WL_CONNECTED; }
+        bool mode(WiFiMode_t mode) { return true; }
+        bool hostname(const char *name) { return true; }
+
+        WiFiEventHandler onStationModeConnected(std::function<void(const WiFiEventStationModeConnected&)> handler) {
+            return WiFiEventHandler();
+        }
+};
+
+extern MockWiFi WiFi;
+
+#endif
@@ -0,0 +1,14 @@
+#ifndef MOCK_ESP8266_MDNS_H
+#define MOCK_ESP8266_MDNS_H
+
+#include "Arduino.h"
+
+class MockMDNS {
+    public:
+        bool begin(const char *hostname) { return true; }
+        bool update(void) { return true; }
+};
+
+extern MockMDNS MDNS;
+
+#endif
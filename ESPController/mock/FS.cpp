@@ -0,0 +1,209 @@
+#include "FS.h"
+#include <dirent.h>
+#include <sys/stat.h>
+
+FS SPIFFS;
+
+
+/**************
+ *    FILE    *
+ **************/
+
+File::File(std::shared_ptr<MockFileData> data, const std::string &name, bool writable, bool append) {
+    m_data = data;
+    m_name = name;
+    m_writable = writable;
+    m_position = append ? data->data.size() : 0;
+}
+
+int File::read(void) {
+    if (!m_data || m_position >= m_data->data.size()) return -1;
+    SPIFFS.simulateLatency();
+    SPIFFS.reads++;
+    return m_data->data[m_position++];
+}
+
+size_t File::read(uint8_t *buffer, size_t size) {
+    if (!m_data) return 0;
+    SPIFFS.simulateLatency();
+    SPIFFS.reads++;
+
+    if (m_position >= m_data->data.size()) return 0;
+    if (size > m_data->data.size() - m_position) size = m_data->data.size() - m_position;
+    memcpy(buffer, &m_data->data[m_position], size);
+    m_position += size;
+    return size;
+}
+
+int File::peek(void) {
+    if (!m_data || m_position >= m_data->data.size()) return -1;
+    return m_data->data[m_position];
+}
+
+int File::available(void) {
+    if (!m_data) return 0;
+    return m_data->data.size() - m_position;
+}
+
+size_t File::write(uint8_t c) {
+    return write(&c, 1);
+}
+
+size_t File::write(const uint8_t *buffer, size_t size) {
+    if (!m_data || !m_writable) return 0;
+    SPIFFS.simulateLatency();
+    SPIFFS.writes++;
+
+    if (m_position + size > m_data->data.size()) m_data->data.resize(m_position + size);
+    memcpy(&m_data->data[m_position], buffer, size);
+    m_position += size;
+    return size;
+}
+
+bool File::seek(uint32_t position, SeekMode mode) {
+    if (!m_data) return false;
+
+    size_t newPosition = position;
+    if (mode == SeekCur) newPosition = m_position + position;
+    if (mode == SeekEnd) newPosition = m_data->data.size() - position;
+    if (newPosition > m_data->data.size()) return false;
+
+    m_position = newPosition;
+    return true;
+}
+
+
+/*************
+ *    DIR    *
+ *************/
+
+Dir::Dir(const std::vector<std::string> &names, const std::vector<size_t> &sizes) {
+    m_names = names;
+    m_sizes = sizes;
+    m_index = -1;
+}
+
+bool Dir::next(void) {
+    m_index++;
+    return m_index < (int) m_names.size();
+}
+
+String Dir::fileName(void) {
+    if (m_index < 0 || m_index >= (int) m_names.size()) return String();
+    return String(m_names[m_index]);
+}
+
+size_t Dir::fileSize(void) {
+    if (m_index < 0 || m_index >= (int) m_sizes.size()) return 0;
+    return m_sizes[m_index];
+}
+
+
+/********************
+ *    FILESYSTEM    *
+ ********************/
+
+bool FS::begin(void) {
+    if (m_mounted) return true;
+    m_mounted = true;
+
+    const char *root = getenv("MOCK_FS_ROOT");
+    loadDirectory(root ? root : "data", "");
+    return true;
+}
+
+void FS::loadDirectory(const std::string &hostPath, const std::string &path) {
+    DIR *dir = opendir(hostPath.c_str());
+    if (!dir) return;
+
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL) {
+        std::string name = entry->d_name;
+        if (name == "." || name == "..") continue;
+
+        std::string hostFile = hostPath + "/" + name;
+        struct stat info;
+        if (stat(hostFile.c_str(), &info) != 0) continue;
+
+        // SPIFFS has no real directories, the path is part of the file name
+        if (S_ISDIR(info.st_mode)) {
+            loadDirectory(hostFile, path + "/" + name);
+            continue;
+        }
+
+        FILE *file = fopen(hostFile.c_str(), "rb");
+        if (!file) continue;
+
+        std::shared_ptr<MockFileData> data = std::make_shared<MockFileData>();
+        data->data.resize(info.st_size);
+        if (fread(data->data.data(), 1, info.st_size, file) == (size_t) info.st_size) m_files[path + "/" + name] = data;
+        fclose(file);
+    }
+
+    closedir(dir);
+}
+
+void FS::simulateLatency(void) {
+    if (latency > 0) delayMicroseconds(latency);
+}
+
+File FS::open(const String &path, const char *mode) {
+    simulateLatency();
+    opens++;
+
+    std::string name = path.c_str();
+    bool writable = strchr(mode, 'w') || strchr(mode, 'a') || strchr(mode, '+');
+
+    std::map<std::string, std::shared_ptr<MockFileData>>::iterator file = m_files.find(name);
+    if (mode[0] == 'w') {
+        // Create or truncate
+        std::shared_ptr<MockFileData> data = std::make_shared<MockFileData>();
+        m_files[name] = data;
+        return File(data, name, true, false);
+    }
+
+    if (file == m_files.end()) {
+        if (mode[0] != 'a') return File();
+        std::shared_ptr<MockFileData> data = std::make_shared<MockFileData>();
+        m_files[name] = data;
+        return File(data, name, true, false);
+    }
+
+    return File(file->second, name, writable, mode[0] == 'a');
+}
+
+bool FS::exists(const String &path) {
+    simulateLatency();
+    return m_files.count(path.c_str()) > 0;
+}
+
+bool FS::remove(const String &path) {
+    simulateLatency();
+    return m_files.erase(path.c_str()) > 0;
+}
+
+bool FS::rename(const String &from, const String &to) {
+    simulateLatency();
+
+    std::map<std::string, std::shared_ptr<MockFileData>>::iterator file = m_files.find(from.c_str());
+    if (file == m_files.end() || m_files.count(to.c_str()) > 0) return false;
+
+    m_files[to.c_str()] = file->second;
+    m_files.erase(file);
+    return true;
+}
+
+Dir FS::openDir(const String &path) {
+    simulateLatency();
+
+    // Like SPIFFS, list all files starting with the given path
+    std::vector<std::string> names;
+    std::vector<size_t> sizes;
+    for (std::map<std::string, std::shared_ptr<MockFileData>>::iterator file = m_files.begin(); file != m_files.end(); file++) {
+        if (file->first.compare(0, path.length(), path.c_str()) != 0) continue;
+        names.push_back(file->first);
+        sizes.push_back(file->second->data.size());
+    }
+
+    return Dir(names, sizes);
+}
\ No newline at end of file
@@ -0,0 +1,99 @@
+#ifndef MOCK_FS_H
+#define MOCK_FS_H
+
+/*
+ * In-memory SPIFFS replacement for the native build. On begin(), all files of the host directory given by the
+ * MOCK_FS_ROOT environment variable (default: "data") are loaded into memory. Writes never touch the host.
+ */
+
+#include "Arduino.h"
+#include <map>
+#include <memory>
+#include <vector>
+
+enum SeekMode {
+    SeekSet = 0,
+    SeekCur = 1,
+    SeekEnd = 2
+};
+
+struct MockFileData {
+    std::vector<uint8_t> data;
+};
+
+class File {
+    private:
+        std::shared_ptr<MockFileData> m_data;
+        std::string m_name;
+        size_t m_position;
+        bool m_writable;
+
+    public:
+        File() : m_position(0), m_writable(false) {}
+        File(std::shared_ptr<MockFileData> data, const std::string &name, bool writable, bool append);
+
+        operator bool() const { return (bool) m_data; }
+
+        int read(void);
+        size_t read(uint8_t *buffer, size_t size);
+        int peek(void);
+        int available(void);
+
+        size_t write(uint8_t c);
+        size_t write(const uint8_t *buffer, size_t size);
+
+        bool seek(uint32_t position, SeekMode mode = SeekSet);
+        size_t position(void) const { return m_position; }
+        size_t size(void) const { return m_data ? m_data->data.size() : 0; }
+
+        const char *name(void) const { return m_name.c_str(); }
+        void close(void) { m_data.reset(); }
+};
+
+class Dir {
+    private:
+        std::vector<std::string> m_names;
+        std::vector<size_t> m_sizes;
+        int m_index;
+
+    public:
+        Dir() : m_index(-1) {}
+        Dir(const std::vector<std::string> &names, const std::vector<size_t> &sizes);
+
+        bool next(void);
+        String fileName(void);
+        size_t fileSize(void);
+};
+
+class FS {
+    private:
+        std::map<std::string, std::shared_ptr<MockFileData>> m_files;
+        bool m_mounted;
+
+    public:
+        // Simulated flash latency in microseconds per file operation (open, read and write calls)
+        unsigned long latency;
+
+        // Statistics
+        unsigned long opens;
+        unsigned long reads;
+        unsigned long writes;
+
+        FS() : m_mounted(false), latency(0), opens(0), reads(0), writes(0) {}
+
+        bool begin(void);
+        void end(void) {}
+
+        File open(const String &path, const char *mode);
+        bool exists(const String &path);
+        bool remove(const String &path);
+        bool rename(const String &from, const String &to);
+        Dir openDir(const String &path);
+
+        void loadDirectory(const std::string &hostPath, const std::string &path);
+        void simulateLatency(void);
+};
+
+extern FS SPIFFS;
+
+#endif
\ No newline at end of file
@@ -0,0 +1,150 @@
+#ifndef MOCK_FASTLED_H
+#define MOCK_FASTLED_H
+
+/*
+ * FastLED replacement for the native build. Only the parts used by the controller are implemented. The math
+ * follows FastLED 3.3 (FASTLED_SCALE8_FIXED), show() doesn't output anything but counts the calls. addLeds() only
+ * remembers the led array, so a benchmark or test can look at what would be sent to the strip.
+ */
+
+#include "Arduino.h"
+
+#define FASTLED_USING_NAMESPACE
+
+typedef uint8_t fract8;
+
+inline uint8_t scale8(uint8_t i, fract8 scale) {
+    return ((uint16_t) i * (1 + (uint16_t) scale)) >> 8;
+}
+
+inline uint8_t qadd8(uint8_t i, uint8_t j) {
+    unsigned int t = i + j;
+    return t > 255 ? 255 : t;
+}
+
+inline uint8_t qsub8(uint8_t i, uint8_t j) {
+    int t = i - j;
+    return t < 0 ? 0 : t;
+}
+
+inline uint8_t blend8(uint8_t a, uint8_t b, uint8_t amountOfB) {
+    uint16_t partial = (a << 8) | b;
+    partial -= (a * amountOfB);
+    partial += (b * amountOfB);
+    return partial >> 8;
+}
+
+struct CRGB {
+    union {
+        struct {
+            union { uint8_t r; uint8_t red; };
+            union { uint8_t g; uint8_t green; };
+            union { uint8_t b; uint8_t blue; };
+        };
+        uint8_t raw[3];
+    };
+
+    typedef enum {
+        Black = 0x000000,
+        White = 0xFFFFFF,
+        Red = 0xFF0000,
+        Green = 0x008000,
+        Blue = 0x0000FF
+    } HTMLColorCode;
+
+    CRGB() {}
+    CRGB(uint8_t ir, uint8_t ig, uint8_t ib) : r(ir), g(ig), b(ib) {}
+    CRGB(uint32_t colorcode) : r((colorcode >> 16) & 0xFF), g((colorcode >> 8) & 0xFF), b(colorcode & 0xFF) {}
+    CRGB(HTMLColorCode colorcode) : CRGB((uint32_t) colorcode) {}
+
+    uint8_t &operator[](uint8_t x) { return raw[x]; }
+    const uint8_t &operator[](uint8_t x) const { return raw[x]; }
+
+    explicit operator bool() const { return r || g || b; }
+
+    CRGB &nscale8(uint8_t scaledown) {
+        r = scale8(r, scaledown);
+        g = scale8(g, scaledown);
+        b = scale8(b, scaledown);
+        return *this;
+    }
+
+    CRGB &operator+=(const CRGB &rhs) {
+        r = qadd8(r, rhs.r);
+        g = qadd8(g, rhs.g);
+        b = qadd8(b, rhs.b);
+        return *this;
+    }
+};
+
+inline bool operator==(const CRGB &lhs, const CRGB &rhs) {
+    return lhs.r == rhs.r && lhs.g == rhs.g && lhs.b == rhs.b;
+}
+
+inline bool operator!=(const CRGB &lhs, const CRGB &rhs) {
+    return !(lhs == rhs);
+}
+
+inline CRGB &nblend(CRGB &existing, const CRGB &overlay, fract8 amountOfOverlay) {
+    if (amountOfOverlay == 0) return existing;
+    if (amountOfOverlay == 255) {
+        existing = overlay;
+        return existing;
+    }
+
+    existing.r = blend8(existing.r, overlay.r, amountOfOverlay);
+    existing.g = blend8(existing.g, overlay.g, amountOfOverlay);
+    existing.b = blend8(existing.b, overlay.b, amountOfOverlay);
+    return existing;
+}
+
+inline CRGB blend(const CRGB &p1, const CRGB &p2, fract8 amountOfP2) {
+    CRGB result = p1;
+    nblend(result, p2, amountOfP2);
+    return result;
+}
+
+inline void fill_solid(CRGB *leds, int numToFill, const CRGB &color) {
+    for (int i = 0; i < numToFill; i++) leds[i] = color;
+}
+
+// Color orders, in the octal notation of FastLED
+enum EOrder {
+    RGB = 0012,
+    RBG = 0021,
+    GRB = 0102,
+    GBR = 0120,
+    BRG = 0201,
+    BGR = 0210
+};
+
+template <uint8_t DATA_PIN, EOrder RGB_ORDER = GRB>
+class WS2812B {};
+
+class CFastLED {
+    private:
+        uint8_t m_brightness;
+
+    public:
+        unsigned long shows;
+        CRGB *leds;                 // Led array registered by addLeds()
+        int numLeds;
+        EOrder colorOrder;
+
+        CFastLED() : m_brightness(255), shows(0), leds(NULL), numLeds(0), colorOrder(RGB) {}
+
+        template <template <uint8_t DATA_PIN, EOrder RGB_ORDER> class CHIPSET, uint8_t DATA_PIN, EOrder RGB_ORDER>
+        void addLeds(CRGB *data, int nLeds) {
+            leds = data;
+            numLeds = nLeds;
+            colorOrder = RGB_ORDER;
+        }
+
+        void show(void) { shows++; }
+        void setBrightness(uint8_t scale) { m_brightness = scale; }
+        uint8_t getBrightness(void) { return m_brightness; }
+};
+
+extern CFastLED FastLED;
+
+#endif
@@ -0,0 +1,38 @@
+#ifndef MOCK_GIF_DECODER_H
+#define MOCK_GIF_DECODER_H
+
+/*
+ * GifDecoder replacement for the native build. Gif files are played back from their transcoded MAF files, so the
+ * fallback decoder only needs to exist. It doesn't draw anything.
+ */
+
+#include "Arduino.h"
+
+#define ERROR_NONE              0
+#define ERROR_FINISHED          1
+
+typedef void (*callback)(void);
+typedef void (*pixel_callback)(int16_t x, int16_t y, uint8_t red, uint8_t green, uint8_t blue);
+typedef bool (*file_seek_callback)(unsigned long position);
+typedef unsigned long (*file_position_callback)(void);
+typedef int (*file_read_callback)(void);
+typedef int (*file_read_block_callback)(void *buffer, int numberOfBytes);
+
+template <int maxGifWidth, int maxGifHeight, int lzwMaxBits>
+class GifDecoder {
+    public:
+        void setScreenClearCallback(callback f) {}
+        void setUpdateScreenCallback(callback f) {}
+        void setDrawPixelCallback(pixel_callback f) {}
+        void setStartDrawingCallback(callback f) {}
+
+        void setFileSeekCallback(file_seek_callback f) {}
+        void setFilePositionCallback(file_position_callback f) {}
+        void setFileReadCallback(file_read_callback f) {}
+        void setFileReadBlockCallback(file_read_block_callback f) {}
+
+        int startDecoding(void) { return ERROR_NONE; }
+        int decodeFrame(void) { return ERROR_NONE; }
+};
+
+#endif
@@ -0,0 +1,10 @@
+#ifndef MOCK_SETTINGS_H
+#define MOCK_SETTINGS_H
+
+/*
+ * Used by the native build if there is no src/Settings.h (e.g. in CI).
+ */
+
+#include "../src/Settings-example.h"
+
+#endif
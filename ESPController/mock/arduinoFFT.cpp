@@ -0,0 +1,99 @@
+#include "arduinoFFT.h"
+
+void arduinoFFT::Windowing(double *vData, uint16_t samples, uint8_t windowType, uint8_t dir) {
+    double samplesMinusOne = samples - 1.0;
+
+    for (uint16_t i = 0; i < (samples >> 1); i++) {
+        double ratio = i / samplesMinusOne;
+        double weighingFactor = 1.0;
+
+        switch (windowType) {
+            case FFT_WIN_TYP_HAMMING:
+                weighingFactor = 0.54 - (0.46 * cos(2 * M_PI * ratio));
+                break;
+            case FFT_WIN_TYP_HANN:
+                weighingFactor = 0.54 * (1.0 - cos(2 * M_PI * ratio));
+                break;
+            case FFT_WIN_TYP_BLACKMAN:
+                weighingFactor = 0.42323 - (0.49755 * cos(2 * M_PI * ratio)) + (0.07922 * cos(4 * M_PI * ratio));
+                break;
+            case FFT_WIN_TYP_BLACKMAN_NUTTALL:
+                weighingFactor = 0.3635819 - (0.4891775 * cos(2 * M_PI * ratio)) + (0.1365995 * cos(4 * M_PI * ratio))
+                    - (0.0106411 * cos(6 * M_PI * ratio));
+                break;
+            default:
+                break;
+        }
+
+        if (dir == FFT_FORWARD) {
+            vData[i] *= weighingFactor;
+            vData[samples - (i + 1)] *= weighingFactor;
+        } else {
+            vData[i] /= weighingFactor;
+            vData[samples - (i + 1)] /= weighingFactor;
+        }
+    }
+}
+
+void arduinoFFT::Compute(double *vReal, double *vImag, uint16_t samples, uint8_t dir) {
+    // Reverse bits
+    uint16_t j = 0;
+    for (uint16_t i = 0; i < (samples - 1); i++) {
+        if (i < j) {
+            double temp = vReal[i];
+            vReal[i] = vReal[j];
+            vReal[j] = temp;
+            temp = vImag[i];
+            vImag[i] = vImag[j];
+            vImag[j] = temp;
+        }
+        uint16_t k = samples >> 1;
+        while (k <= j) {
+            j -= k;
+            k >>= 1;
+        }
+        j += k;
+    }
+
+    // Compute the FFT
+    double c1 = -1.0;
+    double c2 = 0.0;
+    uint16_t l2 = 1;
+    for (uint16_t l = 1; (1 << l) <= samples; l++) {
+        uint16_t l1 = l2;
+        l2 <<= 1;
+        double u1 = 1.0;
+        double u2 = 0.0;
+        for (j = 0; j < l1; j++) {
+            for (uint16_t i = j; i < samples; i += l2) {
+                uint16_t i1 = i + l1;
+                double t1 = u1 * vReal[i1] - u2 * vImag[i1];
+                double t2 = u1 * vImag[i1] + u2 * vReal[i1];
+                vReal[i1] = vReal[i] - t1;
+                vImag[i1] = vImag[i] - t2;
+                vReal[i] += t1;
+                vImag[i] += t2;
+            }
+            double z = ((u1 * c1) - (u2 * c2));
+            u2 = ((u1 * c2) + (u2 * c1));
+            u1 = z;
+        }
+        c2 = sqrt((1.0 - c1) / 2.0);
+        if (dir == FFT_FORWARD) c2 = -c2;
+        c1 = sqrt((1.0 + c1) / 2.0);
+    }
+
+    // Scaling for reverse transform
+    if (dir != FFT_FORWARD) {
+        for (uint16_t i = 0; i < samples; i++) {
+            vReal[i] /= samples;
+            vImag[i] /= samples;
+        }
+    }
+}
+
+void arduinoFFT::ComplexToMagnitude(double *vReal, double *vImag, uint16_t samples) {
+    for (uint16_t i = 0; i < samples; i++) {
+        vReal[i] = sqrt(vReal[i] * vReal[i] + vImag[i] * vImag[i]);
+    }
+}
@@ -0,0 +1,34 @@
+#ifndef MOCK_ARDUINO_FFT_H
+#define MOCK_ARDUINO_FFT_H
+
+/*
+ * arduinoFFT (1.x API) replacement for the native build. Same algorithms in double precision, so the results match
+ * the library.
+ */
+
+#include "Arduino.h"
+
+#define FFT_FORWARD                     0x01
+#define FFT_REVERSE                     0x00
+
+#define FFT_WIN_TYP_RECTANGLE           0x00
+#define FFT_WIN_TYP_HAMMING             0x01
+#define FFT_WIN_TYP_HANN                0x02
+#define FFT_WIN_TYP_TRIANGLE            0x03
+#define FFT_WIN_TYP_NUTTALL             0x04
+#define FFT_WIN_TYP_BLACKMAN            0x05
+#define FFT_WIN_TYP_BLACKMAN_NUTTALL    0x06
+#define FFT_WIN_TYP_BLACKMAN_HARRIS     0x07
+#define FFT_WIN_TYP_FLT_TOP             0x08
+#define FFT_WIN_TYP_WELCH               0x09
+
+class arduinoFFT {
+    public:
+        arduinoFFT(void) {}
+
+        void Windowing(double *vData, uint16_t samples, uint8_t windowType, uint8_t dir);
+        void Compute(double *vReal, double *vImag, uint16_t samples, uint8_t dir);
+        void ComplexToMagnitude(double *vReal, double *vImag, uint16_t samples);
+};
+
+#endif
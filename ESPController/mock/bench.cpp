@@ -0,0 +1,699 @@
+#include "Arduino.h"
+#include "FS.h"
+#include "FastLED.h"
+#include "Visualization.h"
+#include "MicSampler.h"
+#include "Scheduler.h"
+#include "Profiler.h"
+#include "Output.h"
+#include "Transition.h"
+#include "SettingsStore.h"
+#include "Effects.h"
+#include <LedLayout.h>
+#include <MAFDecoder.h>
+#include <FileIO.h>
+#include <ESP8266WebServer.h>
+#include <time.h>
+#include <new>
+#include <vector>
+
+/*
+ * Entry point of the native build. Runs setup() once and then loop() for every mode and visualization until the given
+ * number of frames was rendered. Reports the frame rate, the time spent in the frame tasks per frame, how late the
+ * frames started, the heap allocations, the led pushes and the bytes sent over the serial port per frame, and the timing
+ * of every task. The steady state runs switch without a transition, the transition runs switch at their start.
+ *
+ * With "effects", it instead renders the built in effects and their straightforward reference implementations from the
+ * same random spectra, compares their output at every frame and times both. Build with other MATRIX_WIDTH / MATRIX_HEIGHT
+ * flags to check other matrix sizes.
+ *
+ * Usage: .pio/build/native/program [frames]
+ *        .pio/build/native/program effects [frames]
+ */
+
+// Globals of main.cpp
+void setup();
+void loop();
+void requestSwitch(unsigned int newMode, int direction, int visIndex, bool store);
+extern bool switchPending;
+extern int animationIndex;
+extern Visualization visualization;
+extern CRGB *leds;
+extern CRGB layerLeds[FILE_IO_SLOTS][MATRIX_WIDTH * MATRIX_HEIGHT];
+extern MAFDecoder<MATRIX_WIDTH, MATRIX_HEIGHT> mafDecoders[FILE_IO_SLOTS];
+extern bool mafPlayback[FILE_IO_SLOTS];
+extern ESP8266WebServer webserver;
+
+#define MODE_ANI    0
+#define MODE_VIS    1
+
+
+/*****************************
+ *    ALLOCATION COUNTING    *
+ *****************************/
+
+namespace {
+    unsigned long allocations = 0;
+}
+
+void *operator new(size_t size) {
+    allocations++;
+    void *p = malloc(size);
+    if (!p) throw std::bad_alloc();
+    return p;
+}
+
+void *operator new[](size_t size) {
+    allocations++;
+    void *p = malloc(size);
+    if (!p) throw std::bad_alloc();
+    return p;
+}
+
+void operator delete(void *p) noexcept {
+    free(p);
+}
+
+void operator delete[](void *p) noexcept {
+    free(p);
+}
+
+void operator delete(void *p, size_t size) noexcept {
+    free(p);
+}
+
+void operator delete[](void *p, size_t size) noexcept {
+    free(p);
+}
+
+#ifdef __GLIBC__
+extern "C" void *__libc_malloc(size_t size);
+
+extern "C" void *malloc(size_t size) {
+    allocations++;
+    return __libc_malloc(size);
+}
+#endif
+
+
+/*******************
+ *    BENCHMARK    *
+ *******************/
+
+void runBenchmark(const char *name, int frames, bool httpLoad) {
+    Scheduler::resetStats();
+    unsigned long startAllocations = allocations;
+    unsigned long startSerial = Serial.bytesWritten;
+    unsigned long startShows = FastLED.shows;
+    unsigned long startMicros = micros();
+    unsigned long loops = 0;
+    unsigned long requests = webserver.requestsHandled;
+
+    while (Scheduler::getFrames() < (unsigned long) frames) {
+        // Keep a request for a gif file in the queue
+        if (httpLoad && webserver.requestsHandled >= requests) {
+            webserver.mockRequest(HTTP_GET, "/api/animations/3");
+            requests++;
+        }
+
+        loop();
+        loops++;
+    }
+
+    double seconds = (micros() - startMicros) / 1000000.0;
+
+    // Time spent in the frame tasks
+    double frameMicros = 0;
+    for (int i = 0; i < Scheduler::getNumTasks(); i++) {
+        if (Scheduler::getTask(i).type == TASK_FRAME) frameMicros += Scheduler::getTask(i).totalMicros;
+    }
+
+    printf("%-18s %7.1f fps %9.2f us frame tasks %9.1f loops/frame %6lu us avg late %6lu us max late %4lu late frames %6.2f allocs/frame %5.2f shows/frame %7.1f serial bytes/frame\n",
+        name,
+        frames / seconds,
+        frameMicros / frames,
+        (double) loops / frames,
+        Scheduler::getAvgLateMicros(),
+        Scheduler::getMaxLateMicros(),
+        Scheduler::getLateFrames(),
+        (double) (allocations - startAllocations) / frames,
+        (double) (FastLED.shows - startShows) / frames,
+        (double) (Serial.bytesWritten - startSerial) / frames);
+
+    for (int i = 0; i < Scheduler::getNumTasks(); i++) {
+        const Scheduler::Task &task = Scheduler::getTask(i);
+        printf("    %-14s %8lu runs %9.2f us avg %6lu us max\n",
+            task.name, task.runs, task.runs ? (double) task.totalMicros / task.runs : 0.0, task.maxMicros);
+    }
+}
+
+// Switches the mode (or to the next animation / visualization) and waits until the switch is done
+void switchTo(unsigned int newMode, int direction) {
+    requestSwitch(newMode, direction, -1, false);
+    while (switchPending || Transition::isActive()) loop();
+
+    // Until the new source was presented
+    unsigned long frames = Scheduler::getFrames();
+    while (Scheduler::getFrames() == frames) loop();
+}
+
+// Switches to the next (prefetched) or the previous animation right after a frame, like a request between two frames.
+// Reports how many switches found the animation open already, the latency from the request to the first frame of the
+// new animation and how long the switch blocked the loop
+void runSwitches(const char *name, int direction, int switches) {
+    unsigned long totalLatency = 0;
+    unsigned long maxLatency = 0;
+    unsigned long totalBlock = 0;
+    unsigned long maxBlock = 0;
+    int prefetched = 0;
+    Scheduler::resetStats();
+
+    for (int i = 0; i < switches; i++) {
+        // Leave some idle time to open the next animation, the switch starts right after a frame
+        unsigned long frames = Scheduler::getFrames();
+        while (Scheduler::getFrames() < frames + 5) loop();
+
+        unsigned long start = micros();
+        unsigned long requested = start;
+        requestSwitch(MODE_ANI, direction, -1, false);
+        unsigned long block = micros() - start;
+        if (!switchPending) prefetched++;
+        while (switchPending) {
+            start = micros();
+            loop();
+            block = max(block, micros() - start);
+        }
+
+        unsigned long shows = FastLED.shows;
+        while (FastLED.shows == shows) loop();
+        unsigned long latency = micros() - requested;
+
+        totalLatency += latency;
+        maxLatency = max(maxLatency, latency);
+        totalBlock += block;
+        maxBlock = max(maxBlock, block);
+    }
+
+    printf("%-18s %d/%d prefetched %7.2f ms avg latency %7.2f ms max latency %7.1f us avg block %6lu us max block %4lu late frames\n",
+        name, prefetched, switches, totalLatency / 1000.0 / switches, maxLatency / 1000.0, (double) totalBlock / switches,
+        maxBlock, Scheduler::getLateFrames());
+}
+
+// Measures how long after its deadline every frame of the shown animation is pushed to the leds
+void runFrameDelay(const char *name, int frames) {
+    unsigned long totalDelay = 0;
+    unsigned long maxDelay = 0;
+    unsigned long shows = FastLED.shows;
+    int slot = (leds - layerLeds[0]) / (MATRIX_WIDTH * MATRIX_HEIGHT);
+    uint32_t deadline = mafDecoders[slot].getNextDeadline();
+    if (!mafPlayback[slot]) {
+        // E.g. the bundled animations don't match the matrix size
+        printf("%-18s no transcoded animation\n", name);
+        return;
+    }
+
+    for (int i = 0; i < frames; ) {
+        loop();
+        if (FastLED.shows == shows) continue;
+        shows = FastLED.shows;
+
+        // A decoded frame moved the deadline
+        uint32_t nextDeadline = mafDecoders[slot].getNextDeadline();
+        if (nextDeadline == deadline) continue;
+        unsigned long delay = micros() - deadline;
+        totalDelay += delay;
+        maxDelay = max(maxDelay, delay);
+        deadline = nextDeadline;
+        i++;
+    }
+
+    printf("%-18s %7.2f ms avg delay %7.2f ms max delay\n", name, totalDelay / 1000.0 / frames, maxDelay / 1000.0);
+}
+
+void runUpload(const char *name, const std::vector<uint8_t> &gif) {
+    unsigned long startWrites = SPIFFS.writes;
+    unsigned long startMicros = micros();
+
+    unsigned long requests = webserver.requestsHandled;
+    webserver.mockUpload("/api/animations", gif.data(), gif.size());
+    while (webserver.requestsHandled == requests) loop();
+    unsigned long uploadMicros = micros() - startMicros;
+    int status = webserver.lastStatus;
+    String message = webserver.lastContent;
+
+    webserver.mockRequest(HTTP_GET, "/api/animations");
+    while (webserver.requestsHandled == requests + 1) loop();
+
+    printf("%-18s %6lu bytes %4d %-28s %6lu flash writes %8lu us, %s animations\n",
+        name, (unsigned long) gif.size(), status, message.c_str(), SPIFFS.writes - startWrites, uploadMicros,
+        webserver.lastContent.c_str());
+}
+
+/**********************
+ *    EFFECT CHECK    *
+ **********************/
+
+namespace {
+    CRGB refPalette[VISUALIZATION_PALETTE_SIZE];
+    CRGB refSwirlColors[EFFECT_SPIRAL_SIZE];
+    CRGB refHeatmapRamp[EFFECT_RAMP_SIZE];
+}
+
+// Level as the effects got it before the levels were fixed point
+double refLevel(int32_t level) {
+    return level / (double) EFFECT_LEVEL_MAX;
+}
+
+// Sets a led and tells if its color changed, like the effects did before
+bool refSetLed(CRGB &led, const CRGB &color) {
+    if (led == color) return false;
+    led = color;
+    return true;
+}
+
+// Bars as they were rendered before the gradient table: the foreground color is blended for every pixel
+bool refBars(CRGB *leds, const EffectInput &input) {
+    bool changed = false;
+    for (int x = 0; x < MATRIX_WIDTH; x++) {
+        double thresh_d = MATRIX_HEIGHT - refLevel(input.spectrum[x]) * MATRIX_HEIGHT;
+        int thresh = (int) thresh_d;
+        fract8 factor = (fract8) ((1 + thresh - thresh_d) * 255);
+
+        for (int y = 0; y < MATRIX_HEIGHT; y++) {
+            CRGB color_fg = blend(
+                blend(refPalette[4], refPalette[3], x * 255 / (MATRIX_WIDTH - 1)),
+                blend(refPalette[2], refPalette[1], x * 255 / (MATRIX_WIDTH - 1)),
+                y * 255 / (MATRIX_HEIGHT - 1)
+            );
+
+            if (y > thresh) changed |= refSetLed(leds[x + y * MATRIX_WIDTH], color_fg);
+            else if (y == thresh) changed |= refSetLed(leds[x + y * MATRIX_WIDTH], blend(refPalette[0], color_fg, factor));
+            else changed |= refSetLed(leds[x + y * MATRIX_WIDTH], refPalette[0]);
+        }
+    }
+    return changed;
+}
+
+// Swirl as it was rendered before the ring buffer: the colors are shifted by one and the spiral is walked every frame
+bool refSwirl(CRGB *leds, const EffectInput &input) {
+    CRGB col = blend(
+        refPalette[0],
+        blend(
+            blend(refPalette[1], refPalette[2], refLevel(input.spectrum[0]) * 255),
+            blend(refPalette[3], refPalette[4], refLevel(input.spectrum[MATRIX_WIDTH / 2]) * 255),
+            refLevel(input.spectrum[MATRIX_WIDTH - 1]) * 255
+        ),
+        refLevel(input.peakVal) * 255
+    );
+
+    for (int i = EFFECT_SPIRAL_SIZE - 1; i > 0; i--) refSwirlColors[i] = refSwirlColors[i - 1];
+    refSwirlColors[0] = col;
+
+    int wMax = MATRIX_WIDTH - 1;
+    int hMax = MATRIX_HEIGHT - 2;
+    int direction = 0;
+    int px = -1;
+    int py = 0;
+    int l = 0;
+    bool changed = false;
+
+    for (int i = 0; i < EFFECT_SPIRAL_SIZE; i++) {
+        if ((direction == 0 || direction == 2) ? l > wMax : l > hMax) {
+            l = 0;
+            wMax--;
+            hMax--;
+            direction = (direction + 1) % 4;
+        }
+
+        if (direction == 0) px++;
+        if (direction == 1) py++;
+        if (direction == 2) px--;
+        if (direction == 3) py--;
+
+        changed |= refSetLed(leds[px + py * MATRIX_WIDTH], refSwirlColors[i]);
+        changed |= refSetLed(leds[MATRIX_WIDTH - px - 1 + (MATRIX_HEIGHT - py - 1) * MATRIX_WIDTH], refSwirlColors[i]);
+        l++;
+    }
+    return changed;
+}
+
+// Heatmap as it was rendered before the ring buffer: every led is shifted one column to the left and the new column is
+// set on the right. The colors come from the same ramp as the effect, it is checked separately
+bool refHeatmap(CRGB *leds, const EffectInput &input) {
+    bool changed = false;
+    for (int x = 0; x < MATRIX_WIDTH - 1; x++) {
+        for (int y = 0; y < MATRIX_HEIGHT; y++) {
+            changed |= refSetLed(leds[x + y * MATRIX_WIDTH], leds[x + 1 + y * MATRIX_WIDTH]);
+        }
+    }
+
+    for (int y = 0; y < MATRIX_HEIGHT; y++) {
+        int i = refLevel(input.spectrum[y * MATRIX_WIDTH / MATRIX_HEIGHT]) * (EFFECT_RAMP_SIZE - 1);
+        i = max(0, min(i, EFFECT_RAMP_SIZE - 1));
+        changed |= refSetLed(leds[y * MATRIX_WIDTH + MATRIX_WIDTH - 1], refHeatmapRamp[i]);
+    }
+    return changed;
+}
+
+// Heatmap color of a level as it was blended for every pixel before the ramp. The last segment used to pass v * 4 - 3
+// without scaling it to 0 - 255, so it never blended from color C to color D
+CRGB refHeatmapColor(double v, bool scaleLastSegment) {
+    if (v < 0.25) return blend(refPalette[0], refPalette[1], v * 4 * 255);
+    if (v < 0.5) return blend(refPalette[1], refPalette[2], (v * 4 - 1) * 255);
+    if (v < 0.75) return blend(refPalette[2], refPalette[3], (v * 4 - 2) * 255);
+    return blend(refPalette[3], refPalette[4], scaleLastSegment ? (v * 4 - 3) * 255 : v * 4 - 3);
+}
+
+// Largest difference of a channel of two colors
+int colorDistance(const CRGB &a, const CRGB &b) {
+    return max(abs(a.r - b.r), max(abs(a.g - b.g), abs(a.b - b.b)));
+}
+
+// Compares every entry of the heatmap ramp to the blend of its level. The ramp computes the blend amount in integers, the
+// old blend truncated a double that is sometimes just below the integer, so entries may be one step off. Returns the
+// number of levels that are further off
+int runHeatmapRampCheck() {
+    static int32_t spectrum[MATRIX_WIDTH];
+    static CRGB effectLeds[MATRIX_WIDTH * MATRIX_HEIGHT];
+    HeatmapEffect heatmap;
+    heatmap.init(refPalette);
+
+    EffectInput input = {};
+    input.spectrum = spectrum;
+    int rounded = 0;
+    int differing = 0;
+    int unscaledDiffering = 0;
+    for (int i = 0; i < EFFECT_RAMP_SIZE; i++) {
+        // The middle of the level, so the rounding of the spectrum doesn't select the entry below
+        for (int x = 0; x < MATRIX_WIDTH; x++) spectrum[x] = (2 * i + 1) * EFFECT_LEVEL_MAX / (2 * (EFFECT_RAMP_SIZE - 1));
+        heatmap.update(effectLeds, input);
+
+        const CRGB &color = effectLeds[MATRIX_WIDTH - 1];
+        int distance = colorDistance(color, refHeatmapColor((double) i / (EFFECT_RAMP_SIZE - 1), true));
+        if (distance == 1) rounded++;
+        if (distance > 1) differing++;
+        if (colorDistance(color, refHeatmapColor((double) i / (EFFECT_RAMP_SIZE - 1), false)) > 1) unscaledDiffering++;
+    }
+    heatmap.teardown();
+
+    printf("heatmap ramp: %d of %d levels differ, %d by one step, %d differ from the unscaled last segment\n",
+        differing, EFFECT_RAMP_SIZE, rounded, unscaledDiffering);
+    return differing;
+}
+
+// Renders the effect and its reference from the same random spectra, counts the frames in which their leds differ and
+// times both. Returns the number of differing frames
+int runEffectCheck(Effect &effect, bool (*reference)(CRGB *leds, const EffectInput &input), const CRGB *initialLeds,
+        int frames) {
+    static int32_t spectra[1024][MATRIX_WIDTH];
+    static int32_t peakVals[1024];
+    static CRGB effectLeds[MATRIX_WIDTH * MATRIX_HEIGHT];
+    static CRGB referenceLeds[MATRIX_WIDTH * MATRIX_HEIGHT];
+
+    // The same spectra for every effect, including silence and full scale
+    srand(1);
+    for (int i = 0; i < 1024; i++) {
+        for (int x = 0; x < MATRIX_WIDTH; x++) spectra[i][x] = rand() % (EFFECT_LEVEL_MAX + 1);
+        peakVals[i] = rand() % (EFFECT_LEVEL_MAX + 1);
+    }
+    for (int x = 0; x < MATRIX_WIDTH; x++) {
+        spectra[0][x] = 0;
+        spectra[1][x] = EFFECT_LEVEL_MAX;
+    }
+
+    effect.init(refPalette);
+    for (int i = 0; i < MATRIX_WIDTH * MATRIX_HEIGHT; i++) {
+        effectLeds[i] = CRGB(0, 0, 0);
+        referenceLeds[i] = initialLeds[i];
+    }
+
+    EffectInput input = {};
+    int differing = 0;
+    for (int i = 0; i < frames; i++) {
+        input.spectrum = spectra[i % 1024];
+        input.peakVal = peakVals[i % 1024];
+        effect.update(effectLeds, input);
+        reference(referenceLeds, input);
+        if (memcmp(effectLeds, referenceLeds, sizeof(effectLeds)) != 0) differing++;
+    }
+
+    // Time the update alone, the leds keep changing with the spectra
+    clock_t start = clock();
+    for (int i = 0; i < frames; i++) {
+        input.spectrum = spectra[i % 1024];
+        input.peakVal = peakVals[i % 1024];
+        reference(referenceLeds, input);
+    }
+    double referenceMicros = (double) (clock() - start) * 1000000 / CLOCKS_PER_SEC / frames;
+
+    start = clock();
+    for (int i = 0; i < frames; i++) {
+        input.spectrum = spectra[i % 1024];
+        input.peakVal = peakVals[i % 1024];
+        effect.update(effectLeds, input);
+    }
+    double effectMicros = (double) (clock() - start) * 1000000 / CLOCKS_PER_SEC / frames;
+    effect.teardown();
+
+    printf("%-8s %6d of %d frames differ, reference %7.2f us, effect %7.2f us per frame\n",
+        effect.name, differing, frames, referenceMicros, effectMicros);
+    return differing;
+}
+
+int runEffectChecks(int frames) {
+    printf("Effect check: %dx%d matrix, %d frames\n", MATRIX_WIDTH, MATRIX_HEIGHT, frames);
+
+    srand(2);
+    for (int i = 0; i < VISUALIZATION_PALETTE_SIZE; i++) refPalette[i] = CRGB(rand() % 256, rand() % 256, rand() % 256);
+
+    static CRGB black[MATRIX_WIDTH * MATRIX_HEIGHT];
+    BarsEffect bars;
+    int differing = runEffectCheck(bars, refBars, black, frames);
+    differing += runHeatmapRampCheck();
+
+    // The swirl starts with the background in every position, the heatmap with the lowest level in every column
+    for (int i = 0; i < EFFECT_SPIRAL_SIZE; i++) refSwirlColors[i] = refPalette[0];
+    SwirlEffect swirl;
+    differing += runEffectCheck(swirl, refSwirl, black, frames);
+
+    static CRGB heatmapStart[MATRIX_WIDTH * MATRIX_HEIGHT];
+    for (int i = 0; i < EFFECT_RAMP_SIZE; i++) {
+        int segment = min(i * 4 / EFFECT_RAMP_SIZE, 3);
+        refHeatmapRamp[i] = blend(refPalette[segment], refPalette[segment + 1], i * 4 - segment * 255);
+    }
+    for (int i = 0; i < MATRIX_WIDTH * MATRIX_HEIGHT; i++) heatmapStart[i] = refHeatmapRamp[0];
+    HeatmapEffect heatmap;
+    differing += runEffectCheck(heatmap, refHeatmap, heatmapStart, frames);
+
+    return differing == 0 ? 0 : 1;
+}
+
+int main(int argc, char **argv) {
+    if (argc > 1 && strcmp(argv[1], "effects") == 0) return runEffectChecks(argc > 2 ? atoi(argv[2]) : 20000);
+
+    int frames = argc > 1 ? atoi(argv[1]) : 100;
+
+    setup();
+
+    printf("Native benchmark: %dx%d matrix, FFT_SAMPLES %d, TARGET_FPS %d, %d frames\n", MATRIX_WIDTH, MATRIX_HEIGHT, FFT_SAMPLES, TARGET_FPS, frames);
+
+    Transition::setDuration(0);
+    switchTo(MODE_ANI, 1);
+    runBenchmark("animation", frames, false);
+    runFrameDelay("animation frames", 20);
+
+    // Slow http requests: Every file system access takes 10 us
+    SPIFFS.latency = 10;
+    runBenchmark("animation + http", frames, true);
+
+    // Cycle switches open the next animation ahead, the previous one is opened at the switch
+    SPIFFS.latency = 100;
+    runSwitches("switch next", 1, 8);
+    runSwitches("switch prev", -1, 8);
+    SPIFFS.latency = 0;
+
+    switchTo(MODE_VIS, 0);
+    const char *visualizationNames[] = { "vis heatmap", "vis bars", "vis swirl" };
+    for (int i = 0; i < 3; i++) {
+        runBenchmark(visualizationNames[i], frames, false);
+        visualization.nextVis();
+    }
+
+    // Transitions that start with the run: The next animation, the next visualization and a change of the mode. Both
+    // sources are rendered until the transition is finished
+    const uint8_t transitionTypes[] = { TRANSITION_FADE, TRANSITION_WIPE, TRANSITION_DISSOLVE };
+    const unsigned int transitionModes[] = { MODE_ANI, MODE_VIS, MODE_VIS, MODE_ANI };
+    const char *transitionNames[] = { "vis -> ani", "ani -> ani", "ani -> vis", "vis -> vis" };
+    Transition::setDuration(TRANSITION_DURATION);
+    for (int i = 0; i < 4; i++) {
+        Transition::setType(transitionTypes[i % 3]);
+        requestSwitch(transitionModes[i], i == 1 || i == 3 ? 1 : 0, -1, false);
+        char name[32];
+        snprintf(name, sizeof(name), "%s %s", Transition::getTypeName(Transition::getType()), transitionNames[i]);
+        runBenchmark(name, TRANSITION_DURATION * TARGET_FPS / 1000, false);
+        while (Transition::isActive()) loop();
+    }
+    Transition::setDuration(0);
+
+    // Select a visualization by its name
+    unsigned long visRequests = webserver.requestsHandled;
+    webserver.mockRequest(HTTP_POST, "/api/visualizations", "swirl");
+    webserver.mockRequest(HTTP_GET, "/api/visualizations");
+    while (webserver.requestsHandled < visRequests + 2) loop();
+    printf("GET /api/visualizations: %s\n", webserver.lastContent.c_str());
+
+    webserver.mockRequest(HTTP_GET, "/api/visualizations/beat");
+    while (webserver.requestsHandled < visRequests + 3) loop();
+    printf("GET /api/visualizations/beat: %s\n", webserver.lastContent.c_str());
+
+    // A burst of palette changes (like dragging a color picker) is coalesced into a single settings write
+    unsigned long settingsRequests = webserver.requestsHandled;
+    unsigned long settingsWrites = SPIFFS.writes;
+    const int paletteChanges = 20;
+    for (int i = 0; i < paletteChanges; i++) {
+        char color[8];
+        snprintf(color, sizeof(color), "#%02X4020", i * 10);
+        webserver.mockRequest(HTTP_POST, "/api/visualizations/palette/1", color);
+    }
+    while (webserver.requestsHandled < settingsRequests + paletteChanges) loop();
+    unsigned long flushTime = millis() + SETTINGS_FLUSH_DELAY + 100;
+    while (millis() < flushTime) loop();
+    webserver.mockRequest(HTTP_GET, "/api/stats/settings");
+    while (webserver.requestsHandled < settingsRequests + paletteChanges + 1) loop();
+    printf("%d palette changes: %lu flash writes, GET /api/stats/settings: %s\n",
+        paletteChanges, SPIFFS.writes - settingsWrites, webserver.lastContent.c_str());
+
+    #ifdef PROFILER
+        // Cost of a single PROFILE_BEGIN / PROFILE_END pair
+        const int profileIterations = 1000000;
+        unsigned long profileStart = micros();
+        for (int i = 0; i < profileIterations; i++) {
+            PROFILE_BEGIN(SHOW)
+            PROFILE_END(SHOW)
+        }
+        printf("Profiler: %.1f ns per stage\n", (micros() - profileStart) * 1000.0 / profileIterations);
+        Profiler::reset();
+
+        // Serve the stats of a benchmark run like the firmware does
+        switchTo(MODE_ANI, 0);
+        runBenchmark("animation", frames, false);
+        webserver.mockRequest(HTTP_GET, "/api/stats");
+        unsigned long requests = webserver.requestsHandled;
+        while (webserver.requestsHandled == requests) loop();
+        printf("GET /api/stats: %s\n", webserver.lastContent.c_str());
+    #endif
+
+    // Uploads of a valid and of invalid gif files. Invalid ones must be rejected before they are written
+    File gifFile = SPIFFS.open(String(DIR_ANIMATIONS) + "/1.gif", "r");
+    if (gifFile) {
+        std::vector<uint8_t> gif(gifFile.size());
+        gifFile.read(gif.data(), gif.size());
+        gifFile.close();
+
+        std::vector<uint8_t> wrongSize = gif;
+        wrongSize[6]++;
+        std::vector<uint8_t> notGif = gif;
+        notGif[0] = 'X';
+        std::vector<uint8_t> truncated(gif.begin(), gif.begin() + gif.size() / 2);
+
+        switchTo(MODE_ANI, 0);
+        runUpload("upload wrong size", wrongSize);
+        runUpload("upload not gif", notGif);
+        runUpload("upload truncated", truncated);
+        runUpload("upload valid", gif);
+
+        // Deleting the first animation and uploading one into its slot moves the current one in the catalog, the
+        // playback must stay on it
+        while (animationIndex < 1) switchTo(MODE_ANI, 1);
+        String current = FileIO::getNthGifFileName(animationIndex);
+        unsigned long deleteRequests = webserver.requestsHandled;
+        webserver.mockRequest(HTTP_DELETE, "/api/animations/0");
+        while (webserver.requestsHandled == deleteRequests) loop();
+        String afterDelete = FileIO::getNthGifFileName(animationIndex);
+        runUpload("upload in front", gif);
+        printf("Catalog changes: playing %s, %s after deleting the first one, %s after an upload in front\n",
+            current.c_str(), afterDelete.c_str(), FileIO::getNthGifFileName(animationIndex).c_str());
+    }
+
+    // Configure the output stage over the api
+    unsigned long outputRequests = webserver.requestsHandled;
+    webserver.mockRequest(HTTP_POST, "/api/output/brightness", "200");
+    webserver.mockRequest(HTTP_POST, "/api/output/gamma", "2.5");
+    webserver.mockRequest(HTTP_GET, "/api/output");
+    while (webserver.requestsHandled < outputRequests + 3) loop();
+    printf("GET /api/output: %s\n", webserver.lastContent.c_str());
+
+    // The output settings are stored with the other settings. Read them back from the flash
+    SettingsStore::flush();
+    SettingsStore::StoredSettings storedDefaults;
+    memset(&storedDefaults, 0, sizeof(storedDefaults));
+    SettingsStore::begin(storedDefaults);
+    const SettingsStore::StoredSettings &stored = SettingsStore::get();
+    printf("Stored output settings: brightness %d, gamma %.2f, dithering %d, %lu mA\n",
+        stored.brightness, stored.gamma, stored.dithering, (unsigned long) stored.maxMilliamps);
+
+    // Cost of the output stage (gather, gamma, dithering and current estimate in one pass) on a gradient, and a white
+    // frame that exceeds the current budget
+    static CRGB frame[MATRIX_WIDTH * MATRIX_HEIGHT];
+    for (int i = 0; i < MATRIX_WIDTH * MATRIX_HEIGHT; i++) frame[i] = CRGB(i, 255 - i, i * 7);
+    const int outputIterations = 100000;
+    clock_t outputStart = clock();
+    for (int i = 0; i < outputIterations; i++) Output::present(frame);
+    double outputMicros = (double) (clock() - outputStart) * 1000000 / CLOCKS_PER_SEC / outputIterations;
+    printf("Output: %.2f us per frame, GET /api/stats/output: %s\n", outputMicros, Output::getStatsJson().c_str());
+
+    for (int i = 0; i < MATRIX_WIDTH * MATRIX_HEIGHT; i++) frame[i] = CRGB(255, 255, 255);
+    for (int i = 0; i < 3; i++) {
+        Output::present(frame);
+        printf("White frame %d: %s\n", i, Output::getStatsJson().c_str());
+    }
+
+    // A budget that only leaves a few mA for the leds must settle on one level instead of alternating between frames
+    Output::setMaxMilliamps(LED_IDLE_MILLIAMPS * MATRIX_WIDTH * MATRIX_HEIGHT + 5);
+    for (int i = 0; i < MATRIX_WIDTH * MATRIX_HEIGHT; i++) frame[i] = CRGB(i, 255 - i, i * 7);
+    String levels;
+    for (int i = 0; i < 16; i++) {
+        Output::present(frame);
+        String stats = Output::getStatsJson();
+        if (i >= 8) levels += stats.substring(stats.indexOf("\"level\":") + 8, stats.indexOf(",\"frames\"")) + " ";
+    }
+    printf("Small budget: levels %s%s\n", levels.c_str(), Output::getStatsJson().c_str());
+
+    // Neutral output stage for the layout check
+    Output::setBrightness(255);
+    Output::setGamma(1.0);
+    Output::setDithering(false);
+    Output::setMaxMilliamps(0);
+    Output::present(leds);
+
+    // The strip must hold the last pushed frame in the wired order
+    const LedLayout layout(MATRIX_WIDTH, MATRIX_HEIGHT, LAYOUT_TILE_WIDTH, LAYOUT_TILE_HEIGHT, LAYOUT_ROTATION, LAYOUT_FLAGS);
+    int misplaced = 0;
+    for (int i = 0; i < FastLED.numLeds; i++) {
+        if (FastLED.leds[i] != leds[layout.logicalIndex(i)]) misplaced++;
+    }
+    printf("Strip: %d leds, %s layout, %d misplaced\n",
+        FastLED.numLeds, Output::hasLayoutFile() ? "file" : "compiled", misplaced);
+
+    // A damaged catalog is rebuilt from the directory instead of being trusted
+    File catalogFile = SPIFFS.open(FILE_CATALOG, "r");
+    std::vector<uint8_t> catalog(catalogFile.size());
+    catalogFile.read(catalog.data(), catalog.size());
+    catalogFile.close();
+    const int catalogAnimations = FileIO::getNumGifFiles();
+    catalog[catalog.size() - 12] = 0xFF;
+    catalog[catalog.size() - 11] = 0xFF;
+    catalogFile = SPIFFS.open(FILE_CATALOG, "w");
+    catalogFile.write(catalog.data(), catalog.size());
+    catalogFile.close();
+    FileIO::init(DIR_ANIMATIONS);
+    printf("Damaged catalog: %d of %d animations after the rescan\n", FileIO::getNumGifFiles(), catalogAnimations);
+
+    #ifdef MIC_SAMPLER
+        printf("Microphone sampler: %.2f Hz rate, %.2f Hz measured, %lu of %lu samples repeated, %lu late\n",
+            MicSampler::getSampleRate(), MicSampler::getMeasuredSampleRate(), MicSampler::getRepeatedSamples(),
+            MicSampler::getSamples(), MicSampler::getLateSamples());
+    #endif
+
+    return 0;
+}
\ No newline at end of file
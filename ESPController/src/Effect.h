@@ -0,0 +1,60 @@
+#ifndef EFFECT_H
+#define EFFECT_H
+
+#include "Settings.h"
+#include <FastLED.h>
+
+// Palette colors: Background, colA, colB, colC, colD
+#define VISUALIZATION_PALETTE_SIZE  5
+
+// Inputs an effect can request. Only the inputs requested by the active effect are computed
+#define EFFECT_INPUT_WAVEFORM   0x01    // Microphone samples without the dc offset
+#define EFFECT_INPUT_SPECTRUM   0x02    // Smoothed level of MATRIX_WIDTH frequency bands
+#define EFFECT_INPUT_PEAK       0x04    // Band with the highest level. Implies the spectrum
+#define EFFECT_INPUT_BEAT       0x08    // Onsets and the tempo. Implies the spectrum
+
+// Levels are fixed point with EFFECT_LEVEL_MAX as full scale, so effects can scale them without floating point math
+#define EFFECT_LEVEL_SHIFT      15
+#define EFFECT_LEVEL_MAX        (1 << EFFECT_LEVEL_SHIFT)
+
+// Inputs of a single frame. Fields of inputs that weren't requested are undefined
+struct EffectInput {
+    const int16_t *waveform;    // Samples of the last capture, without the dc offset
+    int samples;                // Number of samples of the waveform and of the fft
+    const int32_t *spectrum;    // Level of every column (0 to EFFECT_LEVEL_MAX)
+    int peak;                   // Column of the peak
+    int32_t peakVal;            // Level of the peak (0 to EFFECT_LEVEL_MAX)
+    bool onset;                 // A beat started in this frame
+    float bpm;                  // Estimated tempo, 0 if unknown
+};
+
+
+/*
+ * Base class of the visualizations. Effects are registered by Visualization::addEffect() and selected by their name.
+ *
+ * init() is called when the effect is selected and allocates the state of the effect, teardown() releases it when the
+ * effect is deselected, so only the active effect takes up memory. setPalette() is called with the new palette before
+ * the next update() whenever a palette color changes. update() renders the next frame and returns true if any led was
+ * changed.
+ *
+ * fftSamples is the resolution of the spectrum the effect needs, it is capped at FFT_SAMPLES. Effects that only look at
+ * a few bands should ask for a small fft, it is only computed at that size.
+ */
+class Effect {
+    public:
+        const char *name;
+        uint8_t inputs;                 // EFFECT_INPUT_* flags
+        uint16_t fftSamples;            // Number of samples of the fft (a power of 2)
+
+        Effect(const char *name, uint8_t inputs, uint16_t fftSamples) : name(name), inputs(inputs), fftSamples(fftSamples) {}
+        virtual ~Effect() {}
+
+        // Allocates the state of the effect. Returns false if there is not enough memory
+        virtual bool init(const CRGB *palette) { return true; }
+        virtual void setPalette(const CRGB *palette) {}
+        virtual bool update(CRGB *leds, const EffectInput &input) = 0;
+        virtual void teardown() {}
+};
+
+
+#endif
\ No newline at end of file
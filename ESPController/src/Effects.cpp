@@ -0,0 +1,244 @@
+#include "Effects.h"
+#include <new>
+
+// Position in the row major framebuffer. The output reorders it for the wiring of the strip
+int toLedPos(int x, int y) {
+    return x + y * MATRIX_WIDTH;
+}
+
+// Sets a led and tells if its color changed
+inline bool setLed(CRGB &led, const CRGB &color) {
+    if (led == color) return false;
+    led = color;
+    return true;
+}
+
+// Scales a level to a blend amount
+inline fract8 levelToFract8(int32_t level) {
+    return (level * 255) >> EFFECT_LEVEL_SHIFT;
+}
+
+// Copies a run of colors to the leds and tells if any of them changed
+inline bool setLeds(CRGB *leds, const CRGB *colors, int count) {
+    if (memcmp(leds, colors, count * sizeof(CRGB)) == 0) return false;
+    memcpy(leds, colors, count * sizeof(CRGB));
+    return true;
+}
+
+
+/**************
+ *    BARS    *
+ **************/
+
+bool BarsEffect::init(const CRGB *palette) {
+    m_state = new (std::nothrow) State;
+    if (!m_state) return false;
+
+    setPalette(palette);
+    return true;
+}
+
+void BarsEffect::setPalette(const CRGB *palette) {
+    for (int i = 0; i < VISUALIZATION_PALETTE_SIZE; i++) m_state->palette[i] = palette[i];
+
+    // Gradient from color D to color C along x, blended to the gradient from color B to color A along y
+    for (int x = 0; x < MATRIX_WIDTH; x++) {
+        CRGB top = blend(palette[4], palette[3], x * 255 / (MATRIX_WIDTH - 1));
+        CRGB bottom = blend(palette[2], palette[1], x * 255 / (MATRIX_WIDTH - 1));
+
+        for (int y = 0; y < MATRIX_HEIGHT; y++) {
+            m_state->gradient[x + y * MATRIX_WIDTH] = blend(top, bottom, y * 255 / (MATRIX_HEIGHT - 1));
+        }
+    }
+}
+
+bool BarsEffect::update(CRGB *leds, const EffectInput &input) {
+    const CRGB background = m_state->palette[0];
+    bool changed = false;
+
+    for (int x = 0; x < MATRIX_WIDTH; x++) {
+        // Calc the threshold row and how much of it the bar covers
+        int32_t thresh_l = MATRIX_HEIGHT * (EFFECT_LEVEL_MAX - input.spectrum[x]);
+        int thresh = thresh_l >> EFFECT_LEVEL_SHIFT;
+        fract8 factor = levelToFract8(EFFECT_LEVEL_MAX - (thresh_l & (EFFECT_LEVEL_MAX - 1)));
+
+        for (int y = 0; y < MATRIX_HEIGHT; y++) {
+            CRGB color;
+            if (y > thresh) {
+                // Foreground
+                color = m_state->gradient[x + y * MATRIX_WIDTH];
+            } else if (y == thresh) {
+                // Blend
+                color = blend(background, m_state->gradient[x + y * MATRIX_WIDTH], factor);
+            } else {
+                // Background
+                color = background;
+            }
+            changed |= setLed(leds[x + y * MATRIX_WIDTH], color);
+        }
+    }
+
+    return changed;
+}
+
+void BarsEffect::teardown() {
+    delete m_state;
+    m_state = NULL;
+}
+
+
+/***************
+ *    SWIRL    *
+ ***************/
+
+bool SwirlEffect::init(const CRGB *palette) {
+    m_state = new (std::nothrow) State;
+    if (!m_state) return false;
+
+    setPalette(palette);
+    for (int i = 0; i < EFFECT_SPIRAL_SIZE; i++) m_state->colors[i] = m_state->palette[0];
+    m_state->head = 0;
+
+    // Walk the spiral once, it only depends on the matrix size
+    int wMax = MATRIX_WIDTH - 1;
+    int hMax = MATRIX_HEIGHT - 2;
+    int direction = 0;
+
+    int px = -1;
+    int py = 0;
+    int l = 0;
+
+    for (int i = 0; i < EFFECT_SPIRAL_SIZE; i++) {
+        if (direction == 0 && l > wMax) {
+            l = 0;
+            wMax--;
+            hMax--;
+            direction = 1;
+        } else if (direction == 1 && l > hMax) {
+            l = 0;
+            wMax--;
+            hMax--;
+            direction = 2;
+        } else if (direction == 2 && l > wMax) {
+            l = 0;
+            wMax--;
+            hMax--;
+            direction = 3;
+        } else if (direction == 3 && l > hMax) {
+            l = 0;
+            wMax--;
+            hMax--;
+            direction = 0;
+        }
+
+        if (direction == 0) px++;
+        if (direction == 1) py++;
+        if (direction == 2) px--;
+        if (direction == 3) py--;
+
+        m_state->spiral[i] = toLedPos(px, py);
+        l++;
+    }
+
+    return true;
+}
+
+void SwirlEffect::setPalette(const CRGB *palette) {
+    for (int i = 0; i < VISUALIZATION_PALETTE_SIZE; i++) m_state->palette[i] = palette[i];
+}
+
+bool SwirlEffect::update(CRGB *leds, const EffectInput &input) {
+    // Get the new color
+    const CRGB *palette = m_state->palette;
+    CRGB col = blend(
+        palette[0],
+        blend(
+            blend(
+                palette[1],
+                palette[2],
+                levelToFract8(input.spectrum[0])
+            ),
+            blend(
+                palette[3],
+                palette[4],
+                levelToFract8(input.spectrum[MATRIX_WIDTH / 2])
+            ),
+            levelToFract8(input.spectrum[MATRIX_WIDTH - 1])
+        ),
+        levelToFract8(input.peakVal)
+    );
+
+    // Write the new color at the head of the ring buffer
+    if (++m_state->head >= EFFECT_SPIRAL_SIZE) m_state->head = 0;
+    m_state->colors[m_state->head] = col;
+
+    // Walk the spiral from the outside in with the colors from the newest to the oldest. The second half of the
+    // matrix is the first one rotated by 180 degrees
+    bool changed = false;
+    int j = m_state->head;
+    for (int i = 0; i < EFFECT_SPIRAL_SIZE; i++) {
+        changed |= setLed(leds[m_state->spiral[i]], m_state->colors[j]);
+        changed |= setLed(leds[MATRIX_WIDTH * MATRIX_HEIGHT - 1 - m_state->spiral[i]], m_state->colors[j]);
+
+        if (--j < 0) j = EFFECT_SPIRAL_SIZE - 1;
+    }
+
+    return changed;
+}
+
+void SwirlEffect::teardown() {
+    delete m_state;
+    m_state = NULL;
+}
+
+
+/*****************
+ *    HEATMAP    *
+ *****************/
+
+bool HeatmapEffect::init(const CRGB *palette) {
+    m_state = new (std::nothrow) State;
+    if (!m_state) return false;
+
+    setPalette(palette);
+    for (int i = 0; i < MATRIX_WIDTH * MATRIX_HEIGHT; i++) m_state->colors[i] = m_state->ramp[0];
+    m_state->head = 0;
+    return true;
+}
+
+void HeatmapEffect::setPalette(const CRGB *palette) {
+    // Four equally long gradients from the background through colors A to D
+    for (int i = 0; i < EFFECT_RAMP_SIZE; i++) {
+        int segment = min(i * 4 / EFFECT_RAMP_SIZE, 3);
+        int amount = i * 4 * 255 / (EFFECT_RAMP_SIZE - 1) - segment * 255;
+        m_state->ramp[i] = blend(palette[segment], palette[segment + 1], amount);
+    }
+}
+
+bool HeatmapEffect::update(CRGB *leds, const EffectInput &input) {
+    // Write the new column at the head of the ring buffer. The rows are kept in the same order as the leds
+    if (++m_state->head >= MATRIX_WIDTH) m_state->head = 0;
+    for (int y = 0; y < MATRIX_HEIGHT; y++) {
+        int i = (input.spectrum[y * MATRIX_WIDTH / MATRIX_HEIGHT] * (EFFECT_RAMP_SIZE - 1)) >> EFFECT_LEVEL_SHIFT;
+        i = max(0, min(i, EFFECT_RAMP_SIZE - 1));
+        m_state->colors[m_state->head + y * MATRIX_WIDTH] = m_state->ramp[i];
+    }
+
+    // The oldest column (after the head) is on the left, the newest one on the right
+    bool changed = false;
+    int split = MATRIX_WIDTH - 1 - m_state->head;
+    for (int y = 0; y < MATRIX_HEIGHT; y++) {
+        CRGB *row = &leds[y * MATRIX_WIDTH];
+        const CRGB *history = &m_state->colors[y * MATRIX_WIDTH];
+
+        changed |= setLeds(row, &history[m_state->head + 1], split);
+        changed |= setLeds(&row[split], history, MATRIX_WIDTH - split);
+    }
+
+    return changed;
+}
+
+void HeatmapEffect::teardown() {
+    delete m_state;
+    m_state = NULL;
+}
\ No newline at end of file
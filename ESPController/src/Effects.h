@@ -0,0 +1,71 @@
+#ifndef EFFECTS_H
+#define EFFECTS_H
+
+#include "Effect.h"
+
+#define EFFECT_RAMP_SIZE            256
+#define EFFECT_SPIRAL_SIZE          (MATRIX_WIDTH * MATRIX_HEIGHT / 2)
+
+// The swirl only looks at three bands and the peak, a 16 sample fft is enough for that
+#define EFFECT_SWIRL_FFT_SAMPLES    16
+
+
+// BARS renders a spectrum style bargraph
+class BarsEffect : public Effect {
+    private:
+        struct State {
+            CRGB palette[VISUALIZATION_PALETTE_SIZE];
+            CRGB gradient[MATRIX_WIDTH * MATRIX_HEIGHT];    // Foreground color of every bar pixel
+        };
+        State *m_state;
+
+    public:
+        BarsEffect() : Effect("bars", EFFECT_INPUT_SPECTRUM, FFT_SAMPLES), m_state(NULL) {}
+
+        bool init(const CRGB *palette);
+        void setPalette(const CRGB *palette);
+        bool update(CRGB *leds, const EffectInput &input);
+        void teardown();
+};
+
+// SWIRL renders a rotating swirl with colors mapped to the spectrum and brightness mapped to the amplitude of the peak
+class SwirlEffect : public Effect {
+    private:
+        struct State {
+            CRGB palette[VISUALIZATION_PALETTE_SIZE];
+            CRGB colors[EFFECT_SPIRAL_SIZE];        // Ring buffer of the colors of the last frames
+            int head;                               // Index of the newest color
+            uint16_t spiral[EFFECT_SPIRAL_SIZE];    // Led index of every position of the swirl, from the outside in
+        };
+        State *m_state;
+
+    public:
+        SwirlEffect() : Effect("swirl", EFFECT_INPUT_SPECTRUM | EFFECT_INPUT_PEAK, EFFECT_SWIRL_FFT_SAMPLES), m_state(NULL) {}
+
+        bool init(const CRGB *palette);
+        void setPalette(const CRGB *palette);
+        bool update(CRGB *leds, const EffectInput &input);
+        void teardown();
+};
+
+// HEATMAP renders a spectrogram that scrolls from the right to the left
+class HeatmapEffect : public Effect {
+    private:
+        struct State {
+            CRGB ramp[EFFECT_RAMP_SIZE];                    // Colors for levels from 0 to 1
+            CRGB colors[MATRIX_WIDTH * MATRIX_HEIGHT];      // A ring buffer of columns in every row
+            int head;                                       // Column of the newest column
+        };
+        State *m_state;
+
+    public:
+        HeatmapEffect() : Effect("heatmap", EFFECT_INPUT_SPECTRUM, FFT_SAMPLES), m_state(NULL) {}
+
+        bool init(const CRGB *palette);
+        void setPalette(const CRGB *palette);
+        bool update(CRGB *leds, const EffectInput &input);
+        void teardown();
+};
+
+
+#endif
\ No newline at end of file
@@ -1,10 +1,202 @@
 #include "FileIO.h"
+#include "GifTranscoder.h"
+#include "GifValidator.h"
+#include "MAFDecoder.h"
+
+// "MAT4". Changed with the MAF version, so the catalog is rebuilt and outdated MAF files are transcoded again. A catalog
+// of an older layout fails the crc and is rebuilt as well
+#define CATALOG_MAGIC   0x3454414D
+
+namespace FileIO {
+    namespace {
+        // Callbacks of the gif transcoder
+        bool onTranscodeFileSeek(unsigned long position) {
+            return m_transcodeInFile.seek(position);
+        }
+
+        int onTranscodeFileReadBlock(void * buffer, int numberOfBytes) {
+            return m_transcodeInFile.read((uint8_t*) buffer, numberOfBytes);
+        }
+
+        int onTranscodeFileWriteBlock(const void * buffer, int numberOfBytes) {
+            return m_transcodeOutFile.write((const uint8_t*) buffer, numberOfBytes);
+        }
+
+        String getSlotFileName(uint16_t slot) {
+            return String(m_gifDirName) + "/" + slot + ".gif";
+        }
+
+        int getFileNameSlot(String gifFileName) {
+            // Get the slot from the "<dir>/<slot>.gif" file name. Returns -1 for other file names
+            String prefix = String(m_gifDirName) + "/";
+            if (!gifFileName.startsWith(prefix) || !gifFileName.endsWith(".gif")) return -1;
+
+            String number = gifFileName.substring(prefix.length(), gifFileName.length() - 4);
+            if (number.length() == 0) return -1;
+            for (unsigned int i = 0; i < number.length(); i++) {
+                if (!isDigit(number[i])) return -1;
+            }
+
+            int slot = number.toInt();
+            if (slot >= MAX_NUM_ANIMATIONS) return -1;
+            return slot;
+        }
+
+        bool readCatalogEntry(uint16_t slot, CatalogEntry *entry) {
+            File gifFile = SPIFFS.open(getSlotFileName(slot), "r");
+            if (!gifFile) return false;
+
+            // Run the whole file through the validator to get the size and the frame count
+            GifValidator validator = GifValidator(0, 0);
+            uint8_t buffer[256];
+            int length;
+            while ((length = gifFile.read(buffer, sizeof(buffer))) > 0) {
+                validator.push(buffer, length);
+                yield();
+            }
+            gifFile.close();
+            if (validator.finish() != GIF_TRANSCODER_OK) return false;
+
+            entry->slot = slot;
+            entry->width = validator.getWidth();
+            entry->height = validator.getHeight();
+            entry->frameCount = validator.getFrameCount();
+            entry->size = validator.getSize();
+            return true;
+        }
+
+        bool isMafFileCurrent(String mafFileName) {
+            // Missing and older MAF files are (re)transcoded. An empty one marks a gif that couldn't be transcoded, it
+            // isn't retried
+            File mafFile = SPIFFS.open(mafFileName, "r");
+            if (!mafFile) return false;
+            if (mafFile.size() == 0) return true;
+
+            uint8_t header[4];
+            return mafFile.read(header, 4) == 4 && isMafHeader(header);
+        }
+
+        void insertCatalogEntry(const CatalogEntry *entry) {
+            // Keep the catalog sorted by slot
+            int i = m_catalogSize;
+            while (i > 0 && m_catalog[i - 1].slot > entry->slot) {
+                m_catalog[i] = m_catalog[i - 1];
+                i--;
+            }
+            m_catalog[i] = *entry;
+            m_catalogSize++;
+        }
+
+        void initFreeSlots() {
+            // Push all unused slots in descending order, so the lowest one is on top of the stack
+            bool used[MAX_NUM_ANIMATIONS] = { false };
+            for (int i = 0; i < m_catalogSize; i++) {
+                if (m_catalog[i].slot < MAX_NUM_ANIMATIONS) used[m_catalog[i].slot] = true;
+            }
+
+            m_numFreeSlots = 0;
+            for (int slot = MAX_NUM_ANIMATIONS - 1; slot >= 0; slot--) {
+                if (!used[slot]) m_freeSlots[m_numFreeSlots++] = slot;
+            }
+        }
+
+        // Bitwise crc32 of the catalog entries (a table isn't worth the memory for a few hundred bytes)
+        uint32_t catalogCrc(int size) {
+            const uint8_t *data = (const uint8_t*) m_catalog;
+            uint32_t crc = 0xFFFFFFFF;
+            for (size_t i = 0; i < size * sizeof(CatalogEntry); i++) {
+                crc ^= data[i];
+                for (int j = 0; j < 8; j++) crc = (crc >> 1) ^ (0xEDB88320 & (0 - (crc & 1)));
+            }
+            return ~crc;
+        }
+
+        bool loadCatalog() {
+            File file = SPIFFS.open(FILE_CATALOG, "r");
+            if (!file) return false;
+
+            // Check the header: magic, number of entries and the crc of the entries
+            uint32_t header[3];
+            if (file.read((uint8_t*) header, sizeof(header)) != sizeof(header)) return false;
+            if (header[0] != CATALOG_MAGIC || header[1] > MAX_NUM_ANIMATIONS) return false;
+
+            // Read all entries at once
+            int size = header[1] * sizeof(CatalogEntry);
+            if ((int) file.read((uint8_t*) m_catalog, size) != size || catalogCrc(header[1]) != header[2]) {
+                WARN("The animation catalog is damaged")
+                return false;
+            }
+
+            // The slots must be valid and sorted without duplicates
+            for (uint32_t i = 0; i < header[1]; i++) {
+                if (m_catalog[i].slot >= MAX_NUM_ANIMATIONS || (i > 0 && m_catalog[i].slot <= m_catalog[i - 1].slot)) {
+                    WARN("The animation catalog has invalid slots")
+                    return false;
+                }
+            }
+            m_catalogSize = header[1];
+
+            return true;
+        }
+
+        void saveCatalog() {
+            File file = SPIFFS.open(FILE_CATALOG, "w");
+            if (!file) {
+                WARN("Could not save the animation catalog")
+                return;
+            }
+
+            uint32_t header[3] = { CATALOG_MAGIC, (uint32_t) m_catalogSize, catalogCrc(m_catalogSize) };
+            file.write((const uint8_t*) header, sizeof(header));
+            file.write((const uint8_t*) m_catalog, m_catalogSize * sizeof(CatalogEntry));
+            file.close();
+        }
+
+        void scanCatalog() {
+            // Scan the directory once
+            m_catalogSize = 0;
+            Dir gifDir = SPIFFS.openDir(m_gifDirName);
+            while (gifDir.next()) {
+                int slot = getFileNameSlot(gifDir.fileName());
+                if (slot < 0) continue;
+
+                CatalogEntry entry = {};
+                entry.slot = slot;
+                insertCatalogEntry(&entry);
+            }
+
+            // Transcode all gif files which weren't uploaded via the webserver (e.g. from the SPIFFS image) or were
+            // transcoded by an older version and read the animation info. Files that can't be read are left out. After a
+            // version change every file is transcoded, so yield to the system between the files to feed the watchdog
+            int size = 0;
+            for (int i = 0; i < m_catalogSize; i++) {
+                yield();
+                String fileName = getSlotFileName(m_catalog[i].slot);
+                if (!isMafFileCurrent(getMafFileName(fileName))) transcodeGifFile(fileName);
+                if (readCatalogEntry(m_catalog[i].slot, &m_catalog[size])) {
+                    size++;
+                } else {
+                    WARN("Could not read gif file, it is left out of the catalog")
+                }
+            }
+            m_catalogSize = size;
+        }
+
+        void openMafFile(String gifFileName) {
+            // Open the transcoded file of the current gif if there is one
+            if (m_mafFiles[m_slot]) m_mafFiles[m_slot].close();
+
+            String mafFileName = getMafFileName(gifFileName);
+            if (SPIFFS.exists(mafFileName)) m_mafFiles[m_slot] = SPIFFS.open(mafFileName, "r");
+        }
+    }
+}
 
 void FileIO::init(const char* gifDirName) {
-    // Set the gif directory name and open the dir
+    // Set the gif directory name
     m_gifDirName = gifDirName;
-    m_gifDir = SPIFFS.openDir(m_gifDirName);
-    m_gifFileId = 0;
+    m_slot = 0;
+    for (int i = 0; i < FILE_IO_SLOTS; i++) m_gifFileIds[i] = 0;
 
     // Mount SPIFFS
     if (SPIFFS.begin()) {
@@ -12,85 +204,206 @@ void FileIO::init(const char* gifDirName) {
     } else {
         FATAL("SPIFFS could not be mounted");
     }
+
+    // Load the animation catalog. If there is none, build it from the directory
+    m_catalogSize = 0;
+    if (loadCatalog()) {
+        DEBUGF("Loaded catalog with %d animations\n", m_catalogSize)
+    } else {
+        scanCatalog();
+        saveCatalog();
+        DEBUGF("Created catalog with %d animations\n", m_catalogSize)
+    }
+    initFreeSlots();
+}
+
+void FileIO::selectSlot(int slot) {
+    m_slot = slot;
+}
+
+int FileIO::getSlot() {
+    return m_slot;
 }
 
 bool FileIO::onGifFileSeek(unsigned long position) {
-    if (!m_gifFile) return false;
-    return m_gifFile.seek(position);
+    if (!m_gifFiles[m_slot]) return false;
+    return m_gifFiles[m_slot].seek(position);
 }
 
 unsigned long FileIO::onGifFilePosition(void) {
-    if (!m_gifFile) return -1;
-    return m_gifFile.position();
+    if (!m_gifFiles[m_slot]) return -1;
+    return m_gifFiles[m_slot].position();
 }
 
 int FileIO::onGifFileRead(void) {
-    if (!m_gifFile) return 0;
-    return m_gifFile.read();
+    if (!m_gifFiles[m_slot]) return 0;
+    return m_gifFiles[m_slot].read();
 }
 
 int FileIO::onGifFileReadBlock(void * buffer, int numberOfBytes) {
-    if (!m_gifFile) return 0;
-    return m_gifFile.read((uint8_t*) buffer, numberOfBytes);
+    if (!m_gifFiles[m_slot]) return 0;
+    return m_gifFiles[m_slot].read((uint8_t*) buffer, numberOfBytes);
 }
 
-void FileIO::nextGifFile() {
-    // Close the old file
-    if (m_gifFile) m_gifFile.close();
+bool FileIO::onMafFileSeek(unsigned long position) {
+    if (!m_mafFiles[m_slot]) return false;
+    return m_mafFiles[m_slot].seek(position);
+}
 
-    // Get the next gif file id
-    m_gifFileId++;
-    if (m_gifFileId >= FileIO::getNumGifFiles()) m_gifFileId = 0;
+int FileIO::onMafFileRead(void) {
+    if (!m_mafFiles[m_slot]) return 0;
+    return m_mafFiles[m_slot].read();
+}
 
-    // Open the file
-    String fileName = getNthGifFileName(m_gifFileId);
-    m_gifFile = SPIFFS.open(fileName, "r");
-    if (!m_gifFile) {
-        WARN("Could not open next Gif file")
-        return;
-    }
+int FileIO::onMafFileReadBlock(void * buffer, int numberOfBytes) {
+    if (!m_mafFiles[m_slot]) return 0;
+    return m_mafFiles[m_slot].read((uint8_t*) buffer, numberOfBytes);
+}
+
+bool FileIO::hasMafFile() {
+    // An empty maf file marks a gif that couldn't be transcoded
+    return m_mafFiles[m_slot] && m_mafFiles[m_slot].size() > 0;
 }
 
-void FileIO::prevGifFile() {
-    // Close the old file
-    if (m_gifFile) m_gifFile.close();
+bool FileIO::openGifFile(int n) {
+    closeGifFile();
+    if (m_catalogSize == 0) return false;
 
-    // Get the next gif file id
-    m_gifFileId--;
-    if (m_gifFileId < 0) m_gifFileId = FileIO::getNumGifFiles() - 1;
+    // Wrap the id around
+    n %= m_catalogSize;
+    if (n < 0) n += m_catalogSize;
+    m_gifFileIds[m_slot] = n;
 
     // Open the file
-    String fileName = getNthGifFileName(m_gifFileId);
-    m_gifFile = SPIFFS.open(fileName, "r");
-    if (!m_gifFile) {
-        WARN("Could not open previous Gif file")
-        return;
+    String fileName = getNthGifFileName(n);
+    m_gifFiles[m_slot] = SPIFFS.open(fileName, "r");
+    if (!m_gifFiles[m_slot]) {
+        WARN("Could not open Gif file")
+        return false;
     }
+    openMafFile(fileName);
+    return true;
+}
+
+void FileIO::closeGifFile() {
+    if (m_gifFiles[m_slot]) m_gifFiles[m_slot].close();
+    if (m_mafFiles[m_slot]) m_mafFiles[m_slot].close();
+}
+
+int FileIO::getGifFileId() {
+    return m_gifFileIds[m_slot];
 }
 
 String FileIO::getNthGifFileName(int n) {
     // Return empty string if n is invalid
-    if (n < 0) return "";
-
-    // Prepare a directory with index counter
-    int i = 0;
-    Dir gifDir = SPIFFS.openDir(m_gifDirName);
+    if (n < 0 || n >= m_catalogSize) return "";
+    return getSlotFileName(m_catalog[n].slot);
+}
 
-    // Iterate through all files. Return at the correct index
-    while (gifDir.next()) {
-        if (i == n) return gifDir.fileName();
-        i++;
+int FileIO::getGifFileIndex(String gifFileName) {
+    int slot = getFileNameSlot(gifFileName);
+    for (int i = 0; i < m_catalogSize; i++) {
+        if (m_catalog[i].slot == slot) return i;
     }
-
-    // No matching file found. Return empty string
-    return "";
+    return -1;
 }
 
 int FileIO::getNumGifFiles() {
-    int i = 0;
-    Dir gifDir = SPIFFS.openDir(m_gifDirName);
+    return m_catalogSize;
+}
+
+String FileIO::getFreeGifFileName() {
+    // Return empty string if all slots are used
+    if (m_numFreeSlots == 0) return "";
+    return getSlotFileName(m_freeSlots[m_numFreeSlots - 1]);
+}
+
+bool FileIO::addGifFile(String gifFileName, uint16_t width, uint16_t height, uint16_t frameCount, uint32_t size) {
+    int slot = getFileNameSlot(gifFileName);
+    if (slot < 0) return false;
+
+    // Transcode the file. The animation info was collected during the upload, so the file isn't read again for it
+    transcodeGifFile(gifFileName);
+
+    CatalogEntry entry = {};
+    entry.slot = slot;
+    entry.width = width;
+    entry.height = height;
+    entry.frameCount = frameCount;
+    entry.size = size;
+
+    // Remove the slot from the free slots. Uploads always use the top one
+    int i = m_numFreeSlots - 1;
+    while (i >= 0 && m_freeSlots[i] != slot) i--;
+    if (i < 0) return false;
+    m_numFreeSlots--;
+    for (; i < m_numFreeSlots; i++) m_freeSlots[i] = m_freeSlots[i + 1];
+
+    insertCatalogEntry(&entry);
+    saveCatalog();
+    return true;
+}
+
+bool FileIO::removeGifFile(int n) {
+    if (n < 0 || n >= m_catalogSize) return false;
+
+    // Remove the gif and the transcoded file
+    String gifFileName = getNthGifFileName(n);
+    if (!SPIFFS.remove(gifFileName)) return false;
+    SPIFFS.remove(getMafFileName(gifFileName));
+
+    // Update the catalog and free the slot
+    m_freeSlots[m_numFreeSlots++] = m_catalog[n].slot;
+    m_catalogSize--;
+    for (int i = n; i < m_catalogSize; i++) m_catalog[i] = m_catalog[i + 1];
+    saveCatalog();
+
+    return true;
+}
+
+String FileIO::getMafFileName(String gifFileName) {
+    // The transcoded file is stored next to the gif file
+    return gifFileName.substring(0, gifFileName.length() - 4) + ".maf";
+}
+
+bool FileIO::transcodeGifFile(String gifFileName) {
+    String mafFileName = getMafFileName(gifFileName);
+
+    // Open the gif and the maf file
+    m_transcodeInFile = SPIFFS.open(gifFileName, "r");
+    if (!m_transcodeInFile) {
+        WARN("Could not open Gif file for transcoding")
+        return false;
+    }
+    m_transcodeOutFile = SPIFFS.open(mafFileName, "w");
+    if (!m_transcodeOutFile) {
+        WARN("Could not create Maf file")
+        m_transcodeInFile.close();
+        return false;
+    }
+
+    // Transcode the file. The transcoder allocates its buffers on the heap, so create it there as well. It yields to
+    // the system (and feeds the watchdog) before every pass and after every frame, as a large file takes seconds
+    GifTranscoder *transcoder = new GifTranscoder(MATRIX_WIDTH, MATRIX_HEIGHT);
+    transcoder->setFileSeekCallback(onTranscodeFileSeek);
+    transcoder->setFileReadBlockCallback(onTranscodeFileReadBlock);
+    transcoder->setFileWriteBlockCallback(onTranscodeFileWriteBlock);
+    transcoder->setYieldCallback(yield);
+    int result = transcoder->transcode();
+    delete transcoder;
+
+    m_transcodeInFile.close();
+    m_transcodeOutFile.close();
+
+    if (result != GIF_TRANSCODER_OK) {
+        DEBUGF("Could not transcode %s (error %d), it will be played back as gif\n", gifFileName.c_str(), result)
+
+        // Leave an empty file, so the transcoding isn't retried on every boot
+        m_transcodeOutFile = SPIFFS.open(mafFileName, "w");
+        m_transcodeOutFile.close();
+        return false;
+    }
 
-    // Count the number of files and return
-    while (gifDir.next()) i++;
-    return i;
+    DEBUGF("Transcoded %s\n", gifFileName.c_str())
+    return true;
 }
\ No newline at end of file
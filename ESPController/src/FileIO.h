@@ -4,29 +4,72 @@
 #include <FS.h>
 #include "Log.h"
 
+// Number of animations that can be open at the same time (the outgoing and the incoming one of a transition)
+#define FILE_IO_SLOTS   2
+
 
 namespace FileIO {
+    // Catalog entry of a single animation. The file name is derived from the slot ("<dir>/<slot>.gif")
+    struct CatalogEntry {
+        uint16_t slot;
+        uint16_t width;
+        uint16_t height;
+        uint16_t frameCount;            // Number of frames
+        uint32_t size;                  // Size of the gif file in bytes
+    };
+
     // Private anonymous namespace
     namespace {
         const char* m_gifDirName;
 
-        Dir m_gifDir;
-        File m_gifFile;
-        int m_gifFileId;
+        // Catalog of all animations, sorted by slot, and a stack of the unused slots
+        CatalogEntry m_catalog[MAX_NUM_ANIMATIONS];
+        int m_catalogSize;
+        uint16_t m_freeSlots[MAX_NUM_ANIMATIONS];
+        int m_numFreeSlots;
+
+        // Open files of every slot. The file callbacks read from the selected slot
+        File m_gifFiles[FILE_IO_SLOTS];
+        File m_mafFiles[FILE_IO_SLOTS];
+        int m_gifFileIds[FILE_IO_SLOTS];
+        int m_slot;
+
+        File m_transcodeInFile;
+        File m_transcodeOutFile;
     }
 
     void init(const char* gifDirName);
 
+    // Selects the slot the file callbacks read from and openGifFile() opens the animation in
+    void selectSlot(int slot);
+    int getSlot();
+
     bool onGifFileSeek(unsigned long position);
     unsigned long onGifFilePosition(void);
     int onGifFileRead(void);
     int onGifFileReadBlock(void * buffer, int numberOfBytes);
 
-    void nextGifFile();
-    void prevGifFile();
+    bool onMafFileSeek(unsigned long position);
+    int onMafFileRead(void);
+    int onMafFileReadBlock(void * buffer, int numberOfBytes);
+    bool hasMafFile();
+
+    // Opens the nth animation (wrapped around) in the selected slot. Returns false if it couldn't be opened
+    bool openGifFile(int n);
+    void closeGifFile();
+    int getGifFileId();
 
     int getNumGifFiles();
     String getNthGifFileName(int n);
+    // Position of the gif file in the catalog, -1 if it isn't in there
+    int getGifFileIndex(String gifFileName);
+
+    String getFreeGifFileName();
+    bool addGifFile(String gifFileName, uint16_t width, uint16_t height, uint16_t frameCount, uint32_t size);
+    bool removeGifFile(int n);
+
+    String getMafFileName(String gifFileName);
+    bool transcodeGifFile(String gifFileName);
 }
 
 #endif
\ No newline at end of file
@@ -0,0 +1,128 @@
+#include "MicSampler.h"
+#include "Log.h"
+
+namespace MicSampler {
+    namespace {
+        bool m_running;
+        uint32_t m_period;                  // Sample period in us
+        unsigned long m_deadline;           // Time of the next sample
+        unsigned long m_lastSample;         // Time of the last sample, 0 before the first one
+
+        int16_t m_buffers[2][FFT_SAMPLES];
+        int m_size;                         // Samples per buffer, 0 until the first read
+        int m_writing;                      // Buffer that is filled, the other one holds the completed samples
+        int m_count;                        // Samples in the buffer that is filled
+        bool m_ready;                       // The completed buffer wasn't read yet
+        int16_t m_previous;
+
+        // Statistics. Halved together once they get large, so they don't wrap
+        unsigned long m_samples;
+        unsigned long m_repeatedSamples;
+        unsigned long m_lateSamples;
+        unsigned long m_intervals;          // Number of sample intervals in m_intervalMicros
+        unsigned long m_intervalMicros;
+    }
+
+    void begin(uint32_t sampleRate) {
+        if (m_running || sampleRate == 0) return;
+
+        m_period = 1000000UL / sampleRate;
+        if (m_period == 0) m_period = 1;
+        m_deadline = micros();
+        m_lastSample = 0;
+        m_count = 0;
+        m_ready = false;
+        m_previous = -1;
+        m_running = true;
+
+        DEBUGF("Microphone sampling at %.2f Hz\n", getSampleRate())
+    }
+
+    void end(void) {
+        m_running = false;
+        m_count = 0;
+        m_ready = false;
+    }
+
+    bool isRunning(void) {
+        return m_running;
+    }
+
+    void sample(void) {
+        if (!m_running || m_size == 0) return;
+
+        unsigned long now = micros();
+        long late = (long) (now - m_deadline);
+        if (late < 0) return;
+
+        // Don't catch up with a burst of samples, pace the next ones from this one
+        if (late >= (long) m_period) {
+            m_lateSamples++;
+            m_deadline = now;
+        }
+        m_deadline += m_period;
+
+        int16_t value = analogRead(PIN_MICROPHONE);
+
+        if (m_samples > 0x40000000UL || m_intervalMicros > 0x40000000UL) {
+            m_samples /= 2;
+            m_repeatedSamples /= 2;
+            m_lateSamples /= 2;
+            m_intervals /= 2;
+            m_intervalMicros /= 2;
+        }
+        m_samples++;
+        if (value == m_previous) m_repeatedSamples++;
+        if (m_lastSample != 0) {
+            m_intervals++;
+            m_intervalMicros += now - m_lastSample;
+        }
+        m_previous = value;
+        m_lastSample = now;
+
+        // Swap the buffers once the one that is filled is complete
+        m_buffers[m_writing][m_count++] = value;
+        if (m_count >= m_size) {
+            m_writing ^= 1;
+            m_count = 0;
+            m_ready = true;
+        }
+    }
+
+    bool read(int16_t *samples, int n) {
+        n = min(n, FFT_SAMPLES);
+        if (n != m_size) {
+            m_size = n;
+            m_count = 0;
+            m_ready = false;
+            return false;
+        }
+        if (!m_ready) return false;
+
+        memcpy(samples, m_buffers[m_writing ^ 1], n * sizeof(int16_t));
+        m_ready = false;
+        return true;
+    }
+
+    double getSampleRate(void) {
+        if (m_period == 0) return 0;
+        return 1000000.0 / m_period;
+    }
+
+    double getMeasuredSampleRate(void) {
+        if (m_intervalMicros == 0) return 0;
+        return m_intervals * 1000000.0 / m_intervalMicros;
+    }
+
+    unsigned long getSamples(void) {
+        return m_samples;
+    }
+
+    unsigned long getRepeatedSamples(void) {
+        return m_repeatedSamples;
+    }
+
+    unsigned long getLateSamples(void) {
+        return m_lateSamples;
+    }
+}
@@ -0,0 +1,47 @@
+#ifndef MIC_SAMPLER_H
+#define MIC_SAMPLER_H
+
+#include "Settings.h"
+#include <Arduino.h>
+
+
+/*
+ * Samples the microphone at a fixed rate without blocking the frame. sample() takes at most one sample per call when its
+ * micros() deadline has passed and is called by a background task on every pass of the scheduler. The samples are
+ * collected in a double buffer: once a buffer is full, the next one is filled while read() hands out the completed one,
+ * so the fft only runs on a complete set of samples. analogRead() is not safe to call from an interrupt (it runs from
+ * the flash, which is unavailable during SPIFFS writes), so there is no timer interrupt involved.
+ *
+ * A sample that is due while a frame task or another background task runs is taken late, the following ones are
+ * paced from it. Such samples are counted by getLateSamples(). With WiFi on, the SDK returns the previous conversion
+ * while the radio uses the ADC, so above a few kHz some samples are repeated. They are counted, the usable rate is the
+ * one at which getRepeatedSamples() stays close to 0.
+ */
+namespace MicSampler {
+    // Starts sampling at the sample rate in Hz. Does nothing if the sampler is already running
+    void begin(uint32_t sampleRate);
+    // Stops sampling and drops the collected samples
+    void end(void);
+    bool isRunning(void);
+
+    // Takes the next sample if it is due. Returns immediately if the sampler isn't running
+    void sample(void);
+
+    // Copies the newest completed buffer of n samples (at most FFT_SAMPLES) and returns true, or returns false if no
+    // buffer was completed since the last read. Changing n starts a new buffer of that size
+    bool read(int16_t *samples, int n);
+
+    // Sample rate (the requested one rounded to whole microseconds) and the rate that was actually measured between
+    // consecutive samples
+    double getSampleRate(void);
+    double getMeasuredSampleRate(void);
+
+    // Number of samples, of samples that had the same value as the previous one and of samples that were taken more
+    // than a sample period late
+    unsigned long getSamples(void);
+    unsigned long getRepeatedSamples(void);
+    unsigned long getLateSamples(void);
+}
+
+
+#endif
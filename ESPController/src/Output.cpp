@@ -0,0 +1,269 @@
+#include "Output.h"
+#include "Log.h"
+#include <FS.h>
+#include <LedLayout.h>
+
+namespace Output {
+    namespace {
+        constexpr LedLayout m_layout(MATRIX_WIDTH, MATRIX_HEIGHT, LAYOUT_TILE_WIDTH, LAYOUT_TILE_HEIGHT, LAYOUT_ROTATION, LAYOUT_FLAGS);
+        static_assert(m_layout.isValid(), "The layout tiles must fill the matrix");
+
+        uint16_t m_order[OUTPUT_NUM_LEDS];  // Framebuffer position of every led of the strip
+        CRGB m_strip[OUTPUT_NUM_LEDS];      // Front buffer: The colors of the strip in the wired order
+        bool m_layoutFile;
+
+        // Rounding offsets of the dithering: a bit reversed frame counter, so every fraction of 1 / 8 is rounded up on
+        // that many frames spread over the 8 frames
+        const uint8_t m_ditherOffsets[8] = { 16, 144, 80, 208, 48, 176, 112, 240 };
+
+        uint8_t m_brightness;
+        uint8_t m_level;                    // Brightness the level tables were built for, lowered by the current limit
+        float m_gamma;
+        uint32_t m_correction;
+        bool m_dithering;
+        uint32_t m_maxMilliamps;
+
+        uint16_t m_gammaTable[256];         // Gamma curve in 8.8 fixed point
+        uint16_t m_levels[3][256];          // Output level of every channel value in 8.8 fixed point
+        bool m_identityLevels;              // Every value is its own level, the lookup can be skipped
+        bool m_fraction;                    // The last frame had levels between two output values
+        bool m_ditherChanges;               // A led of the last frame changes with the offset of the dithering
+        uint8_t m_frame;
+
+        // Statistics
+        uint32_t m_milliamps;
+        unsigned long m_frames;
+        unsigned long m_limitedFrames;
+        unsigned long m_totalMicros;
+        unsigned long m_maxMicros;
+
+        void buildLevels() {
+            // Scale of every channel from the correction and the brightness, 255 * 255 is full scale
+            const uint32_t scales[3] = {
+                ((m_correction >> 16) & 0xFF) * (uint32_t) m_level,
+                ((m_correction >> 8) & 0xFF) * (uint32_t) m_level,
+                (m_correction & 0xFF) * (uint32_t) m_level
+            };
+
+            m_identityLevels = true;
+            for (int c = 0; c < 3; c++) {
+                for (int i = 0; i < 256; i++) {
+                    m_levels[c][i] = m_gammaTable[i] * scales[c] / (255 * 255);
+                    if (m_levels[c][i] != i << 8) m_identityLevels = false;
+                }
+            }
+        }
+
+        void buildGammaTable() {
+            for (int i = 0; i < 256; i++) m_gammaTable[i] = (uint16_t) (pow(i / 255.0, m_gamma) * (255 << 8) + 0.5);
+            buildLevels();
+        }
+
+        // levelSum is the sum of the channel levels before the rounding (8.8 fixed point), channelSum the sum of the
+        // rounded channels that are pushed
+        void limitCurrent(uint32_t levelSum, uint32_t channelSum) {
+            const uint32_t idleMilliamps = (uint32_t) LED_IDLE_MILLIAMPS * OUTPUT_NUM_LEDS;
+            uint32_t channelMilliamps = channelSum * LED_MILLIAMPS_PER_CHANNEL / 255;
+
+            uint8_t level = m_brightness;
+            if (m_maxMilliamps > 0) {
+                const uint32_t available = m_maxMilliamps > idleMilliamps ? m_maxMilliamps - idleMilliamps : 0;
+
+                // The estimate is taken before the rounding, so it doesn't change with the dithering from frame to
+                // frame. The dithering may round every channel up by one, which is kept as a margin
+                const uint32_t margin = m_dithering && m_fraction ? 3 * OUTPUT_NUM_LEDS : 0;
+                const uint32_t worstMilliamps = ((levelSum >> 8) + margin) * LED_MILLIAMPS_PER_CHANNEL / 255;
+
+                // The current is proportional to the level, so the next frame starts with the one that just fits. A
+                // frame that is black at the current level tells nothing, it keeps the level. The level stays at least
+                // 1 unless there is no current left for the leds, as a black frame at level 0 would allow any level
+                if (worstMilliamps > 0) {
+                    const uint32_t allowed = m_level * available / worstMilliamps;
+                    if (allowed < level) level = allowed;
+                } else if (m_level < level) {
+                    level = m_level;
+                }
+                if (available == 0) {
+                    level = 0;
+                } else if (level == 0 && m_brightness > 0) {
+                    level = 1;
+                }
+
+                // Scale the frame down if the level of the last frame was too high for this one
+                if (worstMilliamps > available) {
+                    uint8_t scale = available * 255 / worstMilliamps;
+                    if (scale < 1 && available > 0) scale = 1;
+                    for (int i = 0; i < OUTPUT_NUM_LEDS; i++) m_strip[i].nscale8(scale);
+                    channelMilliamps = channelMilliamps * scale / 255;
+                    m_limitedFrames++;
+                }
+            }
+            m_milliamps = idleMilliamps + channelMilliamps;
+
+            if (level != m_level) {
+                m_level = level;
+                buildLevels();
+            }
+        }
+
+        bool loadLayoutFile() {
+            File file = SPIFFS.open(FILE_LAYOUT, "r");
+            if (!file) return false;
+
+            bool complete = file.size() == sizeof(m_order)
+                && file.read((uint8_t*) m_order, sizeof(m_order)) == sizeof(m_order);
+            file.close();
+            if (!complete) {
+                WARN("The layout file doesn't match the matrix size")
+                return false;
+            }
+
+            // Every framebuffer position must be used exactly once
+            uint8_t used[(OUTPUT_NUM_LEDS + 7) / 8];
+            memset(used, 0, sizeof(used));
+            for (int i = 0; i < OUTPUT_NUM_LEDS; i++) {
+                uint16_t index = m_order[i];
+                if (index >= OUTPUT_NUM_LEDS || used[index / 8] & (1 << (index % 8))) {
+                    WARN("The layout file has invalid or duplicate leds")
+                    return false;
+                }
+                used[index / 8] |= 1 << (index % 8);
+            }
+
+            return true;
+        }
+    }
+
+    void begin(void) {
+        FastLED.addLeds<WS2812B, PIN_LEDS, LED_COLOR_ORDER>(m_strip, OUTPUT_NUM_LEDS);
+        FastLED.setBrightness(255);
+
+        m_brightness = 255;
+        m_level = 255;
+        m_correction = LED_CORRECTION;
+        m_dithering = LED_DITHERING;
+        m_maxMilliamps = LED_MAX_MILLIAMPS;
+        setGamma(LED_GAMMA);
+
+        m_layoutFile = loadLayoutFile();
+        if (m_layoutFile) {
+            DEBUGLN("Loaded the led layout from " FILE_LAYOUT)
+        } else {
+            m_layout.build(m_order);
+        }
+    }
+
+    void present(const CRGB *leds) {
+        unsigned long start = micros();
+        uint32_t levelSum = 0;
+        uint32_t channelSum = 0;
+
+        if (m_identityLevels) {
+            for (int i = 0; i < OUTPUT_NUM_LEDS; i++) {
+                const CRGB &color = leds[m_order[i]];
+                m_strip[i] = color;
+                channelSum += color.r + color.g + color.b;
+            }
+            levelSum = channelSum << 8;
+            m_fraction = false;
+            m_ditherChanges = false;
+        } else {
+            // Without dithering, the levels are rounded to the nearest output value
+            const uint16_t offset = m_dithering ? m_ditherOffsets[m_frame++ & 7] : 128;
+            uint16_t fraction = 0;
+            bool changes = false;
+
+            for (int i = 0; i < OUTPUT_NUM_LEDS; i++) {
+                const CRGB &color = leds[m_order[i]];
+                const uint16_t r = m_levels[0][color.r];
+                const uint16_t g = m_levels[1][color.g];
+                const uint16_t b = m_levels[2][color.b];
+                fraction |= r | g | b;
+
+                // Fractions below the smallest or above the largest offset are rounded the same way on every frame
+                changes |= (uint8_t) (r - m_ditherOffsets[0]) < 224 || (uint8_t) (g - m_ditherOffsets[0]) < 224
+                    || (uint8_t) (b - m_ditherOffsets[0]) < 224;
+                levelSum += r + g + b;
+
+                m_strip[i].r = (r + offset) >> 8;
+                m_strip[i].g = (g + offset) >> 8;
+                m_strip[i].b = (b + offset) >> 8;
+                channelSum += m_strip[i].r + m_strip[i].g + m_strip[i].b;
+            }
+            m_fraction = (fraction & 0xFF) != 0;
+            m_ditherChanges = m_dithering && changes;
+        }
+        limitCurrent(levelSum, channelSum);
+
+        unsigned long duration = micros() - start;
+        m_frames++;
+        m_totalMicros += duration;
+        if (duration > m_maxMicros) m_maxMicros = duration;
+
+        FastLED.show();
+    }
+
+    void setBrightness(uint8_t brightness) {
+        // The current limit of the next frame starts from the new brightness
+        m_brightness = brightness;
+        m_level = brightness;
+        buildLevels();
+    }
+
+    uint8_t getBrightness(void) {
+        return m_brightness;
+    }
+
+    void setGamma(float gamma) {
+        m_gamma = gamma;
+        buildGammaTable();
+    }
+
+    float getGamma(void) {
+        return m_gamma;
+    }
+
+    void setCorrection(uint32_t correction) {
+        m_correction = correction;
+        buildLevels();
+    }
+
+    uint32_t getCorrection(void) {
+        return m_correction;
+    }
+
+    void setDithering(bool dithering) {
+        m_dithering = dithering;
+    }
+
+    bool getDithering(void) {
+        return m_dithering;
+    }
+
+    bool isDithering(void) {
+        return m_dithering && m_ditherChanges;
+    }
+
+    void setMaxMilliamps(uint32_t milliamps) {
+        m_maxMilliamps = milliamps;
+        m_level = m_brightness;
+        buildLevels();
+    }
+
+    uint32_t getMaxMilliamps(void) {
+        return m_maxMilliamps;
+    }
+
+    String getStatsJson(void) {
+        return "{\"milliamps\":" + String(m_milliamps)
+            + ",\"level\":" + String(m_level)
+            + ",\"frames\":" + String(m_frames)
+            + ",\"limitedFrames\":" + String(m_limitedFrames)
+            + ",\"avgMicros\":" + String(m_frames ? (double) m_totalMicros / m_frames : 0.0, 2)
+            + ",\"maxMicros\":" + String(m_maxMicros) + "}";
+    }
+
+    bool hasLayoutFile(void) {
+        return m_layoutFile;
+    }
+}
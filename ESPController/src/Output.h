@@ -0,0 +1,63 @@
+#ifndef OUTPUT_H
+#define OUTPUT_H
+
+#include "Settings.h"
+#include <Arduino.h>
+#include <FastLED.h>
+
+#define OUTPUT_NUM_LEDS         (MATRIX_WIDTH * MATRIX_HEIGHT)
+
+
+/*
+ * Double buffered output stage of the led strip. The renderers draw into the back buffer, a row major framebuffer
+ * (x + y * MATRIX_WIDTH) that keeps its contents between frames, as the decoders only draw what changed. present()
+ * turns it into the front buffer in a single integer pass: every led is gathered in the wired order, its channels are
+ * looked up in level tables, dithered and summed up for the current estimate. Only the push reads the front buffer, so
+ * the back buffer can be changed as soon as present() returns, and post processing never touches the frame of the
+ * renderers.
+ *
+ * The order is a table of the framebuffer position of every led, built once at boot from the compile time layout
+ * (LAYOUT_* settings) or loaded from FILE_LAYOUT, so remapping a frame costs one lookup per led regardless of the
+ * wiring. FastLED's own brightness stays at 255.
+ *
+ * The level tables hold gamma, color correction and brightness of every channel value in 8.8 fixed point. The
+ * fraction is rounded with a different offset on each of 8 frames (temporal dithering), so dark colors keep their
+ * steps after the gamma curve. The current of the last frame decides the brightness of the next one: the largest
+ * level that keeps it below the budget. A frame that exceeds it anyway (e.g. a sudden white frame) is scaled down in a
+ * second pass.
+ */
+namespace Output {
+    // Registers the strip with FastLED and builds the led order. The SPIFFS must be mounted before
+    void begin(void);
+
+    // Builds the front buffer from the framebuffer (wired order, brightness) and pushes it to the leds
+    void present(const CRGB *leds);
+
+    void setBrightness(uint8_t brightness);
+    uint8_t getBrightness(void);
+
+    // Gamma of the leds (1 for linear) and correction of the channels (0xRRGGBB)
+    void setGamma(float gamma);
+    float getGamma(void);
+    void setCorrection(uint32_t correction);
+    uint32_t getCorrection(void);
+
+    // While dithering, the frames must be pushed even if they didn't change. isDithering() tells if a led of the last
+    // frame changes with the dithering, only then the frame has to be pushed again
+    void setDithering(bool dithering);
+    bool getDithering(void);
+    bool isDithering(void);
+
+    // Current budget of the strip in mA, 0 for no limit
+    void setMaxMilliamps(uint32_t milliamps);
+    uint32_t getMaxMilliamps(void);
+
+    // Current estimate of the last frame, the brightness it was presented at, frame cost and limited frames
+    String getStatsJson(void);
+
+    // Whether the led order was loaded from FILE_LAYOUT
+    bool hasLayoutFile(void);
+}
+
+
+#endif
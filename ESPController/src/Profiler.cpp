@@ -0,0 +1,69 @@
+#include "Profiler.h"
+
+#ifdef PROFILER
+
+namespace Profiler {
+    namespace {
+        const char *m_stageNames[PROFILE_NUM_STAGES] = {
+            "gifDecode", "mafDecode", "micCapture", "fft", "visRender", "show", "handleClient", "serial", "transition"
+        };
+
+        uint32_t m_histograms[PROFILE_NUM_STAGES][PROFILE_NUM_BUCKETS];
+        uint32_t m_counts[PROFILE_NUM_STAGES];
+        uint32_t m_totalMicros[PROFILE_NUM_STAGES];
+        uint32_t m_maxMicros[PROFILE_NUM_STAGES];
+    }
+
+    void record(uint8_t stage, unsigned long micros) {
+        // The bucket is the number of significant bits
+        int bucket = micros > 0 ? 32 - __builtin_clz((uint32_t) micros) : 0;
+        if (bucket >= PROFILE_NUM_BUCKETS) bucket = PROFILE_NUM_BUCKETS - 1;
+
+        // Halve the stage, the histogram keeps its shape and the average stays valid
+        if (m_counts[stage] >= PROFILE_STATS_LIMIT || m_totalMicros[stage] >= PROFILE_STATS_LIMIT) {
+            for (int i = 0; i < PROFILE_NUM_BUCKETS; i++) m_histograms[stage][i] /= 2;
+            m_counts[stage] /= 2;
+            m_totalMicros[stage] /= 2;
+        }
+
+        m_histograms[stage][bucket]++;
+        m_counts[stage]++;
+        m_totalMicros[stage] += micros;
+        if (micros > m_maxMicros[stage]) m_maxMicros[stage] = micros;
+    }
+
+    void reset(void) {
+        memset(m_histograms, 0, sizeof(m_histograms));
+        memset(m_counts, 0, sizeof(m_counts));
+        memset(m_totalMicros, 0, sizeof(m_totalMicros));
+        memset(m_maxMicros, 0, sizeof(m_maxMicros));
+    }
+
+    String getStatsJson(void) {
+        String json = "{";
+
+        for (int i = 0; i < PROFILE_NUM_STAGES; i++) {
+            if (i > 0) json += ",";
+            json += "\"" + String(m_stageNames[i])
+                + "\":{\"count\":" + String(m_counts[i])
+                + ",\"avg\":" + String(m_counts[i] > 0 ? m_totalMicros[i] / m_counts[i] : 0)
+                + ",\"max\":" + String(m_maxMicros[i])
+                + ",\"hist\":[";
+
+            // Leave out the empty buckets at the end
+            int numBuckets = PROFILE_NUM_BUCKETS;
+            while (numBuckets > 0 && m_histograms[i][numBuckets - 1] == 0) numBuckets--;
+            for (int j = 0; j < numBuckets; j++) {
+                if (j > 0) json += ",";
+                json += String(m_histograms[i][j]);
+            }
+
+            json += "]}";
+        }
+
+        json += "}";
+        return json;
+    }
+}
+
+#endif
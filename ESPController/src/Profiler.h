@@ -0,0 +1,55 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include "Settings.h"
+#include <Arduino.h>
+
+// Profiled stages
+#define PROFILE_GIF_DECODE      0
+#define PROFILE_MAF_DECODE      1
+#define PROFILE_MIC_CAPTURE     2
+#define PROFILE_FFT             3
+#define PROFILE_VIS_RENDER      4
+#define PROFILE_SHOW            5
+#define PROFILE_HANDLE_CLIENT   6
+#define PROFILE_SERIAL          7
+#define PROFILE_TRANSITION      8
+#define PROFILE_NUM_STAGES      9
+
+// Histogram bucket n counts the run times of 2^(n-1) to 2^n - 1 us, the last bucket everything above
+#define PROFILE_NUM_BUCKETS     16
+
+// The counts and times of a stage are halved when one of them reaches this limit, so they don't overflow
+#define PROFILE_STATS_LIMIT     0x40000000UL
+
+/*
+ * Records the run time of a stage in a histogram:
+ *
+ *     PROFILE_BEGIN(FFT)
+ *     ...
+ *     PROFILE_END(FFT)
+ *
+ * Both macros must be in the same scope. Without PROFILER, they compile to nothing.
+ */
+#ifdef PROFILER
+
+#define PROFILE_BEGIN(STAGE) unsigned long profileStart_##STAGE = micros();
+#define PROFILE_END(STAGE) Profiler::record(PROFILE_##STAGE, micros() - profileStart_##STAGE);
+
+namespace Profiler {
+    void record(uint8_t stage, unsigned long micros);
+    void reset(void);
+
+    // Count, average, maximum and the histogram of every stage as json
+    String getStatsJson(void);
+}
+
+#else
+
+#define PROFILE_BEGIN(STAGE)
+#define PROFILE_END(STAGE)
+
+#endif
+
+
+#endif
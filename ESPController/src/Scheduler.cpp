@@ -0,0 +1,186 @@
+#include "Scheduler.h"
+
+namespace Scheduler {
+    namespace {
+        Task m_tasks[SCHEDULER_MAX_TASKS];
+        int m_numTasks;
+        int m_nextBackgroundTask;
+
+        unsigned int m_fps;
+        unsigned long m_framePeriod;
+        unsigned long m_nextFrame;
+        bool m_frameRequested;
+        unsigned long m_requestedFrame;
+
+        unsigned long m_frames;
+        unsigned long m_lateFrames;
+        unsigned long m_lateSamples;        // Frames in m_totalLateMicros, halved with it
+        unsigned long m_totalLateMicros;
+        unsigned long m_maxLateMicros;
+
+        unsigned long runTask(Task &task) {
+            unsigned long start = micros();
+            task.callback();
+            unsigned long duration = micros() - start;
+
+            task.lastFrame = m_frames;
+            if (task.runs >= SCHEDULER_STATS_LIMIT || task.totalMicros >= SCHEDULER_STATS_LIMIT) {
+                task.runs /= 2;
+                task.totalMicros /= 2;
+            }
+            task.runs++;
+            task.totalMicros += duration;
+            if (duration > task.maxMicros) task.maxMicros = duration;
+            return duration;
+        }
+
+        unsigned long getAvgMicros(const Task &task) {
+            return task.runs > 0 ? task.totalMicros / task.runs : 0;
+        }
+    }
+
+    void begin(unsigned int fps) {
+        m_fps = fps;
+        m_framePeriod = fps > 0 ? 1000000UL / fps : 0;
+        resetStats();
+    }
+
+    int addTask(const char *name, task_callback callback, uint8_t type) {
+        if (m_numTasks >= SCHEDULER_MAX_TASKS) return -1;
+
+        Task &task = m_tasks[m_numTasks];
+        task.name = name;
+        task.callback = callback;
+        task.type = type;
+        task.lastFrame = 0;
+        task.runs = 0;
+        task.totalMicros = 0;
+        task.maxMicros = 0;
+
+        return m_numTasks++;
+    }
+
+    void run(void) {
+        unsigned long now = micros();
+
+        // Run the frame tasks if the next frame is due
+        long late = (long) (now - m_nextFrame);
+        if (late >= 0) {
+            m_frames++;
+            if (m_lateSamples >= SCHEDULER_STATS_LIMIT || m_totalLateMicros >= SCHEDULER_STATS_LIMIT) {
+                m_lateSamples /= 2;
+                m_totalLateMicros /= 2;
+            }
+            m_lateSamples++;
+            m_totalLateMicros += late;
+            if ((unsigned long) late > m_maxLateMicros) m_maxLateMicros = late;
+
+            for (int i = 0; i < m_numTasks; i++) {
+                if (m_tasks[i].type == TASK_FRAME) runTask(m_tasks[i]);
+            }
+
+            // Without a target fps, every call renders a frame and runs every background task once
+            if (m_framePeriod == 0) {
+                m_nextFrame = micros();
+            } else {
+                // Don't try to catch up if we fell behind by more than a frame, that would only burst out frames
+                m_nextFrame += m_framePeriod;
+                if ((long) (micros() - m_nextFrame) >= (long) m_framePeriod) {
+                    m_lateFrames++;
+                    m_nextFrame = micros() + m_framePeriod;
+                }
+
+                // Pull the next frame forward to the requested time
+                if (m_frameRequested) {
+                    unsigned long earliest = now + m_framePeriod / 2;
+                    unsigned long requested = (long) (m_requestedFrame - earliest) < 0 ? earliest : m_requestedFrame;
+                    if ((long) (requested - m_nextFrame) < 0) m_nextFrame = requested;
+                    m_frameRequested = false;
+                }
+                return;
+            }
+        }
+
+        // Run the background tasks round robin in the time left until the next frame. A task that already ran in this
+        // frame is only run again if its average run time fits into that time
+        for (int n = 0; n < m_numTasks; n++) {
+            Task &task = m_tasks[m_nextBackgroundTask];
+            m_nextBackgroundTask = (m_nextBackgroundTask + 1) % m_numTasks;
+            if (task.type != TASK_BACKGROUND) continue;
+
+            long budget = (long) (m_nextFrame - micros());
+            if (task.lastFrame == m_frames && task.runs > 0 && (budget <= 0 || getAvgMicros(task) > (unsigned long) budget)) continue;
+
+            runTask(task);
+        }
+    }
+
+    void requestFrame(unsigned long time) {
+        // The earliest request counts
+        if (!m_frameRequested || (long) (time - m_requestedFrame) < 0) m_requestedFrame = time;
+        m_frameRequested = true;
+    }
+
+    void resetStats(void) {
+        // Start the measurement with a new frame, the last one could be long ago
+        m_nextFrame = micros();
+
+        m_frames = 0;
+        m_lateFrames = 0;
+        m_lateSamples = 0;
+        m_totalLateMicros = 0;
+        m_maxLateMicros = 0;
+
+        for (int i = 0; i < m_numTasks; i++) {
+            m_tasks[i].lastFrame = 0;
+            m_tasks[i].runs = 0;
+            m_tasks[i].totalMicros = 0;
+            m_tasks[i].maxMicros = 0;
+        }
+    }
+
+    unsigned long getFrames(void) {
+        return m_frames;
+    }
+
+    unsigned long getLateFrames(void) {
+        return m_lateFrames;
+    }
+
+    unsigned long getAvgLateMicros(void) {
+        return m_lateSamples > 0 ? m_totalLateMicros / m_lateSamples : 0;
+    }
+
+    unsigned long getMaxLateMicros(void) {
+        return m_maxLateMicros;
+    }
+
+    int getNumTasks(void) {
+        return m_numTasks;
+    }
+
+    const Task &getTask(int n) {
+        return m_tasks[n];
+    }
+
+    String getStatsJson(void) {
+        String json = "{\"fps\":" + String(m_fps)
+            + ",\"frames\":" + String(m_frames)
+            + ",\"lateFrames\":" + String(m_lateFrames)
+            + ",\"avgLate\":" + String(getAvgLateMicros())
+            + ",\"maxLate\":" + String(m_maxLateMicros)
+            + ",\"tasks\":[";
+
+        for (int i = 0; i < m_numTasks; i++) {
+            const Task &task = m_tasks[i];
+            if (i > 0) json += ",";
+            json += "{\"name\":\"" + String(task.name)
+                + "\",\"runs\":" + String(task.runs)
+                + ",\"avg\":" + String(getAvgMicros(task))
+                + ",\"max\":" + String(task.maxMicros) + "}";
+        }
+
+        json += "]}";
+        return json;
+    }
+}
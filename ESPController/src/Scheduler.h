@@ -0,0 +1,67 @@
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#include "Settings.h"
+#include <Arduino.h>
+
+#define SCHEDULER_MAX_TASKS     8
+
+// Limit of the run counts and time sums of the statistics, they are halved when reaching it
+#define SCHEDULER_STATS_LIMIT   0x40000000UL
+
+// Frame tasks run once per frame at the frame deadline, in the order they were added. Background tasks share the time
+// that is left until the next deadline.
+#define TASK_FRAME              0
+#define TASK_BACKGROUND         1
+
+
+/*
+ * Cooperative scheduler that paces the led output to a target frame rate. run() has to be called from loop() and
+ * either runs all frame tasks (if the next frame is due) or the background tasks that fit into the time until the next
+ * frame. Every background task still runs at least once per frame, so it can't be starved by slow frames.
+ *
+ * The run time of every task is recorded, so jitter can be quantified.
+ */
+namespace Scheduler {
+    typedef void (*task_callback)(void);
+
+    struct Task {
+        const char *name;
+        task_callback callback;
+        uint8_t type;
+
+        unsigned long lastFrame;        // Frame in which the task ran last
+
+        // The runs and their total time are halved together before either of them overflows, so the average keeps
+        // working and follows changes of the run time
+        unsigned long runs;
+        unsigned long totalMicros;
+        unsigned long maxMicros;
+    };
+
+    // Sets the target frame rate. With 0, the frame tasks run on every call of run()
+    void begin(unsigned int fps);
+    int addTask(const char *name, task_callback callback, uint8_t type);
+    void run(void);
+
+    // Called from a frame task: runs the next frame earlier at the given time (micros()), e.g. when the next frame of
+    // an animation is due. The frames are still at least half a frame period apart
+    void requestFrame(unsigned long time);
+
+    void resetStats(void);
+
+    // Number of frames, frames that started more than a frame period late and the lateness of the frame starts
+    unsigned long getFrames(void);
+    unsigned long getLateFrames(void);
+    unsigned long getAvgLateMicros(void);
+    unsigned long getMaxLateMicros(void);
+
+    int getNumTasks(void);
+    const Task &getTask(int n);
+
+    // Target fps, frame and task statistics as json
+    String getStatsJson(void);
+}
+
+
+#endif
@@ -4,19 +4,46 @@
 
 #define SERIAL_DEBUG                    // Send debug data via Serial Monitor
 #define SERIAL_MATRIX_DATA              // Send the Led-Data as Hex-Encoded String via Serial Monitor. Must be enabled for the Virtual Matrix
+#define SERIAL_MATRIX_BINARY            // Send the Led-Data with the binary protocol of lib/MatrixStream instead of Hex-Encoded Strings
 
 #define SERIAL_BAUD_RATE                460800 // Serial baud rate used for debugging and the virtual matrix
 
 // The uploaded gif files must have the same dimensions as the matrix. Therefore, if the dimensions are changed here, all
 // gif files need to be reuploaded. The provided example files have a resolution of 12x12.
 // Also, the animations have only been tested with square matrices and may not work, if the width and height have different values.
+#ifndef MATRIX_WIDTH
 #define MATRIX_WIDTH                    32 // X-Dimension of the matrix
+#endif
+#ifndef MATRIX_HEIGHT
 #define MATRIX_HEIGHT                   8 // Y-Dimension of the matrix
+#endif
 
 // Pin for the NeoPixel led strip and the microphone
 #define PIN_LEDS                        D8
 #define PIN_MICROPHONE                  A0
 
+// Wiring of the led strip. The matrix is a chain of LAYOUT_TILE_WIDTH x LAYOUT_TILE_HEIGHT tiles (see lib/LedLayout for
+// the order of the tiles and rotations). All renderers draw row by row, the output copies the frame to the strip in the
+// wired order. A layout file (FILE_LAYOUT, one 16 bit led index of the rows for every led of the strip) overrides it.
+#define LED_COLOR_ORDER                 GRB
+#define LAYOUT_TILE_WIDTH               MATRIX_WIDTH
+#define LAYOUT_TILE_HEIGHT              MATRIX_HEIGHT
+#define LAYOUT_ROTATION                 0 // Rotation of the tiles in 90 degree steps, clockwise
+#define LAYOUT_FLAGS                    0 // LED_LAYOUT_* flags (e.g. LED_LAYOUT_SERPENTINE), 0 if every row starts on the left
+#define FILE_LAYOUT                     "/layout.bin"
+
+// Output stage: gamma of the leds (1.0 for linear), correction of the channels (0xRRGGBB, e.g. 0xFFB0F0 like FastLED's
+// TypicalLEDStrip) and temporal dithering of the levels between two output values. The current of every frame is
+// estimated and the brightness is lowered to stay below LED_MAX_MILLIAMPS (0 for no limit). All but the currents of a
+// single channel and of a led that is off can be changed at /api/output. Dithering is off by default: with a gamma curve
+// almost every frame has such levels, and a dithered frame has to be pushed at every frame even if it didn't change.
+#define LED_GAMMA                       2.2
+#define LED_CORRECTION                  0xFFFFFF
+#define LED_DITHERING                   false
+#define LED_MAX_MILLIAMPS               2000
+#define LED_MILLIAMPS_PER_CHANNEL       20 // Current of one channel at full level
+#define LED_IDLE_MILLIAMPS              1 // Current of a led that is off
+
 // Wifi credentials and hostname / mdns name of the esp
 #define WIFI_SSID                       "ssid"
 #define WIFI_PSK                        "password"
@@ -29,17 +56,59 @@
 #define WEBSERVER_PORT                  80
 #define DIR_HTML_ROOT                   "/htdocs"
 #define DIR_ANIMATIONS                  "/animations"
+#define FILE_CATALOG                    "/catalog.idx" // Index of all animations, so the directory doesn't need to be scanned
+#define FILE_SETTINGS_A                 "/settings.a" // The settings alternate between these two files
+#define FILE_SETTINGS_B                 "/settings.b"
+
+// Changed settings are written to the flash once they didn't change for SETTINGS_FLUSH_DELAY ms, but at the latest
+// SETTINGS_MAX_FLUSH_DELAY ms after the first change
+#define SETTINGS_FLUSH_DELAY            2000
+#define SETTINGS_MAX_FLUSH_DELAY        10000
 
 // Maximum number of animations that can be uploaded.
 #define MAX_NUM_ANIMATIONS              100
 
+// Frame rate of the led output. Network requests are handled in the time between the frames. With 0, a frame is rendered
+// on every loop iteration.
+#define TARGET_FPS                      50
+
+// Record run time histograms of the decoders, fft, rendering, led output, http handling and serial output. They are
+// served at /api/stats. Uncomment to add the instrumentation, without it the macros compile to nothing.
+//#define PROFILER
+
+// Uploaded gif files are transcoded into MAF files, which are played back with the frame delays of the gif. Frames
+// without a delay are shown for this duration in ms (like web browsers do).
+#define MAF_DEFAULT_FRAME_DURATION      100
+
+// Transition between animations, visualizations and modes: TRANSITION_CUT, TRANSITION_FADE, TRANSITION_WIPE or
+// TRANSITION_DISSOLVE, and its duration in ms. Both sources keep playing during the transition.
+#define TRANSITION_TYPE                 TRANSITION_FADE
+#define TRANSITION_DURATION             800
+
 // Number of samples for the visualizations. Must be a power of 2 and at least double the size of MATRIX_WIDTH.
 // Higher values will give better looking FFTs with slightly increased computation time
 #define FFT_SAMPLES                     32
 
+// Sample the microphone at a fixed rate on micros() deadlines from a background task, one sample per pass of the
+// scheduler, instead of a burst with a fixed delay between the reads that blocks the frame. Comment out to use the burst.
+// With WiFi on, the ADC returns the previous value while the radio uses it: up to about 5 kHz the samples are fresh,
+// above that more and more samples are repeated (counted by MicSampler::getRepeatedSamples()). A visualization frame is
+// rendered once FFT_SAMPLES new samples were collected.
+#define MIC_SAMPLER
+#define MIC_SAMPLE_RATE                 10000 // Sample rate in Hz
+
+// Mapping of the fft bins to the columns: FFT_SCALE_LINEAR (every column spans the same number of bins), FFT_SCALE_LOG
+// (the same frequency ratio) or FFT_SCALE_MEL (the same step in perceived pitch). With log and mel, the low columns
+// share bins unless FFT_SAMPLES is a lot larger than MATRIX_WIDTH.
+#define FFT_SCALE                       FFT_SCALE_LINEAR
+
 // Speed at which the frequency bands rise (attack) and fall (release).
 #define FFT_ATTACK                      0.5
 #define FFT_RELEASE                     0.6
 
+// Use the Q15 fixed point FFT instead of arduinoFFT. The ESP8266 has no FPU, so this is a lot faster than the double
+// precision version. Comment out to use arduinoFFT.
+#define FFT_FIXED_POINT
+
 
 #endif
\ No newline at end of file
@@ -0,0 +1,171 @@
+#include "SettingsStore.h"
+#include "Log.h"
+
+// "MST1"
+#define SETTINGS_MAGIC  0x3154534D
+
+// Size of the settings of version 1, the fields of version 2 start after it
+#define SETTINGS_V1_SIZE    40
+
+namespace SettingsStore {
+    static_assert(offsetof(StoredSettings, gamma) >= SETTINGS_V1_SIZE, "The fields of version 2 must follow version 1");
+
+    namespace {
+        struct RecordHeader {
+            uint32_t magic;
+            uint16_t version;
+            uint16_t size;
+            uint32_t sequence;
+        };
+
+        const char *m_slotFileNames[2] = { FILE_SETTINGS_A, FILE_SETTINGS_B };
+
+        StoredSettings m_settings;
+        int m_slot;                     // Slot of the newest record, -1 if there is none
+        uint32_t m_sequence;            // Sequence number of the newest record
+
+        bool m_dirty;
+        unsigned long m_firstChange;    // Time of the first change since the last flush
+        unsigned long m_lastChange;
+
+        unsigned long m_changes;
+        unsigned long m_writes;
+        unsigned long m_bytesWritten;
+        unsigned long m_failedWrites;
+
+        // Bitwise crc32 (the record is only a few bytes long, a table isn't worth the memory)
+        uint32_t crc32(const uint8_t *data, size_t size) {
+            uint32_t crc = 0xFFFFFFFF;
+            for (size_t i = 0; i < size; i++) {
+                crc ^= data[i];
+                for (int j = 0; j < 8; j++) crc = (crc >> 1) ^ (0xEDB88320 & (0 - (crc & 1)));
+            }
+            return ~crc;
+        }
+
+        uint32_t recordCrc(const RecordHeader &header, const StoredSettings &settings) {
+            // The crc covers the header and the settings of the record's version
+            uint8_t buffer[sizeof(RecordHeader) + sizeof(StoredSettings)];
+            memcpy(buffer, &header, sizeof(RecordHeader));
+            memcpy(buffer + sizeof(RecordHeader), &settings, header.size);
+            return crc32(buffer, sizeof(RecordHeader) + header.size);
+        }
+
+        uint16_t getVersionSize(uint16_t version) {
+            return version == 1 ? SETTINGS_V1_SIZE : sizeof(StoredSettings);
+        }
+
+        bool readRecord(int slot, RecordHeader *header, StoredSettings *settings) {
+            File file = SPIFFS.open(m_slotFileNames[slot], "r");
+            if (!file) return false;
+
+            // Records of a newer version or another layout are ignored, the defaults are used instead. Older ones only
+            // overwrite their fields
+            uint32_t crc;
+            bool valid = file.read((uint8_t*) header, sizeof(RecordHeader)) == sizeof(RecordHeader)
+                && header->magic == SETTINGS_MAGIC
+                && header->version >= 1 && header->version <= SETTINGS_VERSION
+                && header->size == getVersionSize(header->version)
+                && file.read((uint8_t*) settings, header->size) == header->size
+                && file.read((uint8_t*) &crc, sizeof(crc)) == sizeof(crc);
+            file.close();
+
+            return valid && crc == recordCrc(*header, *settings);
+        }
+
+        bool writeRecord(int slot, uint32_t sequence) {
+            RecordHeader header = { SETTINGS_MAGIC, SETTINGS_VERSION, sizeof(StoredSettings), sequence };
+            uint32_t crc = recordCrc(header, m_settings);
+
+            File file = SPIFFS.open(m_slotFileNames[slot], "w");
+            if (!file) return false;
+
+            size_t written = file.write((const uint8_t*) &header, sizeof(RecordHeader));
+            written += file.write((const uint8_t*) &m_settings, sizeof(StoredSettings));
+            written += file.write((const uint8_t*) &crc, sizeof(crc));
+            file.close();
+
+            m_bytesWritten += written;
+            return written == sizeof(RecordHeader) + sizeof(StoredSettings) + sizeof(crc);
+        }
+    }
+
+    bool begin(const StoredSettings &defaults) {
+        m_settings = defaults;
+        m_slot = -1;
+        m_sequence = 0;
+        m_dirty = false;
+
+        // Take the newest of the two valid records
+        for (int slot = 0; slot < 2; slot++) {
+            RecordHeader header;
+            StoredSettings settings = defaults;
+            if (!readRecord(slot, &header, &settings)) continue;
+            if (m_slot >= 0 && header.sequence <= m_sequence) continue;
+
+            m_settings = settings;
+            m_slot = slot;
+            m_sequence = header.sequence;
+        }
+
+        if (m_slot < 0) {
+            DEBUGLN("No stored settings, using the defaults")
+            return false;
+        }
+
+        // The name is read from the flash, make sure it is terminated
+        m_settings.visualization[SETTINGS_NAME_LENGTH - 1] = '\0';
+        DEBUGF("Loaded settings #%u from %s\n", m_sequence, m_slotFileNames[m_slot])
+        return true;
+    }
+
+    const StoredSettings &get(void) {
+        return m_settings;
+    }
+
+    bool set(const StoredSettings &settings) {
+        if (memcmp(&settings, &m_settings, sizeof(StoredSettings)) == 0) return false;
+
+        m_settings = settings;
+        m_changes++;
+        m_lastChange = millis();
+        if (!m_dirty) m_firstChange = m_lastChange;
+        m_dirty = true;
+        return true;
+    }
+
+    void update(void) {
+        if (!m_dirty) return;
+
+        unsigned long now = millis();
+        if (now - m_lastChange >= SETTINGS_FLUSH_DELAY || now - m_firstChange >= SETTINGS_MAX_FLUSH_DELAY) flush();
+    }
+
+    void flush(void) {
+        if (!m_dirty) return;
+
+        // Overwrite the older record, so the newest one survives a failed write
+        int slot = m_slot < 0 ? 0 : 1 - m_slot;
+        if (!writeRecord(slot, m_sequence + 1)) {
+            // Try again after the next debounce delay
+            WARN("Could not save the settings")
+            m_failedWrites++;
+            m_firstChange = m_lastChange = millis();
+            return;
+        }
+
+        m_dirty = false;
+        m_slot = slot;
+        m_sequence++;
+        m_writes++;
+    }
+
+    String getStatsJson(void) {
+        return "{\"changes\":" + String(m_changes)
+            + ",\"writes\":" + String(m_writes)
+            + ",\"bytesWritten\":" + String(m_bytesWritten)
+            + ",\"failedWrites\":" + String(m_failedWrites)
+            + ",\"sequence\":" + String(m_sequence)
+            + ",\"pending\":" + String(m_dirty ? "true" : "false") + "}";
+    }
+}
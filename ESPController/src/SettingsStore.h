@@ -0,0 +1,61 @@
+#ifndef SETTINGS_STORE_H
+#define SETTINGS_STORE_H
+
+#include "Settings.h"
+#include "Effect.h"
+#include <FS.h>
+
+#define SETTINGS_VERSION        2
+#define SETTINGS_NAME_LENGTH    16      // Maximum length of the visualization name, including the terminator
+
+
+/*
+ * Persistent user settings. Kept in ram and written to the flash as a single binary record with a version and a crc:
+ *
+ *     uint32 magic | uint16 version | uint16 size | uint32 sequence | StoredSettings | uint32 crc
+ *
+ * The record alternates between two files (FILE_SETTINGS_A and FILE_SETTINGS_B), each flush overwrites the older
+ * one. If the power fails during a write, the other file still holds the previous record. At boot both records are
+ * read and the valid one with the higher sequence number wins, so loading costs two small reads.
+ *
+ * Fields are only appended. A record of an older version is shorter, the fields it doesn't have keep their defaults.
+ *
+ * set() only compares the settings with the ones in ram. A changed record is flushed once no change came in for
+ * SETTINGS_FLUSH_DELAY ms, or at the latest SETTINGS_MAX_FLUSH_DELAY ms after the first change, so a burst of updates
+ * (e.g. dragging a color picker) costs a single flash write.
+ */
+namespace SettingsStore {
+    // All fields are zeroed before they are set, so the padding doesn't change the crc. New fields must start after the
+    // end (including the padding) of the previous version
+    struct StoredSettings {
+        uint8_t mode;
+        uint32_t cycleDelay;                                    // Seconds, 0 to disable cycling
+        uint8_t palette[VISUALIZATION_PALETTE_SIZE][3];         // Rgb palette colors
+        char visualization[SETTINGS_NAME_LENGTH];               // Name of the selected effect
+
+        // Version 2: the output stage
+        float gamma;
+        uint32_t maxMilliamps;                                  // Current budget, 0 for no limit
+        uint8_t brightness;
+        uint8_t dithering;                                      // Temporal dithering on (1) or off (0)
+    };
+
+    // Loads the newest valid record. Returns false (and keeps the given defaults) if there is none
+    bool begin(const StoredSettings &defaults);
+    const StoredSettings &get(void);
+
+    // Updates the settings in ram. Returns true if they changed
+    bool set(const StoredSettings &settings);
+
+    // Writes the settings if they changed and the debounce delay passed. Called from a background task
+    void update(void);
+
+    // Writes pending changes immediately
+    void flush(void);
+
+    // Number of changes, records written, bytes written and failed writes as json
+    String getStatsJson(void);
+}
+
+
+#endif
@@ -0,0 +1,113 @@
+#include "Transition.h"
+
+#define TRANSITION_NUM_LEDS     (MATRIX_WIDTH * MATRIX_HEIGHT)
+
+namespace Transition {
+    namespace {
+        const char *m_typeNames[TRANSITION_NUM_TYPES] = { "cut", "fade", "wipe", "dissolve" };
+
+        uint8_t m_type = TRANSITION_TYPE;
+        unsigned int m_duration = TRANSITION_DURATION;
+        bool m_active;
+        unsigned long m_start;
+
+        uint8_t m_dissolveOrder[TRANSITION_NUM_LEDS];  // Point in the transition at which every led fades over
+        uint16_t m_weights[TRANSITION_NUM_LEDS];       // Weight of the incoming frame (0 to 256) of every column or led
+
+        // Blends a run of channels with the same weight
+        inline void blendRun(uint8_t *out, const uint8_t *from, const uint8_t *to, int count, uint16_t weight) {
+            const uint16_t inverse = 256 - weight;
+            for (int i = 0; i < count; i++) out[i] = (from[i] * inverse + to[i] * weight) >> 8;
+        }
+
+        inline uint16_t clampWeight(int32_t weight) {
+            return weight < 0 ? 0 : weight > 256 ? 256 : weight;
+        }
+    }
+
+    void init(void) {
+        // Shuffle the leds evenly over the transition (xorshift, so the order is the same on every boot)
+        uint32_t state = 2463534242UL;
+        for (int i = 0; i < TRANSITION_NUM_LEDS; i++) m_dissolveOrder[i] = (uint32_t) i * 256 / TRANSITION_NUM_LEDS;
+        for (int i = TRANSITION_NUM_LEDS - 1; i > 0; i--) {
+            state ^= state << 13;
+            state ^= state >> 17;
+            state ^= state << 5;
+            int j = state % (i + 1);
+            uint8_t order = m_dissolveOrder[i];
+            m_dissolveOrder[i] = m_dissolveOrder[j];
+            m_dissolveOrder[j] = order;
+        }
+    }
+
+    void start(unsigned long now) {
+        m_start = now;
+        m_active = true;
+    }
+
+    void stop(void) {
+        m_active = false;
+    }
+
+    bool isActive(void) {
+        return m_active;
+    }
+
+    bool render(CRGB *leds, const CRGB *from, const CRGB *to, unsigned long now) {
+        unsigned long elapsed = now - m_start;
+        if (!m_active || m_type == TRANSITION_CUT || elapsed >= m_duration) return false;
+
+        // Progress of the transition from 0 to 256
+        const int32_t progress = (int32_t) (elapsed * 256 / m_duration);
+        uint8_t *out = (uint8_t*) leds;
+        const uint8_t *a = (const uint8_t*) from;
+        const uint8_t *b = (const uint8_t*) to;
+
+        if (m_type == TRANSITION_FADE) {
+            blendRun(out, a, b, TRANSITION_NUM_LEDS * 3, progress);
+        } else if (m_type == TRANSITION_WIPE) {
+            // The edge starts left of the matrix and ends right of it. One weight per column
+            const int32_t position = progress * (MATRIX_WIDTH + TRANSITION_WIPE_EDGE);
+            for (int x = 0; x < MATRIX_WIDTH; x++) {
+                m_weights[x] = clampWeight((position - x * 256) / TRANSITION_WIPE_EDGE);
+            }
+            for (int y = 0; y < MATRIX_HEIGHT; y++) {
+                for (int x = 0; x < MATRIX_WIDTH; x++) {
+                    int i = (y * MATRIX_WIDTH + x) * 3;
+                    blendRun(out + i, a + i, b + i, 3, m_weights[x]);
+                }
+            }
+        } else {
+            // Every led fades over on its own, starting at its point in the order
+            const int32_t position = progress * (256 + 256 / TRANSITION_DISSOLVE_FADE) / 256;
+            for (int i = 0; i < TRANSITION_NUM_LEDS; i++) {
+                m_weights[i] = clampWeight((position - m_dissolveOrder[i]) * TRANSITION_DISSOLVE_FADE);
+            }
+            for (int i = 0; i < TRANSITION_NUM_LEDS; i++) {
+                blendRun(out + i * 3, a + i * 3, b + i * 3, 3, m_weights[i]);
+            }
+        }
+
+        return true;
+    }
+
+    void setType(uint8_t type) {
+        if (type < TRANSITION_NUM_TYPES) m_type = type;
+    }
+
+    uint8_t getType(void) {
+        return m_type;
+    }
+
+    const char *getTypeName(uint8_t type) {
+        return type < TRANSITION_NUM_TYPES ? m_typeNames[type] : NULL;
+    }
+
+    void setDuration(unsigned int duration) {
+        m_duration = duration;
+    }
+
+    unsigned int getDuration(void) {
+        return m_duration;
+    }
+}
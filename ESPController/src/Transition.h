@@ -0,0 +1,47 @@
+#ifndef TRANSITION_H
+#define TRANSITION_H
+
+#include "Settings.h"
+#include <FastLED.h>
+
+// Transition types
+#define TRANSITION_CUT          0   // Switch at once
+#define TRANSITION_FADE         1   // Cross fade of the whole frame
+#define TRANSITION_WIPE         2   // Soft edge that moves from left to right
+#define TRANSITION_DISSOLVE     3   // The leds fade over one after another in random order
+#define TRANSITION_NUM_TYPES    4
+
+#define TRANSITION_WIPE_EDGE        4   // Width of the soft edge of the wipe in columns
+#define TRANSITION_DISSOLVE_FADE    8   // Slope of the fade of a single led when dissolving (1 / 256 steps)
+
+
+/*
+ * Blends the frames of the outgoing and the incoming source while switching between animations, visualizations and
+ * modes. Both sources keep playing into their own framebuffers, render() mixes them into a third one. All blending is
+ * integer math with one weight per frame (fade), column (wipe) or led (dissolve) and the same multiply-add on every
+ * channel: out = (from * (256 - weight) + to * weight) >> 8, which the compiler can vectorize.
+ */
+namespace Transition {
+    // Builds the random order of the dissolve
+    void init(void);
+
+    // Starts a transition at the given time (millis())
+    void start(unsigned long now);
+    void stop(void);
+    bool isActive(void);
+
+    // Blends the frames into leds at the progress of the given time. Returns false (without writing leds) once the
+    // transition is finished
+    bool render(CRGB *leds, const CRGB *from, const CRGB *to, unsigned long now);
+
+    void setType(uint8_t type);
+    uint8_t getType(void);
+    const char *getTypeName(uint8_t type);
+
+    // Duration in ms. With 0 or TRANSITION_CUT, the sources are switched as soon as the incoming one is ready
+    void setDuration(unsigned int duration);
+    unsigned int getDuration(void);
+}
+
+
+#endif
@@ -1,64 +1,253 @@
 #include "Visualization.h"
-
-int toLedPos(int x, int y) {
-    return x + y * MATRIX_WIDTH;
-}
+#include "MicSampler.h"
+#include "Profiler.h"
+#include "Log.h"
 
 Visualization::Visualization() {
-    currentVis = 2;
+    numEffects = 0;
+    currentVis = 0;
+    effectActive = false;
+    effectFailed = false;
+    paletteChanged = false;
+    fadingVis = -1;
+    fadingActive = false;
 
-    FFT = arduinoFFT();
     fftGain = 0.0005;
+
+    #ifndef FFT_FIXED_POINT
+        FFT = arduinoFFT();
+        for (int x = 0; x < MATRIX_WIDTH; x++) fftVal[x] = 0;
+    #endif
+    fftBandSamples = 0;
+    fftColumnGainBase = 0;
+    for (int x = 0; x < MATRIX_WIDTH; x++) fftLevel[x] = 0;
+    fftPeak = 0;
+    fftPeakVal = 0;
 }
 
-void Visualization::update(CRGB *leds) {
-    // Store the dc offset of the captured signal
-    int dcOffset = 0;
+bool Visualization::update(CRGB *leds, CRGB *fadingLeds) {
+    if (numEffects == 0) return false;
+
+    // Switching back to the effect that is faded out just continues it
+    if (fadingVis == currentVis) {
+        effectActive = fadingActive;
+        fadingVis = -1;
+        fadingActive = false;
+    }
+    Effect *effect = effectFailed ? NULL : effects[currentVis];
+    Effect *fading = fadingLeds && fadingVis >= 0 && fadingActive ? effects[fadingVis] : NULL;
+
+    // Allocate the state of the effect when it is rendered for the first time
+    if (effect && !effectActive) {
+        if (effect->init(palette)) {
+            effectActive = true;
+        } else {
+            DEBUGF("Not enough memory for the %s visualization\n", effect->name)
+            effectFailed = true;
+            effect = NULL;
+        }
+    }
+    if (!effect && !fading) return false;
 
-    // Capture some samples
-    for (int i = 0; i < FFT_SAMPLES; i++) {
-        // Get the current mic input value
-        #ifdef VISUALIZATION_EMULATE_INPUT
-            int val = random(400);
+    if (paletteChanged) {
+        if (effect) effect->setPalette(palette);
+        if (fading) fading->setPalette(palette);
+        paletteChanged = false;
+    }
+
+    // Both effects of a transition get the same input, at the larger fft size. Only the last samples are used for a
+    // smaller fft
+    uint8_t inputs = (effect ? effect->inputs : 0) | (fading ? fading->inputs : 0);
+    int fftSamples = max(effect ? (int) effect->fftSamples : 0, fading ? (int) fading->fftSamples : 0);
+    EffectInput input;
+    input.samples = min(fftSamples, FFT_SAMPLES);
+    int16_t *samples = micSamples + FFT_SAMPLES - input.samples;
+
+    if (inputs) {
+        #ifdef MIC_SAMPLER
+            // Take the newest complete buffer of samples. Without one, the frame isn't rendered, so the effects advance
+            // with the samples
+            PROFILE_BEGIN(MIC_CAPTURE)
+            bool sampled = MicSampler::read(samples, input.samples);
+            PROFILE_END(MIC_CAPTURE)
+            if (!sampled) return false;
         #else
-            int val = analogRead(PIN_MICROPHONE);
+            PROFILE_BEGIN(MIC_CAPTURE)
+            // Capture as many samples as needed
+            for (int i = 0; i < input.samples; i++) {
+                // Get the current mic input value
+                #ifdef VISUALIZATION_EMULATE_INPUT
+                    samples[i] = random(400);
+                #else
+                    samples[i] = analogRead(PIN_MICROPHONE);
+                #endif
+
+                // Short delay to make equidistant captures
+                delayMicroseconds(80);
+            }
+            PROFILE_END(MIC_CAPTURE)
         #endif
 
-        // Set the real and imaginary part and update the dc offset
-        fftReal[i] = val;
-        fftImag[i] = 0;
-        dcOffset += val;
+        // Remove the dc offset of the captured signal
+        int dcOffset = 0;
+        for (int i = 0; i < input.samples; i++) dcOffset += samples[i];
+        dcOffset /= input.samples;
+        for (int i = 0; i < input.samples; i++) samples[i] -= dcOffset;
+        input.waveform = samples;
+    }
+
+    // Calculate the fft values of all columns. The beat detector runs on the same spectrum, folded into bands
+    if (inputs & (EFFECT_INPUT_SPECTRUM | EFFECT_INPUT_PEAK | EFFECT_INPUT_BEAT)) {
+        PROFILE_BEGIN(FFT)
+        computeFFT(samples, input.samples);
+        PROFILE_END(FFT)
+
+        input.spectrum = fftLevel;
+        input.peak = fftPeak;
+        input.peakVal = fftPeakVal;
+        input.onset = beat.isOnset();
+        input.bpm = beat.getBpm();
+    }
+
+    // Update the selected visualization and the one that is faded out
+    PROFILE_BEGIN(VIS_RENDER)
+    bool changed = effect && effect->update(leds, input);
+    if (fading) changed |= fading->update(fadingLeds, input);
+    PROFILE_END(VIS_RENDER)
+
+    return changed;
+}
+
+// Position of the lower edge of column x in bins, for a spectrum of the given number of bins
+static double bandEdge(int x, int bins) {
+    #if FFT_SCALE == FFT_SCALE_LOG
+        // From bin 1 (the dc offset is removed anyway) to the last bin
+        return pow(bins, x / (double) MATRIX_WIDTH);
+    #elif FFT_SCALE == FFT_SCALE_MEL
+        double low = 2595 * log10(1 + MIC_SAMPLE_RATE / (2.0 * bins) / 700);
+        double high = 2595 * log10(1 + MIC_SAMPLE_RATE / 2.0 / 700);
+        double mel = low + (high - low) * x / MATRIX_WIDTH;
+        return 700 * (pow(10, mel / 2595) - 1) * 2 * bins / MIC_SAMPLE_RATE;
+    #else
+        return x * bins / (double) MATRIX_WIDTH;
+    #endif
+}
+
+void Visualization::buildBands(int n) {
+    // Every column averages the bins between its edges. Columns narrower than a bin take the one or two bins they
+    // overlap, so the mapping of a frame only costs one addition per bin and a multiplication per column
+    const int bins = n / 2;
+    for (int x = 0; x < MATRIX_WIDTH; x++) {
+        int start = (int) (bandEdge(x, bins) + 1e-9);
+        int end = (int) ceil(bandEdge(x + 1, bins) - 1e-9);
+        start = min(start, bins - 1);
+        end = max(start + 1, min(end, bins));
+
+        fftBandStart[x] = start;
+        fftBandEnd[x] = end;
+    }
+
+    fftBandSamples = n;
+    fftColumnGainBase = 0;
+}
 
-        // Short delay to make equidistant captures
-        delayMicroseconds(80);
+void Visualization::processBeat(const uint16_t *magnitude, int bins) {
+    // Fold the spectrum into bands of the same frequency range at every fft size. Effects with different fft sizes
+    // then feed the beat detector the same kind of input, so switching between them keeps its history
+    for (int b = 0; b < BEAT_BANDS; b++) {
+        int start = min(b * bins / BEAT_BANDS, bins - 1);
+        int end = max(start + 1, (b + 1) * bins / BEAT_BANDS);
+
+        uint32_t sum = 0;
+        for (int i = start; i < end; i++) sum += magnitude[i];
+        beatBands[b] = sum / (end - start);
     }
 
-    // Remove the dc offset by subtracting it from all values
-    dcOffset /= FFT_SAMPLES;
-    for (int i = 0; i < FFT_SAMPLES; i++) fftReal[i] -= dcOffset;
+    beat.process(beatBands, BEAT_BANDS, millis());
+}
+
+#ifdef FFT_FIXED_POINT
+
+// Q15 versions of the attack and release factors
+#define FFT_ATTACK_FIXED    ((int32_t) (FFT_ATTACK * 32768))
+#define FFT_RELEASE_FIXED   ((int32_t) (FFT_RELEASE * 32768))
+
+void Visualization::computeFFT(const int16_t *samples, int n) {
+    // Scale the 10 bit samples up to the input range of the fixed point fft
+    for (int i = 0; i < n; i++) fftSamples[i] = samples[i] << 4;
 
     // Calculate the FFT
-    FFT.Windowing(fftReal, FFT_SAMPLES, FFT_WIN_TYP_BLACKMAN_NUTTALL, FFT_FORWARD);
-    FFT.Compute(fftReal, fftImag, FFT_SAMPLES, FFT_FORWARD);
-    FFT.ComplexToMagnitude(fftReal, fftImag, FFT_SAMPLES);
+    if (FFT.getSamples() != n) FFT.setSamples(n);
+    FFT.compute(fftSamples, fftMagnitude);
+    processBeat(fftMagnitude, n / 2);
+
+    // Precompute the gain of each column. This folds the fftGain, the frequency dependent gain, the number of bins per
+    // column and the scaling of the fixed point fft into a single factor, so the loop below needs no floating point math
+    if (n != fftBandSamples) buildBands(n);
+    if (fftGain != fftColumnGainBase) {
+        fftColumnGainBase = fftGain;
+        for (int x = 0; x < MATRIX_WIDTH; x++) {
+            double gain = fftGain * exp(x / (double) MATRIX_WIDTH) * n / 16 / (fftBandEnd[x] - fftBandStart[x]);
+            fftColumnGain[x] = (int64_t) (gain * 32768 * 65536);
+        }
+    }
 
-    // Scale the frequency and amplitude and smooth out the fft
+    // Scale the frequency and amplitude and smooth out the fft. The levels stay in Q15, which is what the effects get
     fftPeak = 0;
     fftPeakVal = 0;
     for (int x = 0; x < MATRIX_WIDTH; x++) {
-        int sum = 0;
-        double val = 0;
+        // Sum up the bins of the column
+        int32_t sum = 0;
+        for (int i = fftBandStart[x]; i < fftBandEnd[x]; i++) sum += fftMagnitude[i];
+
+        // Scale the fft and keep the value in bounds
+        int32_t val = (int32_t) min((sum * fftColumnGain[x]) >> 16, (int64_t) 32768);
+
+        // Apply the attack and decay
+        int32_t factor = val > fftLevel[x] ? FFT_ATTACK_FIXED : FFT_RELEASE_FIXED;
+        fftLevel[x] = (fftLevel[x] * factor + val * (32768 - factor)) >> 15;
+        if (fftLevel[x] > fftPeakVal) {
+            fftPeakVal = fftLevel[x];
+            fftPeak = x;
+        }
+    }
+}
+
+#else
+
+void Visualization::computeFFT(const int16_t *samples, int n) {
+    for (int i = 0; i < n; i++) {
+        fftReal[i] = samples[i];
+        fftImag[i] = 0;
+    }
 
-        // Average all nearby frequency bands to scale the frequency range to MATRIX_WIDTH
-        double l = FFT_SAMPLES / (double) MATRIX_WIDTH / 2;
-        for (int i = (int) (x * l); i < (x + 1) * l; i++) {
-            val += fftReal[i];
-            sum++;
+    // Calculate the FFT
+    FFT.Windowing(fftReal, n, FFT_WIN_TYP_BLACKMAN_NUTTALL, FFT_FORWARD);
+    FFT.Compute(fftReal, fftImag, n, FFT_FORWARD);
+    FFT.ComplexToMagnitude(fftReal, fftImag, n);
+
+    // The beat detector expects the magnitudes of the fixed point fft
+    uint16_t magnitude[FFT_SAMPLES / 2];
+    for (int i = 0; i < n / 2; i++) magnitude[i] = (uint16_t) min(fftReal[i] * 16 / n, 65535.0);
+    processBeat(magnitude, n / 2);
+
+    // Precompute the gain of each column: The fftGain, the frequency dependent gain and the number of bins per column
+    if (n != fftBandSamples) buildBands(n);
+    if (fftGain != fftColumnGainBase) {
+        fftColumnGainBase = fftGain;
+        for (int x = 0; x < MATRIX_WIDTH; x++) {
+            fftColumnGain[x] = fftGain * exp(x / (double) MATRIX_WIDTH) / (fftBandEnd[x] - fftBandStart[x]);
         }
+    }
 
-        // Scale the fft
-        val *= fftGain / sum;
-        val *= exp(x / (double) MATRIX_WIDTH);
+    // Scale the frequency and amplitude and smooth out the fft
+    fftPeak = 0;
+    fftPeakVal = 0;
+    for (int x = 0; x < MATRIX_WIDTH; x++) {
+        // Average the bins of the column and scale the fft
+        double val = 0;
+        for (int i = fftBandStart[x]; i < fftBandEnd[x]; i++) val += fftReal[i];
+        val *= fftColumnGain[x];
 
         //val *= sqrt(val);
 
@@ -68,32 +257,112 @@ void Visualization::update(CRGB *leds) {
 
         if (val > fftVal[x]) fftVal[x] = fftVal[x] * FFT_ATTACK + val * (1 - FFT_ATTACK);
         else fftVal[x] = fftVal[x] * FFT_RELEASE + val * (1 - FFT_RELEASE);
-        if (fftVal[x] > fftPeakVal) {
-            fftPeakVal = fftVal[x];
-            fftPeak = x / (double) (MATRIX_WIDTH - 1);
+        fftLevel[x] = (int32_t) (fftVal[x] * EFFECT_LEVEL_MAX);
+        if (fftLevel[x] > fftPeakVal) {
+            fftPeakVal = fftLevel[x];
+            fftPeak = x;
         }
     }
+}
+
+#endif
+
+void Visualization::endEffect() {
+    // Release the state of the effect
+    if (effectActive) effects[currentVis]->teardown();
+    effectActive = false;
+    effectFailed = false;
+}
+
+void Visualization::end() {
+    endEffect();
+    endTransition();
+}
+
+void Visualization::beginTransition() {
+    if (numEffects == 0) return;
+    endTransition();
+
+    // The selected effect keeps its state, so selecting the next one doesn't release it
+    fadingVis = currentVis;
+    fadingActive = effectActive;
+    effectActive = false;
+    effectFailed = false;
+}
+
+void Visualization::endTransition() {
+    if (fadingVis >= 0 && fadingActive) effects[fadingVis]->teardown();
+    fadingVis = -1;
+    fadingActive = false;
+}
+
+int Visualization::findVis(const String &name) {
+    for (int i = 0; i < numEffects; i++) {
+        if (name.equals(effects[i]->name)) return i;
+    }
+    return -1;
+}
+
+bool Visualization::addEffect(Effect *effect) {
+    if (numEffects >= VISUALIZATION_MAX_EFFECTS) return false;
+
+    // The inputs are computed from fftSamples samples
+    if (effect->inputs && (effect->fftSamples < 2 || (effect->fftSamples & (effect->fftSamples - 1)) != 0)) {
+        WARN("Effect has inputs but no valid fft size")
+        return false;
+    }
+
+    effects[numEffects++] = effect;
+    return true;
+}
+
+int Visualization::getNumEffects() {
+    return numEffects;
+}
 
-    // Update the selected visualization
-    updateFuncs[currentVis](leds, colorBuf, palette, fftVal, fftPeak, fftPeakVal);
+Effect *Visualization::getEffect(int index) {
+    if (index < 0 || index >= numEffects) return NULL;
+    return effects[index];
+}
+
+Effect *Visualization::getCurrentEffect() {
+    return getEffect(currentVis);
 }
 
 void Visualization::nextVis() {
+    if (numEffects == 0) return;
+    endEffect();
+
     // Increase the visualization index
     currentVis++;
-    if (currentVis >= NUM_VISUALIZATIONS) currentVis = 0;
+    if (currentVis >= numEffects) currentVis = 0;
 }
 
 void Visualization::prevVis() {
+    if (numEffects == 0) return;
+    endEffect();
+
     // Decrease the visualization index
     currentVis--;
-    if (currentVis < 0) currentVis = NUM_VISUALIZATIONS - 1;
+    if (currentVis < 0) currentVis = numEffects - 1;
+}
+
+bool Visualization::setVis(const String &name) {
+    int i = findVis(name);
+    if (i < 0) return false;
+
+    if (i != currentVis) {
+        endEffect();
+        currentVis = i;
+    }
+    return true;
 }
 
 // Getters and setters for the palette
 bool Visualization::setPaletteColor(int index, CRGB color) {
     if (index < 0 || index >= VISUALIZATION_PALETTE_SIZE) return false;
     palette[index] = color;
+    paletteChanged = true;
     return true;
 }
 CRGB Visualization::getPaletteColor(int index) {
@@ -104,165 +373,6 @@ CRGB *Visualization::getPalette() {
     return palette;
 }
 
-// BARS renders a spectrum style bargraph
-void v_bars(CRGB leds[], CRGB colorBuf[], CRGB palette[], double fftVal[], double fftPeak, double fftPeakVal) {
-    for (int x = 0; x < MATRIX_WIDTH; x++) {
-        // Calc the threshold values
-        double thresh_d = MATRIX_HEIGHT - fftVal[x] * MATRIX_HEIGHT;
-        int thresh = (int) thresh_d;
-        fract8 factor = (fract8) ((1 + thresh - thresh_d) * 255);
-
-        for (int y = 0; y < MATRIX_HEIGHT; y++) {
-            CRGB color;
-            CRGB color_fg = blend(
-                blend(
-                    palette[4],
-                    palette[3],
-                    x * 255 / (MATRIX_WIDTH - 1)
-                ),
-                blend(
-                    palette[2],
-                    palette[1],
-                    x * 255 / (MATRIX_WIDTH - 1)
-                ),
-                y * 255 / (MATRIX_HEIGHT - 1)
-            );
-
-            if (y > thresh) {
-                // Foreground
-                color = color_fg;
-            } else if (y == thresh) {
-                // Blend
-                color = blend(palette[0], color_fg, factor);
-            } else {
-                // Background
-                color = palette[0];
-            }
-            leds[x + y * MATRIX_WIDTH] = color;
-        }
-    }
-}
-
-// SWIRL renders a rotating swirl with colors mapped to the peak frequency and brightness mapped to the amplitude
-void v_swirl(CRGB leds[], CRGB colorBuf[], CRGB palette[], double fftVal[], double fftPeak, double fftPeakVal) {
-    // Get the new color
-    /* int a = fftVal[0] * 255 / MATRIX_HEIGHT;
-    int b = max(0, (int) (a - fftVal[MATRIX_WIDTH / 2] * 255 / MATRIX_HEIGHT));
-    int c = max(0, (int) (a - fftVal[MATRIX_WIDTH - 1] * 255 / MATRIX_HEIGHT)); */
-    
-    //CRGB col = CHSV((int) (fftPeak * 255), 255, (int) (fftPeakVal * 128) + 127);
-    CRGB col = blend(
-        palette[0],
-        blend(
-            blend(
-                palette[1],
-                palette[2],
-                fftVal[0] * 255
-            ),
-            blend(
-                palette[3],
-                palette[4],
-                fftVal[MATRIX_WIDTH / 2] * 255
-            ),
-            fftVal[MATRIX_WIDTH - 1] * 255
-        ),
-        fftPeakVal * 255
-    );
-
-    // Shift it into the color buffer array
-    for (int i = MATRIX_WIDTH * MATRIX_HEIGHT / 2 - 1; i > 0; i--)
-        colorBuf[i] = colorBuf[i - 1];
-    colorBuf[0] = col;
-
-    int wMax = MATRIX_WIDTH - 1;
-    int hMax = MATRIX_HEIGHT - 2;
-    int direction = 0;
-
-    int px = -1;
-    int py = 0;
-    int l = 0;
-
-    for (int i = 0; i < MATRIX_WIDTH * MATRIX_HEIGHT / 2; i++) {
-        /*Serial.print(i);
-        Serial.print(": ");*/
-        if (direction == 0 && l > wMax) {
-            l = 0;
-            wMax--;
-            hMax--;
-            direction = 1;
-            /*Serial.print("reset l=0, wMax=");
-            Serial.print(wMax);
-            Serial.print(", hMax=");
-            Serial.print(hMax);
-            Serial.print(", direction=");
-            Serial.print(direction);*/
-        } else if (direction == 1 && l > hMax) {
-            l = 0;
-            wMax--;
-            hMax--;
-            direction = 2;
-            /*Serial.print("reset l=0, wMax=");
-            Serial.print(wMax);
-            Serial.print(", hMax=");
-            Serial.print(hMax);
-            Serial.print(", direction=");
-            Serial.print(direction);*/
-        } else if (direction == 2 && l > wMax) {
-            l = 0;
-            wMax--;
-            hMax--;
-            direction = 3;
-            /*Serial.print("reset l=0, wMax=");
-            Serial.print(wMax);
-            Serial.print(", hMax=");
-            Serial.print(hMax);
-            Serial.print(", direction=");
-            Serial.print(direction);*/
-        } else if (direction == 3 && l > hMax) {
-            l = 0;
-            wMax--;
-            hMax--;
-            direction = 0;
-            /*Serial.print("reset l=0, wMax=");
-            Serial.print(wMax);
-            Serial.print(", hMax=");
-            Serial.print(hMax);
-            Serial.print(", direction=");
-            Serial.print(direction);*/
-        }
-
-        if (direction == 0) px++;
-        if (direction == 1) py++;
-        if (direction == 2) px--;
-        if (direction == 3) py--;
-
-        leds[toLedPos(px, py)] = colorBuf[i];
-        leds[toLedPos(MATRIX_WIDTH - px - 1, MATRIX_HEIGHT - py - 1)] = colorBuf[i];
-
-        /*Serial.print("p=");
-        Serial.print(px);
-        Serial.print(",");
-        Serial.println(py);*/
-
-        l++;
-    }
-}
-
-// HEATMAP renders a top to bottom heatmap
-void v_heatmap(CRGB leds[], CRGB colorBuf[], CRGB palette[], double fftVal[], double fftPeak, double fftPeakVal) {
-    // Shift all columns to the left
-    for (int x = 0; x < MATRIX_WIDTH - 1; x++)
-        for (int y = 0; y < MATRIX_HEIGHT; y++)
-            leds[x + y * MATRIX_WIDTH] = CRGB(leds[x + 1 + y * MATRIX_WIDTH]);
-
-    // Set the right led column to the new color
-    for (int y = 0; y < MATRIX_HEIGHT; y++) {
-        CRGB color;
-        double v = fftVal[y * MATRIX_WIDTH / MATRIX_HEIGHT];
-        if (v < 0.25) color = blend(palette[0], palette[1], v * 4 * 255);
-        else if (v < 0.5) color = blend(palette[1], palette[2], (v * 4 - 1) * 255);
-        else if (v < 0.75) color = blend(palette[2], palette[3], (v * 4 - 2) * 255);
-        else color = blend(palette[3], palette[4], v * 4 - 3);
-        leds[y * MATRIX_WIDTH + MATRIX_WIDTH - 1] = color;
-    }
+BeatDetector<BEAT_BANDS> &Visualization::getBeatDetector() {
+    return beat;
 }
\ No newline at end of file
@@ -2,48 +2,115 @@
 #define VISUALIZATION_H
 
 #include "Settings.h"
+#include "Effect.h"
 
 #include <FastLED.h>
-#include <arduinoFFT.h>
+#include <BeatDetector.h>
+#ifdef FFT_FIXED_POINT
+    #include <FixedFFT.h>
+#else
+    #include <arduinoFFT.h>
+#endif
 
 //#define VISUALIZATION_EMULATE_INPUT
-#define VISUALIZATION_PALETTE_SIZE  5
-#define NUM_VISUALIZATIONS          3
+#define VISUALIZATION_MAX_EFFECTS   8
 
-// Visualization update functions
-void v_bars(CRGB*, CRGB*, CRGB*, double*, double, double);
-void v_swirl(CRGB*, CRGB*, CRGB*, double*, double, double);
-void v_heatmap(CRGB*, CRGB*, CRGB*, double*, double, double);
+// Mappings of the fft bins to the columns
+#define FFT_SCALE_LINEAR            0   // Every column spans the same number of bins
+#define FFT_SCALE_LOG               1   // Every column spans the same frequency ratio
+#define FFT_SCALE_MEL               2   // Every column spans the same number of mels (perceived pitch)
 
+#ifndef FFT_SCALE
+    #define FFT_SCALE               FFT_SCALE_LINEAR
+#endif
+#ifndef MIC_SAMPLE_RATE
+    #define MIC_SAMPLE_RATE         10000
+#endif
+
+// The beat detector gets the spectrum folded into this many bands, so its input doesn't change with the fft size of
+// the effect
+#define BEAT_BANDS                  8
+
+
+/*
+ * Captures the microphone and renders the selected effect. Effects are added at run time with addEffect() and
+ * selected by their index or name. Only the inputs the selected effect asks for are computed, the fft runs at the
+ * resolution the effect requested.
+ */
 class Visualization {
     private:
-        int currentVis;                 // Current visualization id
-        void (*updateFuncs[NUM_VISUALIZATIONS])(CRGB*, CRGB*, CRGB*, double[], double, double) = {
-            &v_bars, &v_swirl, &v_heatmap
-        }; // Array of update functions
+        Effect *effects[VISUALIZATION_MAX_EFFECTS];     // Registered effects
+        int numEffects;
+        int currentVis;                 // Index of the selected effect
+        bool effectActive;              // The selected effect was initialized
+        bool effectFailed;              // The selected effect couldn't be initialized
+        bool paletteChanged;            // The palette changed since the effect got it
+        int fadingVis;                  // Index of the effect that is faded out by a transition, -1 if there is none
+        bool fadingActive;              // The faded out effect is initialized
 
+        #ifdef FFT_FIXED_POINT
+        FixedFFT<FFT_SAMPLES> FFT;
+        int16_t fftSamples[FFT_SAMPLES];            // Captured samples
+        uint16_t fftMagnitude[FFT_SAMPLES / 2];     // Magnitude of the frequency bins
+        int64_t fftColumnGain[MATRIX_WIDTH];        // Q16 gain of each column
+        #else
         arduinoFFT FFT;
         double fftReal[FFT_SAMPLES];    // Real part of the fft
         double fftImag[FFT_SAMPLES];    // Imaginary part of the fft
-        double fftVal[MATRIX_WIDTH];    // Actual fft values
-        double fftPeak;                 // Position of the peak (0 to 1)
-        double fftPeakVal;              // Value of the peak (0 to MATRIX_HEIGHT)
+        double fftColumnGain[MATRIX_WIDTH];         // Gain of each column
+        double fftVal[MATRIX_WIDTH];                // Actual fft values
+        #endif
+        uint16_t fftBandStart[MATRIX_WIDTH];        // First bin of each column
+        uint16_t fftBandEnd[MATRIX_WIDTH];          // Bin after the last bin of each column
+        int fftBandSamples;                         // Fft size the bands were calculated for
+        double fftColumnGainBase;                   // fftGain used to calculate the column gains
+        int16_t micSamples[FFT_SAMPLES];    // Captured microphone samples
+        int32_t fftLevel[MATRIX_WIDTH]; // Level of each column passed to the effects (0 to EFFECT_LEVEL_MAX)
+        int fftPeak;                    // Column of the peak
+        int32_t fftPeakVal;             // Level of the peak (0 to EFFECT_LEVEL_MAX)
+        uint16_t beatBands[BEAT_BANDS];                 // Mean magnitude of the bins of each band
+        BeatDetector<BEAT_BANDS> beat;                  // Onsets and tempo, from the bands of every fft
         CRGB palette[VISUALIZATION_PALETTE_SIZE];       // Palette colors: Background, colA, colB, colC, colD
-        CRGB colorBuf[MATRIX_WIDTH * MATRIX_HEIGHT];    // Color buffer used by some visualizations
+
+        void computeFFT(const int16_t *samples, int n);
+        void buildBands(int n);
+        void processBeat(const uint16_t *magnitude, int bins);
+        void endEffect();
 
     public:
         Visualization();
 
         double fftGain;
 
-        void update(CRGB *leds);
+        // Registers an effect. Returns false if there are already VISUALIZATION_MAX_EFFECTS effects or the effect has
+        // inputs but its fftSamples isn't a power of 2 of at least 2
+        bool addEffect(Effect *effect);
+        int getNumEffects();
+        Effect *getEffect(int index);
+        Effect *getCurrentEffect();
+
+        // Renders the next frame if new samples are available. Returns true if the leds were changed. During a
+        // transition, the effect that is faded out is rendered into fadingLeds from the same input
+        bool update(CRGB *leds, CRGB *fadingLeds = NULL);
+
+        // Releases the state of the selected effect (and of the faded out one) until the next update
+        void end();
+
+        // Keeps the selected effect running for a transition, the next effect is selected with nextVis(), prevVis()
+        // or setVis(). endTransition() releases the faded out effect
+        void beginTransition();
+        void endTransition();
+        int findVis(const String &name);
 
         void nextVis();
         void prevVis();
+        bool setVis(const String &name);
 
         bool setPaletteColor(int index, CRGB color);
         CRGB getPaletteColor(int index);
         CRGB *getPalette();
+
+        BeatDetector<BEAT_BANDS> &getBeatDetector();
 };
 
 
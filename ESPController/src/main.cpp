@@ -10,7 +10,17 @@
 #include <FastLED.h>                    // FastLED for controlling WS2812B
 #include "FileIO.h"                     // Handles SPIFFS input / output
 #include "GifDecoder.h"                 // Custom lib for decoding gif files
+#include "GifValidator.h"               // Checks gif uploads while they are received
+#include "MAFDecoder.h"                 // Decoder for transcoded animation files
+#include "MatrixStream.h"               // Binary led data stream for the virtual matrix
 #include "Visualization.h"              // Handles the fft visualizations
+#include "Effects.h"                    // Built in visualization effects
+#include "MicSampler.h"                 // Microphone sampling at a fixed rate
+#include "Scheduler.h"                  // Frame pacing
+#include "Profiler.h"                   // Run time histograms of the hot paths
+#include "SettingsStore.h"              // Persistent user settings
+#include "Output.h"                     // Led strip output in the wired order
+#include "Transition.h"                 // Blending between the sources
 
 FASTLED_USING_NAMESPACE
 
@@ -32,22 +42,74 @@ WiFiEventHandler onConnectedHandler;
 // HTTP WebServer
 ESP8266WebServer webserver(WEBSERVER_PORT);
 File currentUploadFile;
+String currentUploadFileName;
+GifValidator uploadValidator(MATRIX_WIDTH, MATRIX_HEIGHT);
+int uploadStatus = 400;
+String uploadMessage = "No gif file.";
 
-// Gif format decoder
+// Gif format decoder. There is only one, it draws into the layer of the slot that needs it (-1 if none)
 GifDecoder<MATRIX_WIDTH, MATRIX_HEIGHT, 12> gifDecoder;
+int gifSlot = -1;
 
-// Visualization handler
+// Decoders for the transcoded (pre-decoded) animation files, one per file slot, so the outgoing and the incoming
+// animation of a transition play at the same time. Used instead of the gif decoder if available
+MAFDecoder<MATRIX_WIDTH, MATRIX_HEIGHT> mafDecoders[FILE_IO_SLOTS];
+bool mafPlayback[FILE_IO_SLOTS];
+
+// Visualization handler and the built in effects
 Visualization visualization;
+BarsEffect barsEffect;
+SwirlEffect swirlEffect;
+HeatmapEffect heatmapEffect;
 
-// FastLED array represents the led strip
+// Layers of the sources (one per file slot) the renderers draw into, row by row. During a transition, the layers are
+// blended into the transition buffer. leds points to the back buffer that Output::present() turns into the front buffer
+// of the strip
 #define NUM_LEDS MATRIX_WIDTH * MATRIX_HEIGHT
-CRGB leds[NUM_LEDS];
+CRGB layerLeds[FILE_IO_SLOTS][NUM_LEDS];
+CRGB transitionLeds[NUM_LEDS];
+CRGB *leds = layerLeds[0];
+
+// Dirty frame tracking. The leds are only presented to the strip and the serial output if they (or the brightness) changed
+bool ledsDirty = true;
+bool ledsPushed;
+uint8_t pushedBrightness;
+unsigned long pushedFrames;
+unsigned long skippedFrames;
+
+// Encoder for the binary led data stream
+#if defined(SERIAL_MATRIX_DATA) && defined(SERIAL_MATRIX_BINARY)
+    MatrixStreamEncoder matrixStream(MATRIX_WIDTH, MATRIX_HEIGHT);
+#endif
+
+// A source is an animation or the visualization, rendered into the layer of its slot
+struct Source {
+    unsigned int mode;
+    int slot;
+};
 
-// Current mode and automatic cycling through all animations
+// Selected mode and automatic cycling through all animations
 unsigned int mode;
 unsigned int cycleDelay;
 unsigned long nextCycle;
 
+// The source that is shown and the one a transition fades to
+Source currentSource;
+Source incomingSource;
+int animationIndex;
+
+// Switch to the next source, prepared by the prepare task before the transition starts
+bool switchPending;
+int switchDirection;                    // Next (1) or previous (-1) animation / visualization, 0 to keep it
+int switchVis;                          // Index of the visualization to select, -1 to use the direction
+bool switchStore;                       // Store the settings once the switch is prepared
+
+// The neighbouring animation in the direction of the last switch is opened in the spare slot while nothing else is going
+// on, so switching to it only swaps the slots
+int prefetchIndex = -1;                 // Animation that was opened ahead, -1 if none
+int prefetchDirection;                  // Its direction from the current one
+bool prefetchReady;                     // Its header and palette are loaded and its first frame is decoded
+
 // Auto WiFI reconnection time
 unsigned long reconnectionTime;
 
@@ -58,54 +120,214 @@ unsigned long reconnectionTime;
  *    HELPER AND CONTROL METHODS    *
  ************************************/
 
-String generateAnimationFileName() {
-    String prefix = String(DIR_ANIMATIONS) + "/";
-    for (int i = 0; i < MAX_NUM_ANIMATIONS; i++) {
+void resetNextCycle() {
+    nextCycle = millis() + cycleDelay * 1000;
+}
 
-        String fileName = prefix + i + ".gif";
-        if (!SPIFFS.exists(fileName)) {
-            return fileName;
-        }
+void applySettings(const SettingsStore::StoredSettings &settings) {
+    mode = settings.mode == MODE_ANI ? MODE_ANI : MODE_VIS;
+    cycleDelay = settings.cycleDelay;
+    for (int i = 0; i < VISUALIZATION_PALETTE_SIZE; i++) {
+        visualization.setPaletteColor(i, CRGB(settings.palette[i][0], settings.palette[i][1], settings.palette[i][2]));
     }
+    visualization.setVis(settings.visualization);
 
-    FATAL("Could not get an empty filename.");
-    return String();
+    Output::setBrightness(settings.brightness);
+    Output::setGamma(settings.gamma);
+    Output::setDithering(settings.dithering != 0);
+    Output::setMaxMilliamps(settings.maxMilliamps);
 }
 
-void resetNextCycle() {
-    nextCycle = millis() + cycleDelay * 1000;
+void storeSettings() {
+    // Only updates the copy in ram. The store writes it to the flash once the changes settled
+    SettingsStore::StoredSettings settings;
+    memset(&settings, 0, sizeof(settings));
+    settings.mode = mode;
+    settings.cycleDelay = cycleDelay;
+    for (int i = 0; i < VISUALIZATION_PALETTE_SIZE; i++) {
+        CRGB color = visualization.getPaletteColor(i);
+        settings.palette[i][0] = color.r;
+        settings.palette[i][1] = color.g;
+        settings.palette[i][2] = color.b;
+    }
+    Effect *effect = visualization.getCurrentEffect();
+    if (effect) strncpy(settings.visualization, effect->name, SETTINGS_NAME_LENGTH - 1);
+
+    settings.brightness = Output::getBrightness();
+    settings.gamma = Output::getGamma();
+    settings.dithering = Output::getDithering() ? 1 : 0;
+    settings.maxMilliamps = Output::getMaxMilliamps();
+
+    SettingsStore::set(settings);
+}
+
+int prefetchSlot() {
+    // The slot that isn't shown
+    return (currentSource.slot + 1) % FILE_IO_SLOTS;
 }
 
-void loadNextAnimation() {
-    if (mode == MODE_ANI) {
-        // Load the new file
-        FileIO::nextGifFile();
+void dropPrefetch() {
+    if (prefetchIndex < 0) return;
 
-        // Start the decoder
-        gifDecoder.startDecoding();
-    } else if (mode == MODE_VIS) {
-        // Set the next visualization
-        visualization.nextVis();
+    // Close the files of the spare slot, unless the prefetched animation was switched to
+    if (prefetchReady) {
+        FileIO::selectSlot(prefetchSlot());
+        FileIO::closeGifFile();
     }
+    prefetchIndex = -1;
+    prefetchReady = false;
+}
 
-    // Reset the delay for the next cycle
-    resetNextCycle();
+bool isPrefetched() {
+    return prefetchReady && mode == MODE_ANI && currentSource.mode == MODE_ANI && switchDirection == prefetchDirection
+        && !Transition::isActive();
+}
+
+bool openAnimation(int slot, int index) {
+    // Start with a black layer, the incoming animation is faded in from there
+    fill_solid(layerLeds[slot], NUM_LEDS, CRGB::Black);
+
+    FileIO::selectSlot(slot);
+    mafPlayback[slot] = false;
+    if (!FileIO::openGifFile(index)) return false;
+
+    // Prefer the transcoded file, the gif decoder is only a fallback. The first frame is decoded right away, so the
+    // transition can start with it
+    mafPlayback[slot] = FileIO::hasMafFile() && mafDecoders[slot].initDecoder();
+    if (mafPlayback[slot]) {
+        mafDecoders[slot].advance(micros());
+        mafDecoders[slot].decodeFrame((uint8_t*) layerLeds[slot]);
+    }
+    return true;
 }
 
-void loadPrevAnimation() {
-    if (mode == MODE_ANI) {
-        // Load the new file
-        FileIO::prevGifFile();
+void prepareSource(const Source &source, int direction) {
+    if (source.mode == MODE_ANI && isPrefetched() && source.slot == prefetchSlot()) {
+        // The animation was opened and its first frame decoded ahead. It is shown from now on
+        animationIndex = prefetchIndex;
+        prefetchIndex = -1;
+        prefetchReady = false;
+        mafDecoders[source.slot].restartTiming(micros());
+        return;
+    }
+
+    // The source gets the spare slot
+    dropPrefetch();
+
+    if (source.mode == MODE_ANI) {
+        if (!openAnimation(source.slot, animationIndex + direction)) return;
+        animationIndex = FileIO::getGifFileId();
 
-        // Start the decoder
-        gifDecoder.startDecoding();
-    } else if (mode == MODE_VIS) {
-        // Set the previous visualization
-        visualization.nextVis();
+        if (!mafPlayback[source.slot]) {
+            // An outgoing animation that used the gif decoder keeps its last frame
+            gifSlot = source.slot;
+            gifDecoder.startDecoding();
+            gifDecoder.decodeFrame();
+        }
+    } else if (source.mode == MODE_VIS) {
+        // Start with a black layer, the incoming source is faded in from there
+        fill_solid(layerLeds[source.slot], NUM_LEDS, CRGB::Black);
+
+        if (switchVis >= 0) {
+            visualization.setVis(visualization.getEffect(switchVis)->name);
+        } else if (direction > 0) {
+            visualization.nextVis();
+        } else if (direction < 0) {
+            visualization.prevVis();
+        }
     }
+}
+
+void finishTransition() {
+    Source outgoing = currentSource;
+    currentSource = incomingSource;
+    Transition::stop();
+
+    // Release the outgoing source
+    if (outgoing.mode == MODE_ANI) {
+        FileIO::selectSlot(outgoing.slot);
+        FileIO::closeGifFile();
+        if (gifSlot == outgoing.slot) gifSlot = -1;
+    }
+    visualization.endTransition();
+
+    leds = layerLeds[currentSource.slot];
+    ledsDirty = true;
+}
+
+void prefetchAnimation() {
+    // Only while an animation is shown without a transition. Every animation is only tried once
+    if (mode != MODE_ANI || currentSource.mode != MODE_ANI || Transition::isActive() || prefetchIndex >= 0) return;
+    int numAnimations = FileIO::getNumGifFiles();
+    if (numAnimations == 0) return;
+
+    // The next one, unless the last switch went back
+    int slot = prefetchSlot();
+    prefetchDirection = switchDirection < 0 ? -1 : 1;
+    prefetchIndex = (animationIndex + prefetchDirection + numAnimations) % numAnimations;
+    if (!openAnimation(slot, prefetchIndex)) return;
+
+    // Animations played by the gif decoder are opened when they are switched to, as it is in use by the current one
+    prefetchReady = mafPlayback[slot];
+    if (!prefetchReady) FileIO::closeGifFile();
+}
+
+void prepareSwitch() {
+    switchPending = false;
+
+    // A new switch ends the running transition at once
+    if (Transition::isActive()) finishTransition();
+
+    // The incoming source gets the other slot. A visualization that is faded out keeps running
+    incomingSource.mode = mode;
+    incomingSource.slot = (currentSource.slot + 1) % FILE_IO_SLOTS;
+    if (currentSource.mode == MODE_VIS && incomingSource.mode == MODE_VIS) visualization.beginTransition();
+    prepareSource(incomingSource, switchDirection);
+
+    if (switchStore) storeSettings();
+    switchStore = false;
+
+    // Cuts switch right away
+    Transition::start(millis());
+    if (Transition::getType() == TRANSITION_CUT || Transition::getDuration() == 0) finishTransition();
+}
+
+void requestSwitch(unsigned int newMode, int direction, int visIndex, bool store) {
+    // Only the last request counts
+    mode = newMode;
+    switchPending = true;
+    switchDirection = direction;
+    switchVis = visIndex;
+    switchStore = switchStore || store;
 
     // Reset the delay for the next cycle
     resetNextCycle();
+
+    // A prefetched animation is swapped in right away, everything else is prepared outside of the frame tasks
+    if (isPrefetched()) prepareSwitch();
+}
+
+void renderAnimation(int slot) {
+    // The file callbacks of both decoders read from the selected slot
+    FileIO::selectSlot(slot);
+
+    if (mafPlayback[slot]) {
+        // Transcoded animations are decoded straight into the layer when the next frame is due
+        if (mafDecoders[slot].advance(micros())) {
+            PROFILE_BEGIN(MAF_DECODE)
+            mafDecoders[slot].decodeFrame((uint8_t*) layerLeds[slot]);
+            PROFILE_END(MAF_DECODE)
+            ledsDirty = true;
+        }
+
+        // Show the next frame when it is due instead of at the next frame of the scheduler
+        Scheduler::requestFrame(mafDecoders[slot].getNextDeadline());
+    } else if (gifSlot == slot) {
+        // Decode frame will handle the delay
+        PROFILE_BEGIN(GIF_DECODE)
+        gifDecoder.decodeFrame();
+        PROFILE_END(GIF_DECODE)
+    }
 }
 
 
@@ -116,7 +338,9 @@ void loadPrevAnimation() {
  *********************************/
 
 void onGifScreenClear() {
-    fill_solid(leds, NUM_LEDS, CRGB::Black);
+    if (gifSlot < 0) return;
+    fill_solid(layerLeds[gifSlot], NUM_LEDS, CRGB::Black);
+    ledsDirty = true;
 }
 
 void onGifUpdateScreen() {
@@ -128,8 +352,17 @@ void onGifDrawPixel(int16_t x, int16_t y, uint8_t red, uint8_t green, uint8_t bl
     if (x >= MATRIX_WIDTH) return;
     if (y < 0) return;
     if (y >= MATRIX_HEIGHT) return;
+    if (gifSlot < 0) return;
+
+    CRGB color(red, green, blue);
+    CRGB &led = layerLeds[gifSlot][x + y * MATRIX_WIDTH];
+    if (led == color) return;
+    led = color;
+    ledsDirty = true;
+}
 
-    leds[x + y * MATRIX_WIDTH] = CRGB(red, green, blue);
+void onMatrixStreamWrite(const uint8_t *buffer, int numberOfBytes) {
+    Serial.write(buffer, numberOfBytes);
 }
 
 
@@ -137,34 +370,84 @@ void onGifDrawPixel(int16_t x, int16_t y, uint8_t red, uint8_t green, uint8_t bl
  *    HTTP REQUEST AND WIFI EVENTS    *
  **************************************/
 
+void failAnimationFileUpload(int status, String message) {
+    // Only report the first error
+    if (uploadStatus != 200) return;
+    uploadStatus = status;
+    uploadMessage = message;
+    WARN(message.c_str())
+
+    // Remove the partially written file
+    if (currentUploadFile) {
+        currentUploadFile.close();
+        if (!SPIFFS.remove(currentUploadFileName)) WARN("Invalid file could not be removed")
+    }
+}
+
+void failAnimationFileUpload(int result) {
+    if (result == GIF_TRANSCODER_ERROR_NOT_GIF) {
+        failAnimationFileUpload(415, "Not a gif file.");
+    } else if (result == GIF_TRANSCODER_ERROR_WRONG_SIZE) {
+        failAnimationFileUpload(422, String("Gif file must be ") + MATRIX_WIDTH + "x" + MATRIX_HEIGHT + " pixels.");
+    } else {
+        failAnimationFileUpload(400, "Invalid gif file.");
+    }
+}
+
 void onAnimationFileUpload() {
     // Get the http upload
     HTTPUpload& upload = webserver.upload();
 
     if (upload.status == UPLOAD_FILE_START) {
-        // Create a new upload file and open it
-        String fileName = generateAnimationFileName();
-        DEBUGF("New gif file: %s\n", fileName.c_str());
-        currentUploadFile = SPIFFS.open(fileName, "w");
-    } else if (upload.status == UPLOAD_FILE_WRITE && currentUploadFile) {
-        // Write a chunk
-        currentUploadFile.write(upload.buf, upload.currentSize);
-    } else if (upload.status == UPLOAD_FILE_END && currentUploadFile) {
-        // Done. Close the file and send an OK message.
+        // Get a free file name. The file is only created once the gif header was checked
+        uploadStatus = 200;
+        uploadMessage = "";
+        uploadValidator.reset();
+        currentUploadFileName = FileIO::getFreeGifFileName();
+        if (currentUploadFileName.length() == 0) {
+            failAnimationFileUpload(507, "No free animation slot.");
+            return;
+        }
+        DEBUGF("New gif file: %s\n", currentUploadFileName.c_str());
+    } else if (upload.status == UPLOAD_FILE_WRITE && uploadStatus == 200) {
+        // Check the chunk before it is written to the flash
+        int result = uploadValidator.push(upload.buf, upload.currentSize);
+        if (result != GIF_TRANSCODER_OK) {
+            failAnimationFileUpload(result);
+            return;
+        }
+
+        // Write the chunk directly from the upload buffer
+        if (!currentUploadFile) currentUploadFile = SPIFFS.open(currentUploadFileName, "w");
+        if (!currentUploadFile || currentUploadFile.write(upload.buf, upload.currentSize) != upload.currentSize) {
+            failAnimationFileUpload(507, "Could not write the gif file.");
+            return;
+        }
+    } else if (upload.status == UPLOAD_FILE_END && uploadStatus == 200) {
+        // The file must be complete
+        int result = uploadValidator.finish();
+        if (result != GIF_TRANSCODER_OK) {
+            failAnimationFileUpload(result);
+            return;
+        }
+
+        // Done. Close the file and add it to the catalog with the info of the validator. This will also transcode it.
         currentUploadFile.close();
+        dropPrefetch();
+        if (FileIO::addGifFile(currentUploadFileName, uploadValidator.getWidth(), uploadValidator.getHeight(),
+                uploadValidator.getFrameCount(), uploadValidator.getSize())) {
+            // The catalog is sorted by slot, an animation inserted in front of the current one moves it back
+            if (FileIO::getGifFileIndex(currentUploadFileName) <= animationIndex) animationIndex++;
+        }
     } else if (upload.status == UPLOAD_FILE_ABORTED) {
         // Aborted. Close the file and remove it.
         if (currentUploadFile) {
             currentUploadFile.close();
-            if (!SPIFFS.remove(currentUploadFile.name())) {
+            if (!SPIFFS.remove(currentUploadFileName)) {
                 WARN("Canceled file could not be removed")
                 return;
             }
         }
-    } else {
-        // Something went wrong. Send an error message
-        WARN("File Upload failed.")
-        return;
     }
 }
 
@@ -214,16 +497,18 @@ bool onApiRequest(String path, HTTPMethod method) {
         path.replace("/api/animations/", "");
         int fileIndex = path.toInt();
 
-        // Send over the file
-        String fileName = FileIO::getNthGifFileName(fileIndex);
-
         // Check if the file exists
-        if (!SPIFFS.exists(fileName)) {
+        if (fileIndex < 0 || fileIndex >= FileIO::getNumGifFiles()) {
             webserver.send(404, "text/plain", "Gif file not found.");
+            return true;
         }
 
-        // Try to remove
-        if (SPIFFS.remove(fileName)) {
+        // Try to remove. The transcoded file is removed as well. The catalog changes, so the next animation is
+        // prefetched again
+        dropPrefetch();
+        if (FileIO::removeGifFile(fileIndex)) {
+            // Keep the index on the current animation. If it was removed, the next one moves into its place
+            if (fileIndex < animationIndex) animationIndex--;
             webserver.send(200);
         } else {
             webserver.send(500, "text/plain", "Could not delete gif file.");
@@ -235,14 +520,14 @@ bool onApiRequest(String path, HTTPMethod method) {
     // Load next animation / visualization
     if (method == HTTP_POST && path.equals("/api/control/next")) {
         // Load the next gif file and send an ok status
-        loadNextAnimation();
+        requestSwitch(mode, 1, -1, true);
         webserver.send(200);
     }
 
     // Load previous animation / visualization
     if (method == HTTP_POST && path.equals("/api/control/prev")) {
         // Load the previous gif file and send an ok status
-        loadPrevAnimation();
+        requestSwitch(mode, -1, -1, true);
         webserver.send(200);
     }
 
@@ -266,6 +551,7 @@ bool onApiRequest(String path, HTTPMethod method) {
         // (The animation would switch immediately when changing from 0 or a high number to a lower one)
         cycleDelay = value;
         resetNextCycle();
+        storeSettings();
 
         webserver.send(200);
         return true;
@@ -281,7 +567,12 @@ bool onApiRequest(String path, HTTPMethod method) {
         int newMode = webserver.arg("plain").toInt();
 
         if (newMode == MODE_ANI || newMode == MODE_VIS) {
-            mode = newMode;
+            // Fade over to the new mode
+            if (newMode != (int) mode) {
+                requestSwitch(newMode, 0, -1, true);
+            } else {
+                storeSettings();
+            }
             webserver.send(200);
         } else {
             webserver.send(400, "text/plain", "Invalid value for mode");
@@ -290,6 +581,52 @@ bool onApiRequest(String path, HTTPMethod method) {
         return true;
     }
 
+    // Get all visualization effects and the selected one
+    if (method == HTTP_GET && path.equals("/api/visualizations")) {
+        String json = "{\"current\":\"" + String(visualization.getCurrentEffect()->name) + "\",\"visualizations\":[";
+        for (int i = 0; i < visualization.getNumEffects(); i++) {
+            Effect *effect = visualization.getEffect(i);
+            if (i > 0) json += ",";
+            json += "{\"name\":\"" + String(effect->name) + "\",\"fftSamples\":" + String(min((int) effect->fftSamples, FFT_SAMPLES)) + "}";
+        }
+        json += "]}";
+
+        webserver.send(200, "application/json", json);
+        return true;
+    }
+
+    // Select a visualization effect by its name
+    if (method == HTTP_POST && path.equals("/api/visualizations")) {
+        int index = visualization.findVis(webserver.arg("plain"));
+        if (index < 0) {
+            webserver.send(404, "text/plain", "Unknown visualization.");
+            return true;
+        }
+
+        // Fade over to the visualization if it is shown, otherwise just select it
+        if (mode == MODE_VIS && visualization.getEffect(index) != visualization.getCurrentEffect()) {
+            requestSwitch(mode, 0, index, true);
+        } else {
+            visualization.setVis(webserver.arg("plain"));
+            resetNextCycle();
+            storeSettings();
+        }
+        webserver.send(200);
+
+        return true;
+    }
+
+    // Get the tempo and the onsets found by the beat detector
+    if (method == HTTP_GET && path.equals("/api/visualizations/beat")) {
+        BeatDetector<BEAT_BANDS> &beat = visualization.getBeatDetector();
+        webserver.send(200, "application/json", "{\"bpm\":" + String(beat.getBpm(), 1)
+            + ",\"onsets\":" + String(beat.getOnsets())
+            + ",\"lastOnset\":" + String(beat.getOnsets() ? millis() - beat.getLastOnset() : 0)
+            + ",\"flux\":" + String(beat.getFlux())
+            + ",\"threshold\":" + String(beat.getThreshold()) + "}");
+        return true;
+    }
+
     // Get all palette colors
     if (method == HTTP_GET && path.equals("/api/visualizations/palette")) {
 
@@ -324,6 +661,149 @@ bool onApiRequest(String path, HTTPMethod method) {
         return true;
     }
 
+    // Set a palette color. The body is the hex color ("#RRGGBB" or "RRGGBB")
+    if (method == HTTP_POST && path.startsWith("/api/visualizations/palette/")) {
+
+        // Get the palette index
+        path.replace("/api/visualizations/palette/", "");
+        int index = path.toInt();
+
+        // Parse the color
+        String hex = webserver.arg("plain");
+        if (hex.startsWith("#")) hex = hex.substring(1);
+        char *end;
+        uint32_t value = strtoul(hex.c_str(), &end, 16);
+        if (hex.length() != 6 || *end != '\0') {
+            webserver.send(400, "text/plain", "Invalid color.");
+            return true;
+        }
+
+        if (visualization.setPaletteColor(index, CRGB(value))) {
+            storeSettings();
+            webserver.send(200);
+        } else {
+            webserver.send(404, "text/plain", "Invalid palette index.");
+        }
+
+        return true;
+    }
+
+    // Get the frame timing and the run time of all scheduler tasks
+    if (method == HTTP_GET && path.equals("/api/scheduler")) {
+        webserver.send(200, "application/json", Scheduler::getStatsJson());
+        return true;
+    }
+
+    // Reset the scheduler statistics
+    if (method == HTTP_DELETE && path.equals("/api/scheduler")) {
+        Scheduler::resetStats();
+        pushedFrames = 0;
+        skippedFrames = 0;
+        webserver.send(200);
+        return true;
+    }
+
+    // Get the number of frames that were pushed to the leds and that were skipped because nothing changed
+    if (method == HTTP_GET && path.equals("/api/scheduler/leds")) {
+        webserver.send(200, "application/json", "{\"pushed\":" + String(pushedFrames) + ",\"skipped\":" + String(skippedFrames) + "}");
+        return true;
+    }
+
+    // Get the settings of the output stage
+    if (method == HTTP_GET && path.equals("/api/output")) {
+        webserver.send(200, "application/json", "{\"brightness\":" + String(Output::getBrightness())
+            + ",\"gamma\":" + String(Output::getGamma(), 2)
+            + ",\"dithering\":" + String(Output::getDithering() ? "true" : "false")
+            + ",\"maxMilliamps\":" + String(Output::getMaxMilliamps()) + "}");
+        return true;
+    }
+
+    // Set the brightness (0 to 255)
+    if (method == HTTP_POST && path.equals("/api/output/brightness")) {
+        int value = webserver.arg("plain").toInt();
+        if (value < 0 || value > 255) {
+            webserver.send(400, "text/plain", "Invalid value for brightness.");
+            return true;
+        }
+
+        Output::setBrightness(value);
+        storeSettings();
+        webserver.send(200);
+        return true;
+    }
+
+    // Set the gamma of the leds (1.0 to 3.0, 1.0 is linear)
+    if (method == HTTP_POST && path.equals("/api/output/gamma")) {
+        float value = webserver.arg("plain").toFloat();
+        if (value < 1.0 || value > 3.0) {
+            webserver.send(400, "text/plain", "Invalid value for gamma.");
+            return true;
+        }
+
+        Output::setGamma(value);
+        storeSettings();
+        ledsDirty = true;
+        webserver.send(200);
+        return true;
+    }
+
+    // Enable (1) or disable (0) the temporal dithering
+    if (method == HTTP_POST && path.equals("/api/output/dithering")) {
+        String value = webserver.arg("plain");
+        if (!value.equals("0") && !value.equals("1")) {
+            webserver.send(400, "text/plain", "Invalid value for dithering.");
+            return true;
+        }
+
+        Output::setDithering(value.equals("1"));
+        storeSettings();
+        ledsDirty = true;
+        webserver.send(200);
+        return true;
+    }
+
+    // Set the current budget in mA (0 for no limit)
+    if (method == HTTP_POST && path.equals("/api/output/power")) {
+        int value = webserver.arg("plain").toInt();
+        if (value < 0) {
+            webserver.send(400, "text/plain", "Invalid value for the current.");
+            return true;
+        }
+
+        Output::setMaxMilliamps(value);
+        storeSettings();
+        ledsDirty = true;
+        webserver.send(200);
+        return true;
+    }
+
+    // Get the current estimate, the limited brightness and the cost of the output stage
+    if (method == HTTP_GET && path.equals("/api/stats/output")) {
+        webserver.send(200, "application/json", Output::getStatsJson());
+        return true;
+    }
+
+    // Get the number of settings changes and how many of them were written to the flash
+    if (method == HTTP_GET && path.equals("/api/stats/settings")) {
+        webserver.send(200, "application/json", SettingsStore::getStatsJson());
+        return true;
+    }
+
+    #ifdef PROFILER
+        // Get the run time histograms of the hot paths
+        if (method == HTTP_GET && path.equals("/api/stats")) {
+            webserver.send(200, "application/json", Profiler::getStatsJson());
+            return true;
+        }
+
+        // Reset the histograms
+        if (method == HTTP_DELETE && path.equals("/api/stats")) {
+            Profiler::reset();
+            webserver.send(200);
+            return true;
+        }
+    #endif
+
     // We got an invalid path, returning false will send a 404 Not Found response
     return false;
 }
@@ -413,6 +893,131 @@ void connectWiFi() {
 }
 
 
+/*************************
+ *    SCHEDULER TASKS    *
+ *************************/
+
+void taskRender() {
+    // Cycle through all animations / visualizations. The switch is prepared by the prepare task, unless the next
+    // animation was prefetched
+    if (cycleDelay > 0 && millis() > nextCycle) requestSwitch(mode, 1, -1, false);
+
+    // During a transition, the outgoing and the incoming source are rendered into their own layers
+    bool transition = Transition::isActive();
+    bool incomingVis = transition && incomingSource.mode == MODE_VIS;
+
+    // ======== VISUALIZATION MODE ========
+    if (currentSource.mode == MODE_VIS || incomingVis) {
+        #ifdef MIC_SAMPLER
+            // Start sampling if not done yet
+            MicSampler::begin(MIC_SAMPLE_RATE);
+        #endif
+
+        // Update will read the samples, create the fft and update the visualization. When fading from one visualization
+        // to another, the outgoing effect keeps drawing into its layer
+        CRGB *visLeds = layerLeds[incomingVis ? incomingSource.slot : currentSource.slot];
+        CRGB *fadingLeds = incomingVis && currentSource.mode == MODE_VIS ? layerLeds[currentSource.slot] : NULL;
+        if (visualization.update(visLeds, fadingLeds)) ledsDirty = true;
+    } else {
+        #ifdef MIC_SAMPLER
+            // The microphone is only needed by the visualizations
+            MicSampler::end();
+        #endif
+
+        // Free the memory of the visualization effect
+        visualization.end();
+    }
+
+    // ======== ANIMATION MODE ========
+    if (currentSource.mode == MODE_ANI) renderAnimation(currentSource.slot);
+    if (transition && incomingSource.mode == MODE_ANI) renderAnimation(incomingSource.slot);
+
+    // ======== TRANSITION ========
+    if (transition) {
+        PROFILE_BEGIN(TRANSITION)
+        bool blending = Transition::render(transitionLeds, layerLeds[currentSource.slot], layerLeds[incomingSource.slot], millis());
+        PROFILE_END(TRANSITION)
+
+        if (blending) {
+            leds = transitionLeds;
+            ledsDirty = true;
+        } else {
+            finishTransition();
+        }
+    }
+}
+
+void taskShow() {
+    // Skip the push (~7.7 ms with interrupts disabled at 256 leds) if the strip already shows this frame. Dithered
+    // frames change on their own, but only on the strip
+    ledsPushed = ledsDirty || Output::getBrightness() != pushedBrightness;
+    if (!ledsPushed && !Output::isDithering()) {
+        skippedFrames++;
+        return;
+    }
+    ledsDirty = false;
+    pushedBrightness = Output::getBrightness();
+    pushedFrames++;
+
+    // Update the led matrix
+    PROFILE_BEGIN(SHOW)
+    Output::present(leds);
+    PROFILE_END(SHOW)
+}
+
+void taskSerialMatrixData() {
+    // Only dump frames that changed
+    if (!ledsPushed) return;
+
+    // Debug the current led data to the serial output
+    PROFILE_BEGIN(SERIAL)
+    #if defined(SERIAL_MATRIX_DATA) && defined(SERIAL_MATRIX_BINARY)
+        matrixStream.writeFrame((uint8_t*) leds);
+    #elif defined(SERIAL_MATRIX_DATA)
+        Serial.print("LEDDATA");
+        for (int i = 0; i < NUM_LEDS; i++) {
+            Serial.printf("%.2X%.2X%.2X", leds[i].r, leds[i].g, leds[i].b);
+        }
+        Serial.println();
+    #endif
+    PROFILE_END(SERIAL)
+}
+
+void taskPrepare() {
+    // Prepare a requested switch, or open the next animation in the time between the frames
+    if (switchPending) {
+        prepareSwitch();
+    } else {
+        prefetchAnimation();
+    }
+}
+
+void taskWiFi() {
+    // Reconnect WiFi and update mdns
+    connectWiFi();
+    MDNS.update();
+}
+
+void taskSettings() {
+    // Write the settings once they stopped changing
+    SettingsStore::update();
+}
+
+#ifdef MIC_SAMPLER
+void taskMicrophone() {
+    // Take the next microphone sample if it is due, the visualization reads them once a buffer is complete
+    MicSampler::sample();
+}
+#endif
+
+void taskWebserver() {
+    // Check for incoming http requests
+    PROFILE_BEGIN(HANDLE_CLIENT)
+    webserver.handleClient();
+    PROFILE_END(HANDLE_CLIENT)
+}
+
+
 /*****************************
  *    MAIN SETUP FUNCTION    *
  *****************************/
@@ -426,22 +1031,45 @@ void setup() {
     DEBUGLN("\n\nLED Matrix Controller. Developed by Amon Benson.\n")
 
     // Debug the matrix size to the serial output
-    #ifdef SERIAL_MATRIX_DATA
+    #if defined(SERIAL_MATRIX_DATA) && defined(SERIAL_MATRIX_BINARY)
+        matrixStream.setWriteCallback(onMatrixStreamWrite);
+        matrixStream.writeInfo();
+    #elif defined(SERIAL_MATRIX_DATA)
         Serial.printf("LEDINFO%.2X%.2X\n", MATRIX_WIDTH, MATRIX_HEIGHT);
     #endif
 
-    // Init variables TODO: Load from file / store when changed
-    mode = MODE_VIS;
-    cycleDelay = 0;
-    visualization.setPaletteColor(0, CRGB(0, 48, 73));      // Background
-    visualization.setPaletteColor(1, CRGB(214, 40, 40));    // Color A
-    visualization.setPaletteColor(2, CRGB(247, 127, 0));    // Color B
-    visualization.setPaletteColor(3, CRGB(252, 191, 73));   // Color C
-    visualization.setPaletteColor(4, CRGB(234, 226, 183));  // Color D
+    // Register the visualization effects
+    visualization.addEffect(&barsEffect);
+    visualization.addEffect(&swirlEffect);
+    visualization.addEffect(&heatmapEffect);
 
     // Init the SPIFFS and open the first gif file
     FileIO::init(DIR_ANIMATIONS);
 
+    // Register the led strip and load its layout
+    Output::begin();
+
+    // Load the settings. The defaults are used until the first change is stored
+    const uint8_t defaultPalette[VISUALIZATION_PALETTE_SIZE][3] = {
+        { 0, 48, 73 },          // Background
+        { 214, 40, 40 },        // Color A
+        { 247, 127, 0 },        // Color B
+        { 252, 191, 73 },       // Color C
+        { 234, 226, 183 }       // Color D
+    };
+    SettingsStore::StoredSettings defaults;
+    memset(&defaults, 0, sizeof(defaults));
+    defaults.mode = MODE_VIS;
+    defaults.cycleDelay = 0;
+    memcpy(defaults.palette, defaultPalette, sizeof(defaultPalette));
+    strncpy(defaults.visualization, "heatmap", SETTINGS_NAME_LENGTH - 1);
+    defaults.brightness = Output::getBrightness();
+    defaults.gamma = Output::getGamma();
+    defaults.dithering = Output::getDithering() ? 1 : 0;
+    defaults.maxMilliamps = Output::getMaxMilliamps();
+    SettingsStore::begin(defaults);
+    applySettings(SettingsStore::get());
+
     // Set the Gif decoder callback methods
     gifDecoder.setScreenClearCallback(onGifScreenClear);
     gifDecoder.setUpdateScreenCallback(onGifUpdateScreen);
@@ -452,9 +1080,21 @@ void setup() {
     gifDecoder.setFileReadCallback(FileIO::onGifFileRead);
     gifDecoder.setFileReadBlockCallback(FileIO::onGifFileReadBlock);
 
-    // Load the first animation and reset the cycle
-    // If in visualization mode, no preloading is needed
-    if (mode == MODE_ANI) loadNextAnimation();
+    // Set the Maf decoder callback methods
+    for (int i = 0; i < FILE_IO_SLOTS; i++) {
+        mafDecoders[i].setFileSeekCallback(FileIO::onMafFileSeek);
+        mafDecoders[i].setFileReadCallback(FileIO::onMafFileRead);
+        mafDecoders[i].setFileReadBlockCallback(FileIO::onMafFileReadBlock);
+        mafDecoders[i].setDefaultFrameDuration(MAF_DEFAULT_FRAME_DURATION);
+    }
+
+    // Load the first animation (or visualization) without a transition and reset the cycle
+    Transition::init();
+    currentSource.mode = mode;
+    currentSource.slot = 0;
+    switchVis = -1;
+    prepareSource(currentSource, 0);
+    leds = layerLeds[currentSource.slot];
     resetNextCycle();
 
     // Init WiFi
@@ -472,8 +1112,27 @@ void setup() {
         webserver.sendHeader("Access-Control-Max-Age", "10000");
         webserver.sendHeader("Access-Control-Allow-Methods", "GET,POST,PUT,DELETE,OPTIONS");
         webserver.sendHeader("Access-Control-Allow-Headers", "*");
-        webserver.send(200, "text/plain", "");
+        webserver.send(uploadStatus, "text/plain", uploadMessage);
+
+        // Until the next upload starts
+        uploadStatus = 400;
+        uploadMessage = "No gif file.";
     }, onAnimationFileUpload);
+
+    // Init the scheduler. The frame tasks run in this order at every frame
+    Scheduler::addTask("render", taskRender, TASK_FRAME);
+    Scheduler::addTask("show", taskShow, TASK_FRAME);
+    #ifdef SERIAL_MATRIX_DATA
+        Scheduler::addTask("serial", taskSerialMatrixData, TASK_FRAME);
+    #endif
+    Scheduler::addTask("wifi", taskWiFi, TASK_BACKGROUND);
+    Scheduler::addTask("webserver", taskWebserver, TASK_BACKGROUND);
+    Scheduler::addTask("prepare", taskPrepare, TASK_BACKGROUND);
+    Scheduler::addTask("settings", taskSettings, TASK_BACKGROUND);
+    #ifdef MIC_SAMPLER
+        Scheduler::addTask("microphone", taskMicrophone, TASK_BACKGROUND);
+    #endif
+    Scheduler::begin(TARGET_FPS);
 }
 
 
@@ -482,42 +1141,6 @@ void setup() {
  ****************************/
 
 void loop() {
-    // Reconnect WiFi
-    connectWiFi();
-
-    // Update mdns
-    MDNS.update();
-
-    // Check for incoming http requests
-    webserver.handleClient();
-
-    // Cycle through all animations / visualizations
-    if (cycleDelay > 0 && millis() > nextCycle) {
-        resetNextCycle();
-        loadNextAnimation();
-    }
-
-    // ======== ANIMATION MODE ========
-    if (mode == MODE_ANI) {
-        // Decode frame will handle the delay
-        gifDecoder.decodeFrame();
-    }
-
-    // ======== VISUALIZATION MODE ========
-    if (mode == MODE_VIS) {
-        // Update will take a sample, create the fft and update the visualization
-        visualization.update(leds);
-    }
-
-    // Update the led matrix
-    FastLED.show();
-
-    // Debug the current led data to the serial output
-    #ifdef SERIAL_MATRIX_DATA
-        Serial.print("LEDDATA");
-        for (int i = 0; i < NUM_LEDS; i++) {
-            Serial.printf("%.2X%.2X%.2X", leds[i].r, leds[i].g, leds[i].b);
-        }
-        Serial.println();
-    #endif
+    // Renders the frames at TARGET_FPS and handles the network in between
+    Scheduler::run();
 }
\ No newline at end of file
@@ -1,4 +1,5 @@
 import sys
+import binascii
 import serial
 import pygame
 
@@ -51,12 +52,14 @@ def parse(line):
 
 
 def parseLedData(data):
+    drawFrame(bytes.fromhex(data[:matrix_width * matrix_height * 6].decode('ascii')))
+
+
+def drawFrame(frame):
     for y in range(matrix_height):
         for x in range(matrix_width):
-            i = (x + y * matrix_width) * 6
-            red = int(data[i:i+2], 16)
-            green = int(data[i+2:i+4], 16)
-            blue = int(data[i+4:i+6], 16)
+            i = (x + y * matrix_width) * 3
+            red, green, blue = frame[i], frame[i + 1], frame[i + 2]
 
             pygame.draw.rect(screen, (red, green, blue), (
                 x * screen_width / matrix_width,
@@ -73,11 +76,148 @@ def parseLedData(data):
     pygame.display.update()
 
 
+# BINARY PROTOCOL (see ESPController/lib/MatrixStream/MatrixStream.h)
+SYNC = b'\xa5\x5a'
+TYPE_INFO, TYPE_RAW, TYPE_PALETTE, TYPE_RLE, TYPE_DELTA = 1, 2, 3, 4, 5
+
+class StreamDecoder:
+    def __init__(self):
+        self.buffer = bytearray()
+        self.frame = None
+        self.frame_valid = False
+        self.last_sequence = None
+
+    def feed(self, data):
+        """Parses the received data. Text lines are passed to parse(), frames are drawn."""
+        self.buffer += data
+
+        while True:
+            start = self.buffer.find(SYNC)
+
+            # Complete text lines in front of the next packet are passed to parse()
+            text_end = len(self.buffer) if start < 0 else start
+            newline = self.buffer.rfind(b'\n', 0, text_end)
+            if newline >= 0:
+                for line in bytes(self.buffer[:newline + 1]).splitlines(keepends=True):
+                    parse(line)
+                del self.buffer[:newline + 1]
+                continue
+
+            if start < 0:
+                # Don't let garbage without line breaks pile up
+                if len(self.buffer) > 65536:
+                    self.buffer.clear()
+                return
+
+            # Wait for the complete header and packet
+            if len(self.buffer) < start + 6:
+                return
+            packet_type = self.buffer[start + 2]
+            sequence = self.buffer[start + 3]
+            length = self.buffer[start + 4] | self.buffer[start + 5] << 8
+            if packet_type < TYPE_INFO or packet_type > TYPE_DELTA:
+                # False sync, skip it
+                del self.buffer[:start + 1]
+                continue
+            if len(self.buffer) < start + 6 + length + 2:
+                return
+
+            header_and_payload = bytes(self.buffer[start + 2:start + 6 + length])
+            crc = self.buffer[start + 6 + length] | self.buffer[start + 7 + length] << 8
+            del self.buffer[:start + 6 + length + 2]
+
+            if binascii.crc_hqx(header_and_payload, 0xffff) != crc:
+                print('--- crc error ---')
+                self.frame_valid = False
+                continue
+
+            # Delta frames can't be applied if a packet was lost
+            if self.last_sequence is None or sequence != (self.last_sequence + 1) & 0xff:
+                self.frame_valid = False
+            self.last_sequence = sequence
+
+            if not self.handle(packet_type, header_and_payload[4:]):
+                self.frame_valid = False
+
+    def handle(self, packet_type, payload):
+        global matrix_width, matrix_height
+
+        if packet_type == TYPE_INFO:
+            width = payload[0] | payload[1] << 8
+            height = payload[2] | payload[3] << 8
+            if (width, height) != (matrix_width, matrix_height) or self.frame is None:
+                matrix_width, matrix_height = width, height
+                self.frame = bytearray(width * height * 3)
+                self.frame_valid = False
+                print('--- matrix width: {0} ---'.format(matrix_width))
+                print('--- matrix height: {0} ---'.format(matrix_height))
+            return True
+
+        if self.frame is None:
+            return False
+        num_pixels = matrix_width * matrix_height
+
+        if packet_type == TYPE_RAW:
+            if len(payload) != num_pixels * 3:
+                return False
+            self.frame[:] = payload
+        elif packet_type == TYPE_PALETTE:
+            palette_size = payload[0] + 1
+            palette = payload[1:1 + palette_size * 3]
+            indices = payload[1 + palette_size * 3:]
+            if len(indices) != num_pixels or max(indices) >= palette_size:
+                return False
+            self.frame[:] = b''.join(palette[i * 3:i * 3 + 3] for i in indices)
+        elif packet_type == TYPE_RLE:
+            self.frame[:] = bytes(num_pixels * 3)
+            if not self.apply_operations(payload):
+                return False
+        elif packet_type == TYPE_DELTA:
+            if not self.frame_valid or not self.apply_operations(payload):
+                return False
+
+        self.frame_valid = True
+        drawFrame(self.frame)
+        return True
+
+    def apply_operations(self, payload):
+        num_pixels = matrix_width * matrix_height
+        i = 0
+        position = 0
+
+        while position < len(payload):
+            op = payload[position]
+            position += 1
+
+            if op < 0x80:
+                # Skip unchanged pixels
+                i += op + 1
+            elif op < 0xc0:
+                # Repeat a single color
+                run = op - 0x80 + 1
+                if position + 3 > len(payload) or i + run > num_pixels:
+                    return False
+                self.frame[i * 3:(i + run) * 3] = payload[position:position + 3] * run
+                position += 3
+                i += run
+            else:
+                # Literal colors
+                run = op - 0xc0 + 1
+                if position + run * 3 > len(payload) or i + run > num_pixels:
+                    return False
+                self.frame[i * 3:(i + run) * 3] = payload[position:position + run * 3]
+                position += run * 3
+                i += run
+
+        return i == num_pixels
+
+
 if __name__ == '__main__':
     print('Virtual Matrix. Developed by Amon Benson.\n')
 
     ser = serial.Serial('/dev/ttyUSB0', baud_rate)
+    decoder = StreamDecoder()
 
+    # Both the binary protocol and the LEDINFO / LEDDATA text commands are understood
     while True:
-        line = ser.readline()
-        parse(line)
+        decoder.feed(ser.read(ser.in_waiting or 1))
\ No newline at end of file
@@ -0,0 +1,68 @@
+"""
+Feeds a stream written by the encoder of ESPController/lib/MatrixStream through the StreamDecoder in chunks of random
+sizes and checks that it draws the same frames as the C++ decoder, passes the text lines on (including a frame of the
+text protocol) and detects every corrupted packet by its crc.
+
+Usage: python3 test.py <stream file> <frames file>
+"""
+
+import sys
+import io
+import types
+import random
+import struct
+import contextlib
+
+
+# The virtual matrix opens a window and a serial port, neither is needed to decode
+pygame = types.ModuleType('pygame')
+pygame.init = lambda: None
+pygame.display = types.SimpleNamespace(set_mode=lambda size: None)
+sys.modules['pygame'] = pygame
+sys.modules['serial'] = types.ModuleType('serial')
+
+import VirtualMatrix
+
+
+drawnFrames = []
+parsedLines = []
+
+def drawFrame(frame):
+    drawnFrames.append(bytes(frame))
+
+def parse(line):
+    parsedLines.append(line)
+    originalParse(line)
+
+originalParse = VirtualMatrix.parse
+VirtualMatrix.drawFrame = drawFrame
+VirtualMatrix.parse = parse
+
+
+if __name__ == '__main__':
+    with open(sys.argv[1], 'rb') as f:
+        stream = f.read()
+    with open(sys.argv[2], 'rb') as f:
+        width, height, frameCount, corruptedPackets, textLines = struct.unpack('<HHIII', f.read(16))
+        frameSize = width * height * 3
+        expectedFrames = [f.read(frameSize) for i in range(frameCount)]
+
+    decoder = VirtualMatrix.StreamDecoder()
+    output = io.StringIO()
+    rng = random.Random(1)
+    position = 0
+    with contextlib.redirect_stdout(output):
+        while position < len(stream):
+            length = rng.randint(1, 64)
+            decoder.feed(stream[position:position + length])
+            position += length
+
+    wrongFrames = sum(1 for drawn, expected in zip(drawnFrames, expectedFrames) if drawn != expected)
+    crcErrors = output.getvalue().count('--- crc error ---')
+    success = len(drawnFrames) == frameCount and wrongFrames == 0 and crcErrors == corruptedPackets \
+        and len(parsedLines) == textLines and (VirtualMatrix.matrix_width, VirtualMatrix.matrix_height) == (width, height)
+
+    print('virtual matrix: {0}x{1}, {2} of {3} frames drawn, {4} wrong, {5} of {6} crc errors, {7} of {8} text lines: {9}'.format(
+        VirtualMatrix.matrix_width, VirtualMatrix.matrix_height, len(drawnFrames), frameCount, wrongFrames, crcErrors,
+        corruptedPackets, len(parsedLines), textLines, 'OK' if success else 'FAILED'))
+    sys.exit(0 if success else 1)